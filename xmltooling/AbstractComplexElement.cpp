@@ -64,6 +64,7 @@ AbstractComplexElement::~AbstractComplexElement() {
 
 bool AbstractComplexElement::hasChildren() const
 {
+    materializeContent();
     if (m_children.empty())
         return false;
     return (find_if(m_children.begin(), m_children.end(), (_1 != ((XMLObject*)nullptr))) != m_children.end());
@@ -71,21 +72,30 @@ bool AbstractComplexElement::hasChildren() const
 
 const list<XMLObject*>& AbstractComplexElement::getOrderedChildren() const
 {
+    materializeContent();
     return m_children;
 }
 
 void AbstractComplexElement::removeChild(XMLObject* child)
 {
+    materializeContent();
+    if (child && child->m_slotted && child->getParent() == this) {
+        m_children.erase(child->m_slot);
+        child->m_slotted = false;
+        return;
+    }
     m_children.erase(remove(m_children.begin(), m_children.end(), child), m_children.end());
 }
 
 const XMLCh* AbstractComplexElement::getTextContent(unsigned int position) const
 {
+    materializeContent();
     return (m_text.size() > position) ? m_text[position] : nullptr;
 }
 
 void AbstractComplexElement::setTextContent(const XMLCh* value, unsigned int position)
 {
+    materializeContent();
     if (position > m_children.size())
         throw XMLObjectException("Can't set text content relative to non-existent child position.");
     vector<XMLCh*>::size_type size = m_text.size();
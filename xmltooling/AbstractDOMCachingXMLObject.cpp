@@ -28,10 +28,12 @@
 #include "AbstractDOMCachingXMLObject.h"
 #include "exceptions.h"
 #include "XMLObjectBuilder.h"
+#include "util/XMLConstants.h"
 #include "util/XMLHelper.h"
 
 #include <algorithm>
 #include <functional>
+#include <xercesc/util/PlatformUtils.hpp>
 
 using namespace xmltooling;
 using namespace xercesc;
@@ -39,12 +41,17 @@ using namespace std;
 
 using boost::scoped_ptr;
 
-AbstractDOMCachingXMLObject::AbstractDOMCachingXMLObject() : m_dom(nullptr), m_document(nullptr)
+namespace {
+    // Cached results of checking a DOM for signatures.
+    char g_signed, g_unsigned;
+};
+
+AbstractDOMCachingXMLObject::AbstractDOMCachingXMLObject() : m_dom(nullptr), m_document(nullptr), m_signatureCheck(nullptr)
 {
 }
 
 AbstractDOMCachingXMLObject::AbstractDOMCachingXMLObject(const AbstractDOMCachingXMLObject& src)
-    : AbstractXMLObject(src), m_dom(nullptr), m_document(nullptr)
+    : AbstractXMLObject(src), m_dom(nullptr), m_document(nullptr), m_signatureCheck(nullptr)
 {
 }
 
@@ -62,6 +69,7 @@ DOMElement* AbstractDOMCachingXMLObject::getDOM() const
 void AbstractDOMCachingXMLObject::setDOM(DOMElement* dom, bool bindDocument) const
 {
     m_dom = dom;
+    m_signatureCheck = nullptr;
     if (dom && bindDocument) {
         DOMDocument* doc = dom->getOwnerDocument();
         setDocument(doc);
@@ -85,6 +93,10 @@ void AbstractDOMCachingXMLObject::setDocument(DOMDocument* doc) const
 void AbstractDOMCachingXMLObject::releaseDOM() const
 {
     if (m_dom) {
+        if (isMaterializing())
+            return;
+        // Any content that was never unmarshalled only exists in the DOM.
+        materializeContent();
         if (m_log.isDebugEnabled()) {
             string qname=getElementQName().toString();
             m_log.debug("releasing cached DOM representation for (%s)", qname.empty() ? "unknown" : qname.c_str());
@@ -95,6 +107,22 @@ void AbstractDOMCachingXMLObject::releaseDOM() const
 
 void AbstractDOMCachingXMLObject::releaseParentDOM(bool propagateRelease) const
 {
+    if (isMaterializing())
+        return;
+
+    // Any change to this object or beneath it invalidates the ID indexes above it,
+    // which can only exist if one was built after the object or, for a child that's
+    // just been added, its parent joined the tree.
+    if (m_idIndexed || (getParent() && getParent()->m_idIndexed)) {
+        for (const XMLObject* obj = this; obj; obj = obj->getParent()) {
+            if (obj->m_idIndex) {
+                delete obj->m_idIndex;
+                obj->m_idIndex = nullptr;
+            }
+        }
+        m_idIndexed = false;
+    }
+
     if (getParent() && getParent()->getDOM()) {
         m_log.debug(
             "releasing cached DOM representation for parent object with propagation set to %s",
@@ -150,6 +178,45 @@ DOMElement* AbstractDOMCachingXMLObject::cloneDOM(DOMDocument* doc) const
     return nullptr;
 }
 
+bool AbstractDOMCachingXMLObject::requiresDOMClone() const
+{
+    if (!m_dom)
+        return false;
+
+    // The swap is a no-op that reads the cached result, since clones can be made concurrently.
+    const void* check = XMLPlatformUtils::compareAndSwap(&m_signatureCheck, nullptr, nullptr);
+    if (check)
+        return check == &g_signed;
+
+    // A DOM inside a parent's DOM that's known to be unsigned needn't be searched.
+    const AbstractDOMCachingXMLObject* parent = dynamic_cast<const AbstractDOMCachingXMLObject*>(getParent());
+    if (parent && parent->m_dom && parent->m_dom == m_dom->getParentNode() &&
+            XMLPlatformUtils::compareAndSwap(&parent->m_signatureCheck, nullptr, nullptr) == &g_unsigned) {
+        XMLPlatformUtils::compareAndSwap(&m_signatureCheck, &g_unsigned, nullptr);
+        return false;
+    }
+
+    // Walk the cached DOM in document order looking for a signature.
+    static const XMLCh Signature[] = UNICODE_LITERAL_9(S,i,g,n,a,t,u,r,e);
+    bool found = false;
+    const DOMElement* e = m_dom;
+    while (e) {
+        if (XMLHelper::isNodeNamed(e, xmlconstants::XMLSIG_NS, Signature)) {
+            found = true;
+            break;
+        }
+        const DOMElement* next = XMLHelper::getFirstChildElement(e);
+        while (!next && e != m_dom) {
+            next = XMLHelper::getNextSiblingElement(e);
+            if (!next)
+                e = static_cast<const DOMElement*>(e->getParentNode());
+        }
+        e = next;
+    }
+    XMLPlatformUtils::compareAndSwap(&m_signatureCheck, found ? &g_signed : &g_unsigned, nullptr);
+    return found;
+}
+
 XMLObject* AbstractDOMCachingXMLObject::clone() const
 {
     // See if we can clone via the DOM.
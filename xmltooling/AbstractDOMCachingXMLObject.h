@@ -69,9 +69,25 @@ namespace xmltooling {
          */
         xercesc::DOMElement* cloneDOM(xercesc::DOMDocument* doc=nullptr) const;
 
+        /**
+         * Indicates whether a clone must be produced from the cached DOM rather than
+         * by copying the object's state directly.
+         *
+         * <p>A structural copy avoids importing and unmarshalling the DOM, but re-marshalling
+         * it is not guaranteed to reproduce the original markup byte for byte, which would
+         * invalidate any signature in the cached DOM.
+         *
+         * <p>The answer is cached along with the DOM, so the DOM should not have signatures
+         * added to it directly once it has been checked.
+         *
+         * @return  true iff a DOM exists and contains a signature
+         */
+        bool requiresDOMClone() const;
+
     private:
         mutable xercesc::DOMElement* m_dom;
         mutable xercesc::DOMDocument* m_document;
+        mutable void* m_signatureCheck;
     };
     
 };
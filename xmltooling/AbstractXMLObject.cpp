@@ -27,22 +27,210 @@
 #include "internal.h"
 #include "exceptions.h"
 #include "AbstractXMLObject.h"
+#include "io/AbstractXMLObjectUnmarshaller.h"
+#include "util/Threads.h"
 
 #include <algorithm>
+#include <functional>
+#include <map>
+#include <new>
+#include <vector>
+#include <xercesc/util/PlatformUtils.hpp>
 
 using namespace xmltooling;
+using std::less;
+using std::map;
+using std::pair;
 using std::set;
 
+using xercesc::DOMDocument;
+using xercesc::DOMElement;
+using xercesc::XMLPlatformUtils;
 using xercesc::XMLString;
 using xercesc::XMLDateTime;
 using xercesc::XMLException;
+using boost::scoped_ptr;
+
+namespace {
+    // Limits on the pool of shared namespace sets.
+    const set<Namespace>::size_type SHARED_NAMESPACES_MAX_SIZE = 3;
+    const set<Namespace>::size_type SHARED_NAMESPACES_MAX_SETS = 4096;
+    const set<Namespace>::size_type SHARED_NAMESPACES_MAX_TRANSITIONS = 16384;
+
+    // Adds a namespace to a set, merging its properties into any existing declaration of the prefix.
+    void mergeNamespace(set<Namespace>& namespaces, const Namespace& ns)
+    {
+        for (set<Namespace>::const_iterator n = namespaces.begin(); n != namespaces.end(); ++n) {
+            // Look for the prefix in the existing set.
+            if (XMLString::equals(ns.getNamespacePrefix(), n->getNamespacePrefix())) {
+                // See if it's the same declaration, and overlay various properties if so.
+                if (XMLString::equals(ns.getNamespaceURI(), n->getNamespaceURI())) {
+                    if (ns.alwaysDeclare())
+                        const_cast<Namespace&>(*n).setAlwaysDeclare(true);
+                    switch (ns.usage()) {
+                        case Namespace::Indeterminate:
+                            break;
+                        case Namespace::VisiblyUsed:
+                            const_cast<Namespace&>(*n).setUsage(Namespace::VisiblyUsed);
+                            break;
+                        case Namespace::NonVisiblyUsed:
+                            if (n->usage() == Namespace::Indeterminate)
+                                const_cast<Namespace&>(*n).setUsage(Namespace::NonVisiblyUsed);
+                            break;
+                    }
+                }
+                return;
+            }
+        }
+
+        // If the prefix is now, go ahead and add it.
+        namespaces.insert(ns);
+    }
+
+    // Orders namespaces by all of their properties, not just the URI and prefix.
+    bool lessNamespace(const Namespace& n1, const Namespace& n2)
+    {
+        if (n1 < n2)
+            return true;
+        else if (n2 < n1)
+            return false;
+        else if (n1.alwaysDeclare() != n2.alwaysDeclare())
+            return n2.alwaysDeclare();
+        return n1.usage() < n2.usage();
+    }
+
+    struct NamespaceSetLess {
+        bool operator()(const set<Namespace>* s1, const set<Namespace>* s2) const {
+            if (s1->size() != s2->size())
+                return s1->size() < s2->size();
+            for (set<Namespace>::const_iterator i = s1->begin(), j = s2->begin(); i != s1->end(); ++i, ++j) {
+                if (lessNamespace(*i, *j))
+                    return true;
+                else if (lessNamespace(*j, *i))
+                    return false;
+            }
+            return false;
+        }
+    };
+
+    typedef pair<const set<Namespace>*,Namespace> transition_t;
 
-XMLObject::XMLObject()
+    struct TransitionLess {
+        bool operator()(const transition_t& t1, const transition_t& t2) const {
+            if (t1.first != t2.first)
+                return less<const set<Namespace>*>()(t1.first, t2.first);
+            return lessNamespace(t1.second, t2.second);
+        }
+    };
+
+    // Append-only pool of small, immutable namespace sets, plus a memo of the
+    // result of adding a namespace to each of them, so that the usual additions
+    // made while building and unmarshalling objects are a lookup.
+    class NamespaceSetPool
+    {
+    public:
+        NamespaceSetPool() : m_lock(RWLock::create()) {
+            m_sets.insert(&m_empty);
+        }
+
+        const set<Namespace>* getEmpty() const {
+            return &m_empty;
+        }
+
+        // Returns the shared result of adding a namespace to a shared set, or nullptr if it can't be shared.
+        const set<Namespace>* add(const set<Namespace>* base, const Namespace& ns) {
+            transition_t key(base, ns);
+            {
+                SharedLock locker(m_lock);
+                map<transition_t,const set<Namespace>*,TransitionLess>::const_iterator t = m_transitions.find(key);
+                if (t != m_transitions.end())
+                    return t->second;
+            }
+
+            set<Namespace> result(*base);
+            mergeNamespace(result, ns);
+            if (result.size() > SHARED_NAMESPACES_MAX_SIZE)
+                return nullptr;
+
+            // Only take the write lock if there's something to add.
+            {
+                SharedLock locker(m_lock);
+                set<const set<Namespace>*,NamespaceSetLess>::const_iterator i = m_sets.find(&result);
+                if (i != m_sets.end()) {
+                    if (m_transitions.size() >= SHARED_NAMESPACES_MAX_TRANSITIONS)
+                        return *i;
+                }
+                else if (m_sets.size() >= SHARED_NAMESPACES_MAX_SETS) {
+                    return nullptr;
+                }
+            }
+
+            m_lock->wrlock();
+            SharedLock locker(m_lock, false);
+            const set<Namespace>* shared = share(result);
+            if (shared && m_transitions.size() < SHARED_NAMESPACES_MAX_TRANSITIONS)
+                m_transitions[key] = shared;
+            return shared;
+        }
+
+        // Returns the shared copy of a set, or nullptr if it can't be shared.
+        const set<Namespace>* get(const set<Namespace>& namespaces) {
+            if (namespaces.size() > SHARED_NAMESPACES_MAX_SIZE)
+                return nullptr;
+            {
+                SharedLock locker(m_lock);
+                set<const set<Namespace>*,NamespaceSetLess>::const_iterator i = m_sets.find(&namespaces);
+                if (i != m_sets.end())
+                    return *i;
+                else if (m_sets.size() >= SHARED_NAMESPACES_MAX_SETS)
+                    return nullptr;
+            }
+
+            m_lock->wrlock();
+            SharedLock locker(m_lock, false);
+            return share(namespaces);
+        }
+
+    private:
+        // Must be called with the write lock held.
+        const set<Namespace>* share(const set<Namespace>& namespaces) {
+            set<const set<Namespace>*,NamespaceSetLess>::const_iterator i = m_sets.find(&namespaces);
+            if (i != m_sets.end())
+                return *i;
+            else if (namespaces.size() > SHARED_NAMESPACES_MAX_SIZE || m_sets.size() >= SHARED_NAMESPACES_MAX_SETS)
+                return nullptr;
+            const set<Namespace>* copy = new set<Namespace>(namespaces);
+            m_sets.insert(copy);
+            return copy;
+        }
+
+        scoped_ptr<RWLock> m_lock;
+        set<Namespace> m_empty;
+        set<const set<Namespace>*,NamespaceSetLess> m_sets;
+        map<transition_t,const set<Namespace>*,TransitionLess> m_transitions;
+    };
+
+    // Created by library initialization and never destroyed, since objects can outlive it.
+    NamespaceSetPool* g_namespaceSetPool = nullptr;
+};
+
+void xmltooling::initNamespaceSets()
+{
+    if (!g_namespaceSetPool)
+        g_namespaceSetPool = new NamespaceSetPool();
+}
+
+XMLObject::XMLObject() : m_slotted(false), m_idIndex(nullptr), m_idIndexed(false)
+{
+}
+
+XMLObject::XMLObject(const XMLObject&) : m_slotted(false), m_idIndex(nullptr), m_idIndexed(false)
 {
 }
 
 XMLObject::~XMLObject()
 {
+    delete m_idIndex;
 }
 
 void XMLObject::releaseThisandParentDOM() const
@@ -87,10 +275,267 @@ void XMLObject::setNil(const XMLCh* value)
     }
 }
 
+namespace {
+    // Arena allocations are rounded up to preserve alignment.
+    const size_t ARENA_ALIGNMENT = 16;
+
+    // Holds the current thread's arena, and exists while the library is initialized.
+    ThreadKey* g_arenaKey = nullptr;
+
+    // Address ranges of the blocks held by arenas, mapping the start of each block to
+    // its end and owning arena, so that objects need no header saying where they came
+    // from. Created by library initialization and never destroyed, since objects can
+    // outlive it.
+    typedef map< const char*,pair<const char*,void*> > arena_blocks_t;
+    RWLock* g_arenaLock = nullptr;
+    arena_blocks_t* g_arenaBlocks = nullptr;
+
+    // Set to the block map only while it's non-empty, so that deleting objects
+    // costs no lookup unless arenas are in use.
+    void* g_arenaBlocksLive = nullptr;
+
+    void addArenaBlock(const char* block, size_t size, void* arena) {
+        g_arenaLock->wrlock();
+        SharedLock locker(g_arenaLock, false);
+        (*g_arenaBlocks)[block] = std::make_pair(block + size, arena);
+        XMLPlatformUtils::compareAndSwap(&g_arenaBlocksLive, g_arenaBlocks, nullptr);
+    }
+
+    void removeArenaBlock(const char* block) {
+        g_arenaLock->wrlock();
+        SharedLock locker(g_arenaLock, false);
+        g_arenaBlocks->erase(block);
+        if (g_arenaBlocks->empty())
+            XMLPlatformUtils::compareAndSwap(&g_arenaBlocksLive, nullptr, g_arenaBlocks);
+    }
+
+    // Returns the arena whose blocks hold an address, or nullptr for the heap.
+    void* findArena(const void* p) {
+        if (!XMLPlatformUtils::compareAndSwap(&g_arenaBlocksLive, nullptr, nullptr))
+            return nullptr;
+        const char* addr = reinterpret_cast<const char*>(p);
+        SharedLock locker(g_arenaLock);
+        arena_blocks_t::const_iterator i = g_arenaBlocks->upper_bound(addr);
+        if (i == g_arenaBlocks->begin())
+            return nullptr;
+        --i;
+        return (addr < i->second.first) ? i->second.second : nullptr;
+    }
+};
+
+// Only the constructing thread allocates from an arena, but the objects
+// can be deleted anywhere, so just the reference count is shared.
+class XMLObjectArena::Impl
+{
+public:
+    Impl(size_t blockSize) : m_blockSize(blockSize), m_next(nullptr), m_left(0), m_refs(1) {
+    }
+
+    ~Impl() {
+        for (std::vector<char*>::iterator i = m_blocks.begin(); i != m_blocks.end(); ++i) {
+            removeArenaBlock(*i);
+            delete[] *i;
+        }
+    }
+
+    void* allocate(size_t size) {
+        if (size > m_left) {
+            size_t blockSize = std::max(size, m_blockSize);
+            m_blocks.reserve(m_blocks.size() + 1);
+            char* block = new char[blockSize];
+            try {
+                addArenaBlock(block, blockSize, this);
+            }
+            catch (...) {
+                delete[] block;
+                throw;
+            }
+            m_blocks.push_back(block);
+            m_next = block;
+            m_left = blockSize;
+        }
+        void* ret = m_next;
+        m_next += size;
+        m_left -= size;
+        XMLPlatformUtils::atomicIncrement(m_refs);
+        return ret;
+    }
+
+    void release() {
+        if (XMLPlatformUtils::atomicDecrement(m_refs) == 0)
+            delete this;
+    }
+
+private:
+    size_t m_blockSize;
+    std::vector<char*> m_blocks;
+    char* m_next;
+    size_t m_left;
+    int m_refs;
+};
+
+
+XMLObjectArena::XMLObjectArena(size_t blockSize) : m_impl(new Impl(blockSize)), m_previous(nullptr)
+{
+    if (g_arenaKey) {
+        m_previous = reinterpret_cast<Impl*>(g_arenaKey->getData());
+        g_arenaKey->setData(m_impl);
+    }
+}
+
+XMLObjectArena::~XMLObjectArena()
+{
+    if (g_arenaKey)
+        g_arenaKey->setData(m_previous);
+    m_impl->release();
+}
+
+bool XMLObjectArena::contains(const XMLObject& xmlObject) const
+{
+    // Look up the complete object, which is what was allocated, not the base subobject.
+    return findArena(dynamic_cast<const void*>(&xmlObject)) == m_impl;
+}
+
+void* AbstractXMLObject::operator new(size_t size)
+{
+    XMLObjectArena::Impl* arena = g_arenaKey ? reinterpret_cast<XMLObjectArena::Impl*>(g_arenaKey->getData()) : nullptr;
+    if (!arena)
+        return ::operator new(size);
+    return arena->allocate((size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1));
+}
+
+void* AbstractXMLObject::operator new(size_t size, const std::nothrow_t&) throw()
+{
+    try {
+        return operator new(size);
+    }
+    catch (std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void AbstractXMLObject::operator delete(void* p)
+{
+    if (!p)
+        return;
+    XMLObjectArena::Impl* arena = reinterpret_cast<XMLObjectArena::Impl*>(findArena(p));
+    if (arena)
+        arena->release();
+    else
+        ::operator delete(p);
+}
+
+void AbstractXMLObject::operator delete(void* p, const std::nothrow_t&) throw()
+{
+    operator delete(p);
+}
+
+namespace {
+    // Striped locks serializing the unmarshalling of deferred content within each
+    // DOM document, which also keeps concurrent readers off the document. The key
+    // holds the object whose content the current thread is unmarshalling, if any,
+    // so it also records that a lock is held. Content is only unmarshalled from
+    // inside another object's content in the same document, so the outermost
+    // object's lock covers it.
+    const unsigned int CONTENT_LOCKS = 64;
+    Mutex* g_contentLocks[CONTENT_LOCKS];
+    ThreadKey* g_contentKey = nullptr;
+
+    Mutex* getContentLock(const DOMDocument* doc) {
+        size_t h = reinterpret_cast<size_t>(doc);
+        h ^= (h >> 7) ^ (h >> 17);
+        return g_contentLocks[h % CONTENT_LOCKS];
+    }
+
+    class ContentGuard {
+    public:
+        ContentGuard(const AbstractXMLObject* current, const DOMDocument* doc)
+                : m_current(current), m_lock(current ? nullptr : getContentLock(doc)) {
+            if (m_lock)
+                m_lock->lock();
+        }
+
+        ~ContentGuard() {
+            g_contentKey->setData(const_cast<AbstractXMLObject*>(m_current));
+            if (m_lock)
+                m_lock->unlock();
+        }
+
+    private:
+        const AbstractXMLObject* m_current;
+        Mutex* m_lock;
+    };
+};
+
+bool AbstractXMLObject::isMaterializing() const
+{
+    return m_lazy && g_contentKey->getData() == this;
+}
+
+void AbstractXMLObject::unmarshallDeferredContent() const
+{
+    // The swap is a no-op that reads the pointer with a full barrier, so that any
+    // content unmarshalled by another thread is visible once it reads as null.
+    const DOMElement* content = reinterpret_cast<const DOMElement*>(
+        XMLPlatformUtils::compareAndSwap(&m_deferredContent, nullptr, nullptr)
+        );
+    if (!content)
+        return;
+
+    const AbstractXMLObject* current = reinterpret_cast<const AbstractXMLObject*>(g_contentKey->getData());
+    if (current == this)
+        return; // called back while adding our own children
+
+    ContentGuard guard(current, content->getOwnerDocument());
+    content = reinterpret_cast<const DOMElement*>(m_deferredContent);
+    if (!content)
+        return;
+
+    g_contentKey->setData(const_cast<AbstractXMLObject*>(this));
+    try {
+        AbstractXMLObjectUnmarshaller* self = dynamic_cast<AbstractXMLObjectUnmarshaller*>(const_cast<AbstractXMLObject*>(this));
+        if (!self)
+            throw UnmarshallingException("Lazily unmarshalled object does not support unmarshalling of its content.");
+        self->unmarshallContent(content);
+    }
+    catch (...) {
+        // Don't try again, the content would be duplicated.
+        XMLPlatformUtils::compareAndSwap(&m_deferredContent, nullptr, content);
+        throw;
+    }
+    XMLPlatformUtils::compareAndSwap(&m_deferredContent, nullptr, content);
+}
+
+void xmltooling::initXMLObjectThreading()
+{
+    if (!g_arenaBlocks) {
+        g_arenaLock = RWLock::create();
+        g_arenaBlocks = new arena_blocks_t();
+    }
+    g_arenaKey = ThreadKey::create(nullptr);
+    g_contentKey = ThreadKey::create(nullptr);
+    for (unsigned int i = 0; i < CONTENT_LOCKS; ++i)
+        g_contentLocks[i] = Mutex::create();
+}
+
+void xmltooling::termXMLObjectThreading()
+{
+    for (unsigned int i = 0; i < CONTENT_LOCKS; ++i) {
+        delete g_contentLocks[i];
+        g_contentLocks[i] = nullptr;
+    }
+    delete g_contentKey;
+    g_contentKey = nullptr;
+    delete g_arenaKey;
+    g_arenaKey = nullptr;
+}
+
 AbstractXMLObject::AbstractXMLObject(const XMLCh* nsURI, const XMLCh* localName, const XMLCh* prefix, const QName* schemaType)
     : m_log(logging::Category::getInstance(XMLTOOLING_LOGCAT ".XMLObject")),
     	m_schemaLocation(nullptr), m_noNamespaceSchemaLocation(nullptr), m_nil(xmlconstants::XML_BOOL_NULL),
-        m_parent(nullptr), m_elementQname(nsURI, localName, prefix)
+        m_parent(nullptr), m_elementQname(nsURI, localName, prefix),
+        m_namespaces(g_namespaceSetPool ? g_namespaceSetPool->getEmpty() : new set<Namespace>()),
+        m_ownedNamespaces(g_namespaceSetPool == nullptr), m_lazy(false), m_deferredContent(nullptr)
 {
     addNamespace(Namespace(nsURI, prefix, false, Namespace::VisiblyUsed));
     if (schemaType) {
@@ -100,17 +545,23 @@ AbstractXMLObject::AbstractXMLObject(const XMLCh* nsURI, const XMLCh* localName,
 }
 
 AbstractXMLObject::AbstractXMLObject(const AbstractXMLObject& src)
-    : m_namespaces(src.m_namespaces), m_log(src.m_log), m_schemaLocation(XMLString::replicate(src.m_schemaLocation)),
+    : m_log(src.m_log), m_schemaLocation(XMLString::replicate(src.m_schemaLocation)),
         m_noNamespaceSchemaLocation(XMLString::replicate(src.m_noNamespaceSchemaLocation)), m_nil(src.m_nil),
         m_parent(nullptr), m_elementQname(src.m_elementQname),
-        m_typeQname(src.m_typeQname.get() ? new QName(*src.m_typeQname) : nullptr)
+        m_typeQname(src.m_typeQname.get() ? new QName(*src.m_typeQname) : nullptr),
+        m_namespaces(src.m_ownedNamespaces ? new set<Namespace>(*src.m_namespaces) : src.m_namespaces),
+        m_ownedNamespaces(src.m_ownedNamespaces), m_lazy(false), m_deferredContent(nullptr)
 {
+    // This runs ahead of every other base, so derived classes copy fully unmarshalled content.
+    src.materializeContent();
 }
 
 AbstractXMLObject::~AbstractXMLObject()
 {
     xercesc::XMLString::release(&m_schemaLocation);
     xercesc::XMLString::release(&m_noNamespaceSchemaLocation);
+    if (m_ownedNamespaces)
+        delete m_namespaces;
 }
 
 void AbstractXMLObject::detach()
@@ -133,41 +584,58 @@ const QName& AbstractXMLObject::getElementQName() const
 
 const set<Namespace>& AbstractXMLObject::getNamespaces() const
 {
-    return m_namespaces;
+    return *m_namespaces;
+}
+
+set<Namespace>& AbstractXMLObject::getOwnedNamespaces() const
+{
+    if (!m_ownedNamespaces) {
+        m_namespaces = new set<Namespace>(*m_namespaces);
+        m_ownedNamespaces = true;
+    }
+    return const_cast<set<Namespace>&>(*m_namespaces);
 }
 
 void AbstractXMLObject::addNamespace(const Namespace& ns) const
 {
-    for (set<Namespace>::const_iterator n = m_namespaces.begin(); n != m_namespaces.end(); ++n) {
-        // Look for the prefix in the existing set.
-        if (XMLString::equals(ns.getNamespacePrefix(), n->getNamespacePrefix())) {
-            // See if it's the same declaration, and overlay various properties if so.
-            if (XMLString::equals(ns.getNamespaceURI(), n->getNamespaceURI())) {
-                if (ns.alwaysDeclare())
-                    const_cast<Namespace&>(*n).setAlwaysDeclare(true);
-                switch (ns.usage()) {
-                    case Namespace::Indeterminate:
-                        break;
-                    case Namespace::VisiblyUsed:
-                        const_cast<Namespace&>(*n).setUsage(Namespace::VisiblyUsed);
-                        break;
-                    case Namespace::NonVisiblyUsed:
-                        if (n->usage() == Namespace::Indeterminate)
-                            const_cast<Namespace&>(*n).setUsage(Namespace::NonVisiblyUsed);
-                        break;
-                }
-            }
-            return;
-        }
+    if (m_ownedNamespaces) {
+        mergeNamespace(const_cast<set<Namespace>&>(*m_namespaces), ns);
+        return;
     }
 
-    // If the prefix is now, go ahead and add it.
-    m_namespaces.insert(ns);
+    const set<Namespace>* shared = g_namespaceSetPool->add(m_namespaces, ns);
+    if (shared) {
+        m_namespaces = shared;
+    }
+    else {
+        // Too big (or too many) to share, so take a private copy.
+        set<Namespace>* owned = new set<Namespace>(*m_namespaces);
+        mergeNamespace(*owned, ns);
+        m_namespaces = owned;
+        m_ownedNamespaces = true;
+    }
 }
 
 void AbstractXMLObject::removeNamespace(const Namespace& ns)
 {
-    m_namespaces.erase(ns);
+    if (m_ownedNamespaces) {
+        const_cast<set<Namespace>&>(*m_namespaces).erase(ns);
+        return;
+    }
+    else if (m_namespaces->find(ns) == m_namespaces->end()) {
+        return;
+    }
+
+    set<Namespace> result(*m_namespaces);
+    result.erase(ns);
+    const set<Namespace>* shared = g_namespaceSetPool->get(result);
+    if (shared) {
+        m_namespaces = shared;
+    }
+    else {
+        m_namespaces = new set<Namespace>(result);
+        m_ownedNamespaces = true;
+    }
 }
 
 const QName* AbstractXMLObject::getSchemaType() const
@@ -321,6 +789,54 @@ XMLDateTime* AbstractXMLObject::prepareForAssignment(XMLDateTime* oldValue, cons
     return ret;
 }
 
+XMLDateTime* AbstractXMLObject::prepareForAssignment(
+    XMLDateTime* oldValue, DateTimeValue& value, const XMLDateTime* newValue, bool duration
+    )
+{
+    value.set(newValue, duration);
+    delete oldValue;
+    releaseThisandParentDOM();
+    return nullptr;
+}
+
+XMLDateTime* AbstractXMLObject::prepareForAssignment(XMLDateTime* oldValue, DateTimeValue& value, time_t newValue, bool duration)
+{
+    value.set(newValue, duration);
+    delete oldValue;
+    releaseThisandParentDOM();
+    return nullptr;
+}
+
+XMLDateTime* AbstractXMLObject::prepareForAssignment(
+    XMLDateTime* oldValue, DateTimeValue& value, const XMLCh* newValue, bool duration
+    )
+{
+    value.set(newValue, duration);
+    delete oldValue;
+    releaseThisandParentDOM();
+    return nullptr;
+}
+
+const XMLDateTime* AbstractXMLObject::getCachedDateTime(XMLDateTime*& cache, const DateTimeValue& value, bool duration) const
+{
+    if (value.empty())
+        return nullptr;
+
+    // Getters are const, so the object is published with a swap in case another
+    // thread is building it at the same time.
+    void** slot = reinterpret_cast<void**>(&cache);
+    XMLDateTime* ret = static_cast<XMLDateTime*>(XMLPlatformUtils::compareAndSwap(slot, nullptr, nullptr));
+    if (!ret) {
+        XMLDateTime* built = value.toXMLDateTime(duration);
+        ret = static_cast<XMLDateTime*>(XMLPlatformUtils::compareAndSwap(slot, built, nullptr));
+        if (ret)
+            delete built;
+        else
+            ret = built;
+    }
+    return ret;
+}
+
 XMLObject* AbstractXMLObject::prepareForAssignment(XMLObject* oldValue, XMLObject* newValue)
 {
     if (newValue && newValue->hasParent())
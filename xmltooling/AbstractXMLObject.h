@@ -30,7 +30,9 @@
 #include <xmltooling/logging.h>
 #include <xmltooling/QName.h>
 #include <xmltooling/XMLObject.h>
+#include <xmltooling/util/DateTimeValue.h>
 
+#include <new>
 #include <boost/scoped_ptr.hpp>
 #include <xercesc/util/XMLDateTime.hpp>
 
@@ -41,6 +43,50 @@
 
 namespace xmltooling {
 
+    /**
+     * Scopes arena allocation of XMLObjects to the current thread.
+     *
+     * <p>While an instance is in scope, the AbstractXMLObject-based objects created
+     * on the constructing thread (e.g. by XMLObjectBuilder::buildFromDocument()) are
+     * carved out of large blocks owned by the arena instead of being allocated one
+     * by one. The blocks are freed together once the arena has gone out of scope
+     * and every object allocated from it has been deleted, so objects can still be
+     * detached, kept beyond the scope, or deleted from any thread.
+     *
+     * <p>Memory belonging to deleted objects is not reused until all of them are gone,
+     * so arenas suit trees that are built, used, and then discarded as a whole.
+     * Only the objects themselves come from the arena: the strings, date/time values
+     * and child containers they hold are allocated from the heap as usual.
+     * Arenas have no effect unless the library is initialized.
+     */
+    class XMLTOOL_API XMLObjectArena
+    {
+        MAKE_NONCOPYABLE(XMLObjectArena);
+        friend class AbstractXMLObject;
+    public:
+        /**
+         * Constructor.
+         *
+         * @param blockSize size of the blocks from which objects are allocated
+         */
+        XMLObjectArena(size_t blockSize=65536);
+
+        ~XMLObjectArena();
+
+        /**
+         * Returns true iff an object was allocated from this arena.
+         *
+         * @param xmlObject an object to check
+         * @return  true iff the object's memory belongs to this arena
+         */
+        bool contains(const XMLObject& xmlObject) const;
+
+    private:
+        class Impl;
+        Impl* m_impl;
+        Impl* m_previous;
+    };
+
     /**
      * An abstract implementation of XMLObject.
      * This is the primary concrete base class, and supplies basic namespace,
@@ -67,6 +113,21 @@ namespace xmltooling {
         XMLObject* getParent() const;
         void setParent(XMLObject* parent);
 
+        /// @cond OFF
+        // Allocates from the current thread's XMLObjectArena, if any.
+        static void* operator new(size_t size);
+        static void* operator new(size_t size, const std::nothrow_t&) throw();
+        static void operator delete(void* p);
+        static void operator delete(void* p, const std::nothrow_t&) throw();
+
+        // Placement forms, which would otherwise be hidden by the ones above.
+        static void* operator new(size_t, void* p) throw() {
+            return p;
+        }
+        static void operator delete(void*, void*) throw() {
+        }
+        /// @endcond
+
      protected:
         /**
          * Constructor
@@ -80,7 +141,7 @@ namespace xmltooling {
             const XMLCh* nsURI=nullptr, const XMLCh* localName=nullptr, const XMLCh* prefix=nullptr, const QName* schemaType=nullptr
             );
 
-        /** Copy constructor. */
+        /** Copy constructor, which first unmarshalls any deferred content of the source. */
         AbstractXMLObject(const AbstractXMLObject& src);
 
         /**
@@ -135,6 +196,71 @@ namespace xmltooling {
          */
         xercesc::XMLDateTime* prepareForAssignment(xercesc::XMLDateTime* oldValue, const XMLCh* newValue, bool duration=false);
 
+        /**
+         * A helper function for derived classes, for assignment of date/time data
+         * held in lexical and epoch form.
+         *
+         * It invalidates the DOM, stores the new value, and frees any object built from the old one.
+         *
+         * @param oldValue the object built from the current value, if any
+         * @param value    the storage for the value
+         * @param newValue the new value
+         * @param duration true iff the value is a duration rather than an absolute timestamp
+         *
+         * @return the object pointer that should be assigned, which is always nullptr
+         */
+        xercesc::XMLDateTime* prepareForAssignment(
+            xercesc::XMLDateTime* oldValue, DateTimeValue& value, const xercesc::XMLDateTime* newValue, bool duration=false
+            );
+
+        /**
+         * A helper function for derived classes, for assignment of date/time data
+         * held in lexical and epoch form.
+         *
+         * It invalidates the DOM, stores the new value, and frees any object built from the old one.
+         *
+         * @param oldValue the object built from the current value, if any
+         * @param value    the storage for the value
+         * @param newValue the epoch to assign as the new value
+         * @param duration true iff the value is a duration rather than an absolute timestamp
+         *
+         * @return the object pointer that should be assigned, which is always nullptr
+         */
+        xercesc::XMLDateTime* prepareForAssignment(
+            xercesc::XMLDateTime* oldValue, DateTimeValue& value, time_t newValue, bool duration=false
+            );
+
+        /**
+         * A helper function for derived classes, for assignment of date/time data
+         * held in lexical and epoch form.
+         *
+         * It invalidates the DOM, stores the new value, and frees any object built from the old one.
+         *
+         * @param oldValue the object built from the current value, if any
+         * @param value    the storage for the value
+         * @param newValue the new value in string form
+         * @param duration true iff the value is a duration rather than an absolute timestamp
+         *
+         * @return the object pointer that should be assigned, which is always nullptr
+         */
+        xercesc::XMLDateTime* prepareForAssignment(
+            xercesc::XMLDateTime* oldValue, DateTimeValue& value, const XMLCh* newValue, bool duration=false
+            );
+
+        /**
+         * A helper function for derived classes, for access to date/time data held in
+         * lexical and epoch form as an XMLDateTime object, which is built on first use.
+         *
+         * @param cache    the object built from the value, if any
+         * @param value    the storage for the value
+         * @param duration true iff the value is a duration rather than an absolute timestamp
+         *
+         * @return the object, or nullptr if the value is unset
+         */
+        const xercesc::XMLDateTime* getCachedDateTime(
+            xercesc::XMLDateTime*& cache, const DateTimeValue& value, bool duration=false
+            ) const;
+
         /**
          * A helper function for derived classes, for assignment of QName data.
          *
@@ -164,9 +290,39 @@ namespace xmltooling {
         XMLObject* prepareForAssignment(XMLObject* oldValue, XMLObject* newValue);
 
         /**
-         * Set of namespaces associated with the object.
+         * A helper function for derived classes, to be called before the child objects
+         * or text content of the object are accessed or modified.
+         *
+         * <p>If the object was unmarshalled lazily (see AbstractXMLObjectUnmarshaller::unmarshallLazily()),
+         * its content is unmarshalled from the DOM the first time this is called. The
+         * accessors supplied by AbstractComplexElement and the IMPL_TYPED_CHILD family
+         * of macros do this already, but hand-written accessors need to call it themselves.
+         *
+         * @throws UnmarshallingException thrown if an error occurs unmarshalling deferred content
+         */
+        void materializeContent() const {
+            if (m_lazy)
+                unmarshallDeferredContent();
+        }
+
+        /**
+         * Returns true iff the object's deferred content is being unmarshalled by the calling thread,
+         * during which time its DOM must be left in place.
+         *
+         * @return true iff the object's content is being unmarshalled lazily by the calling thread
+         */
+        bool isMaterializing() const;
+
+        /**
+         * Returns the set of namespaces associated with the object for modification.
+         *
+         * <p>Objects with identical declarations may share a set, so this gives the
+         * object a private copy first. Prefer addNamespace() and removeNamespace(),
+         * which keep sets shared where they can.
+         *
+         * @return the object's own set of namespaces
          */
-        mutable std::set<Namespace> m_namespaces;
+        std::set<Namespace>& getOwnedNamespaces() const;
 
         /**
          * Logging object.
@@ -192,6 +348,19 @@ namespace xmltooling {
         XMLObject* m_parent;
         QName m_elementQname;
         boost::scoped_ptr<QName> m_typeQname;
+
+        // Namespaces associated with the object. Small sets are immutable and shared
+        // between objects with identical declarations, and are replaced rather than
+        // modified. Larger sets are owned by the object.
+        mutable const std::set<Namespace>* m_namespaces;
+        mutable bool m_ownedNamespaces;
+
+        // Lazily unmarshalled objects keep the DOM element holding their content
+        // until it is first accessed. The flag is fixed once unmarshalling is done.
+        friend class AbstractXMLObjectUnmarshaller;
+        bool m_lazy;
+        mutable void* m_deferredContent;
+        void unmarshallDeferredContent() const;
     };
 
 };
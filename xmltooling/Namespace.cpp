@@ -32,45 +32,72 @@ using namespace xmltooling;
 using xercesc::XMLString;
 
 Namespace::Namespace(const XMLCh* uri, const XMLCh* prefix, bool alwaysDeclare, namespace_usage_t usage)
-    : m_pinned(alwaysDeclare), m_usage(usage)
+    : m_pinned(alwaysDeclare), m_usage(usage), m_uri(nullptr), m_prefix(nullptr), m_ownedURI(false), m_ownedPrefix(false)
 {
-    setNamespaceURI(uri);
-    setNamespacePrefix(prefix);
+    m_uri = StringPool::acquire(uri, m_ownedURI);
+    m_prefix = StringPool::acquire(prefix, m_ownedPrefix);
+}
+
+Namespace::Namespace(const Namespace& src)
+    : m_pinned(src.m_pinned), m_usage(src.m_usage), m_uri(src.m_uri), m_prefix(src.m_prefix), m_ownedURI(false), m_ownedPrefix(false)
+{
+    // Pooled strings can simply be shared.
+    if (src.m_ownedURI)
+        m_uri = StringPool::acquire(src.m_uri, m_ownedURI);
+    if (src.m_ownedPrefix)
+        m_prefix = StringPool::acquire(src.m_prefix, m_ownedPrefix);
 }
 
 Namespace::~Namespace()
 {
+    StringPool::release(m_uri, m_ownedURI);
+    StringPool::release(m_prefix, m_ownedPrefix);
+}
+
+Namespace& Namespace::operator=(const Namespace& src)
+{
+    if (this != &src) {
+        m_pinned = src.m_pinned;
+        m_usage = src.m_usage;
+        setNamespaceURI(src.m_uri);
+        setNamespacePrefix(src.m_prefix);
+    }
+    return *this;
 }
 
 void Namespace::setNamespacePrefix(const XMLCh* prefix)
 {
-    if (prefix)
-        m_prefix=prefix;
-    else
-        m_prefix.erase();
+    bool owned;
+    const XMLCh* replacement = StringPool::acquire(prefix, owned);
+    StringPool::release(m_prefix, m_ownedPrefix);
+    m_prefix = replacement;
+    m_ownedPrefix = owned;
 }
 
 void Namespace::setNamespaceURI(const XMLCh* uri)
 {
-    if (uri)
-        m_uri=uri;
-    else
-        m_uri.erase();
+    bool owned;
+    const XMLCh* replacement = StringPool::acquire(uri, owned);
+    StringPool::release(m_uri, m_ownedURI);
+    m_uri = replacement;
+    m_ownedURI = owned;
 }
 
 bool xmltooling::operator<(const Namespace& op1, const Namespace& op2)
 {
-    int i=XMLString::compareString(op1.getNamespaceURI(),op2.getNamespaceURI());
-    if (i<0)
-        return true;
-    else if (i==0)
-        return (XMLString::compareString(op1.getNamespacePrefix(),op2.getNamespacePrefix())<0);
-    else
+    // Identical pooled strings needn't be compared, but ordering remains lexical.
+    if (op1.m_uri != op2.m_uri) {
+        int i=XMLString::compareString(op1.getNamespaceURI(),op2.getNamespaceURI());
+        if (i!=0)
+            return (i<0);
+    }
+    if (op1.m_prefix == op2.m_prefix)
         return false;
+    return (XMLString::compareString(op1.getNamespacePrefix(),op2.getNamespacePrefix())<0);
 }
 
 bool xmltooling::operator==(const Namespace& op1, const Namespace& op2)
 {
-    return (XMLString::equals(op1.getNamespacePrefix(), op2.getNamespacePrefix()) &&
-            XMLString::equals(op1.getNamespaceURI(), op2.getNamespaceURI()));
+    return (StringPool::equals(op1.m_prefix, op1.m_ownedPrefix, op2.m_prefix, op2.m_ownedPrefix) &&
+            StringPool::equals(op1.m_uri, op1.m_ownedURI, op2.m_uri, op2.m_ownedURI));
 }
@@ -38,6 +38,7 @@ namespace xmltooling {
 
     /**
      * A data structure for encapsulating XML Namespace attributes.
+     * The strings are drawn from the same process-wide pool as QName.
      */
     class XMLTOOL_API Namespace
     {
@@ -59,20 +60,33 @@ namespace xmltooling {
          * @param usage             indicates usage of namespace in the context of an XMLObject
          */
         Namespace(const XMLCh* uri=nullptr, const XMLCh* prefix=nullptr, bool alwaysDeclare=false, namespace_usage_t usage=Indeterminate);
-        
+
+        /**
+         * Copy constructor
+         * @param src   namespace to copy
+         */
+        Namespace(const Namespace& src);
+
         ~Namespace();
+
+        /**
+         * Assignment operator
+         * @param src   namespace to copy
+         * @return  this object
+         */
+        Namespace& operator=(const Namespace& src);
         
         /**
          * Returns the namespace prefix
          * @return  Null-terminated Unicode string containing the prefix, without the colon
          */
-        const XMLCh* getNamespacePrefix() const { return m_prefix.c_str(); }
+        const XMLCh* getNamespacePrefix() const { return m_prefix; }
 
         /**
          * Returns the namespace URI
          * @return  Null-terminated Unicode string containing the URI
          */
-        const XMLCh* getNamespaceURI() const { return m_uri.c_str(); }
+        const XMLCh* getNamespaceURI() const { return m_uri; }
 
         /**
          * Returns true iff the namespace should always be declared regardless of in-scope declarations
@@ -110,11 +124,17 @@ namespace xmltooling {
          */
         void setUsage(namespace_usage_t usage) { m_usage = usage; }
 
+        /// @cond OFF
+        friend XMLTOOL_API bool operator<(const Namespace& op1, const Namespace& op2);
+        friend XMLTOOL_API bool operator==(const Namespace& op1, const Namespace& op2);
+        /// @endcond
+
     private:
         bool m_pinned;
         namespace_usage_t m_usage;
-        xstring m_uri;
-        xstring m_prefix;
+        const XMLCh* m_uri;
+        const XMLCh* m_prefix;
+        bool m_ownedURI, m_ownedPrefix;
     };
 
 #if defined (_MSC_VER)
@@ -26,13 +26,118 @@
 
 #include "internal.h"
 #include "QName.h"
+#include "util/Threads.h"
+
+#include <vector>
 
 using namespace xmltooling;
 using namespace std;
 
 using xercesc::XMLString;
+using boost::scoped_ptr;
+
+namespace {
+    const XMLCh g_emptyString[] = { 0 };
+
+    // Limits on what the pool will accept.
+    const XMLSize_t POOL_MAX_LENGTH = 256;
+    const unsigned int POOL_MAX_ENTRIES = 65536;
+
+    class InternTable
+    {
+    public:
+        InternTable() : m_lock(RWLock::create()), m_count(0), m_buckets(1024) {}
+
+        const XMLCh* intern(const XMLCh* s) {
+            XMLSize_t len = XMLString::stringLen(s);
+            if (len > POOL_MAX_LENGTH)
+                return nullptr;
+            unsigned int h = 2166136261U;
+            for (const XMLCh* p = s; *p; ++p)
+                h = (h ^ *p) * 16777619U;
+
+            m_lock->rdlock();
+            const XMLCh* ret = find(h, s);
+            bool full = (m_count >= POOL_MAX_ENTRIES);
+            m_lock->unlock();
+            if (ret || full)
+                return ret;
+
+            m_lock->wrlock();
+            SharedLock locker(m_lock, false);
+            ret = find(h, s);
+            if (ret || m_count >= POOL_MAX_ENTRIES)
+                return ret;
+            if (m_count >= m_buckets.size())
+                grow();
+
+            // Allocated outside of Xerces, since pooled strings outlive XMLPlatformUtils::Terminate().
+            XMLCh* copy = new XMLCh[len + 1];
+            XMLString::copyString(copy, s);
+            m_buckets[h & (m_buckets.size() - 1)].push_back(make_pair(h, copy));
+            ++m_count;
+            return copy;
+        }
+
+    private:
+        typedef vector< pair<unsigned int,XMLCh*> > bucket_t;
+
+        const XMLCh* find(unsigned int h, const XMLCh* s) const {
+            const bucket_t& bucket = m_buckets[h & (m_buckets.size() - 1)];
+            for (bucket_t::const_iterator i = bucket.begin(); i != bucket.end(); ++i) {
+                if (i->first == h && XMLString::equals(i->second, s))
+                    return i->second;
+            }
+            return nullptr;
+        }
+
+        void grow() {
+            vector<bucket_t> rehashed(m_buckets.size() * 2);
+            for (vector<bucket_t>::const_iterator b = m_buckets.begin(); b != m_buckets.end(); ++b) {
+                for (bucket_t::const_iterator i = b->begin(); i != b->end(); ++i)
+                    rehashed[i->first & (rehashed.size() - 1)].push_back(*i);
+            }
+            m_buckets.swap(rehashed);
+        }
+
+        scoped_ptr<RWLock> m_lock;
+        unsigned int m_count;
+        vector<bucket_t> m_buckets;
+    };
+
+    // Created by library initialization and never destroyed, since QName objects can outlive it.
+    InternTable* g_internTable = nullptr;
+};
+
+void StringPool::init()
+{
+    if (!g_internTable)
+        g_internTable = new InternTable();
+}
+
+const XMLCh* StringPool::acquire(const XMLCh* s, bool& owned)
+{
+    owned = false;
+    if (!s || !*s)
+        return g_emptyString;
+    const XMLCh* ret = g_internTable ? g_internTable->intern(s) : nullptr;
+    if (!ret) {
+        XMLCh* copy = new XMLCh[XMLString::stringLen(s) + 1];
+        XMLString::copyString(copy, s);
+        ret = copy;
+        owned = true;
+    }
+    return ret;
+}
+
+void StringPool::release(const XMLCh* s, bool owned)
+{
+    if (owned)
+        delete[] s;
+}
 
 QName::QName(const XMLCh* uri, const XMLCh* localPart, const XMLCh* prefix)
+    : m_uri(g_emptyString), m_local(g_emptyString), m_prefix(g_emptyString), m_owned(0)
 {
     setNamespaceURI(uri);
     setLocalPart(localPart);
@@ -40,76 +145,111 @@ QName::QName(const XMLCh* uri, const XMLCh* localPart, const XMLCh* prefix)
 }
 
 QName::QName(const char* uri, const char* localPart, const char* prefix)
+    : m_uri(g_emptyString), m_local(g_emptyString), m_prefix(g_emptyString), m_owned(0)
 {
     setNamespaceURI(uri);
     setLocalPart(localPart);
     setPrefix(prefix);
 }
 
+QName::QName(const QName& src)
+    : m_uri(g_emptyString), m_local(g_emptyString), m_prefix(g_emptyString), m_owned(0)
+{
+    *this = src;
+}
+
 QName::~QName()
 {
+    StringPool::release(m_uri, (m_owned & 0x1) != 0);
+    StringPool::release(m_local, (m_owned & 0x2) != 0);
+    StringPool::release(m_prefix, (m_owned & 0x4) != 0);
 }
 
-void QName::setPrefix(const XMLCh* prefix)
+QName& QName::operator=(const QName& src)
+{
+    if (this != &src) {
+        if (src.m_owned) {
+            assign(m_uri, 0x1, src.m_uri);
+            assign(m_local, 0x2, src.m_local);
+            assign(m_prefix, 0x4, src.m_prefix);
+        }
+        else {
+            // Pooled strings can simply be shared.
+            StringPool::release(m_uri, (m_owned & 0x1) != 0);
+            StringPool::release(m_local, (m_owned & 0x2) != 0);
+            StringPool::release(m_prefix, (m_owned & 0x4) != 0);
+            m_uri = src.m_uri;
+            m_local = src.m_local;
+            m_prefix = src.m_prefix;
+            m_owned = 0;
+        }
+    }
+    return *this;
+}
+
+void QName::assign(const XMLCh*& member, unsigned char flag, const XMLCh* value)
 {
-    if (prefix)
-        m_prefix=prefix;
+    bool owned;
+    const XMLCh* replacement = StringPool::acquire(value, owned);
+    StringPool::release(member, (m_owned & flag) != 0);
+    member = replacement;
+    if (owned)
+        m_owned |= flag;
     else
-        m_prefix.erase();
+        m_owned &= ~flag;
+}
+
+void QName::setPrefix(const XMLCh* prefix)
+{
+    assign(m_prefix, 0x4, prefix);
 }
 
 void QName::setNamespaceURI(const XMLCh* uri)
 {
-    if (uri)
-        m_uri=uri;
-    else
-        m_uri.erase();
+    assign(m_uri, 0x1, uri);
 }
 
 void QName::setLocalPart(const XMLCh* localPart)
 {
-    if (localPart)
-        m_local=localPart;
-    else
-        m_local.erase();
+    assign(m_local, 0x2, localPart);
 }
 
 void QName::setPrefix(const char* prefix)
 {
     if (prefix) {
         auto_ptr_XMLCh temp(prefix);
-        m_prefix=temp.get();
+        setPrefix(temp.get());
     }
     else
-        m_prefix.erase();
+        setPrefix((const XMLCh*)nullptr);
 }
 
 void QName::setNamespaceURI(const char* uri)
 {
     if (uri) {
         auto_ptr_XMLCh temp(uri);
-        m_uri=temp.get();
+        setNamespaceURI(temp.get());
     }
     else
-        m_uri.erase();
+        setNamespaceURI((const XMLCh*)nullptr);
 }
 
 void QName::setLocalPart(const char* localPart)
 {
     if (localPart) {
         auto_ptr_XMLCh temp(localPart);
-        m_local=temp.get();
+        setLocalPart(temp.get());
     }
     else
-        m_local.erase();
+        setLocalPart((const XMLCh*)nullptr);
 }
 
 bool xmltooling::operator==(const QName& op1, const QName& op2)
 {
     if (&op1 == &op2)
         return true;
-    return (!XMLString::compareString(op1.getNamespaceURI(),op2.getNamespaceURI()) &&
-            !XMLString::compareString(op1.getLocalPart(),op2.getLocalPart()));
+    return (StringPool::equals(op1.m_local, (op1.m_owned & 0x2) != 0, op2.m_local, (op2.m_owned & 0x2) != 0) &&
+            StringPool::equals(op1.m_uri, (op1.m_owned & 0x1) != 0, op2.m_uri, (op2.m_owned & 0x1) != 0));
 }
 
 bool xmltooling::operator!=(const QName& op1, const QName& op2)
@@ -119,13 +259,15 @@ bool xmltooling::operator!=(const QName& op1, const QName& op2)
 
 bool xmltooling::operator<(const QName& op1, const QName& op2)
 {
-    int i=XMLString::compareString(op1.getNamespaceURI(),op2.getNamespaceURI());
-    if (i<0)
-        return true;
-    else if (i==0)
-        return (XMLString::compareString(op1.getLocalPart(),op2.getLocalPart())<0);
-    else
+    // Identical pooled strings needn't be compared, but ordering remains lexical.
+    if (op1.m_uri != op2.m_uri) {
+        int i=XMLString::compareString(op1.getNamespaceURI(),op2.getNamespaceURI());
+        if (i!=0)
+            return (i<0);
+    }
+    if (op1.m_local == op2.m_local)
         return false;
+    return (XMLString::compareString(op1.getLocalPart(),op2.getLocalPart())<0);
 }
 
 string QName::toString() const
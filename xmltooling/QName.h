@@ -40,6 +40,9 @@ namespace xmltooling {
     /**
      * A data structure for encapsulating XML QNames.
      * The Xerces class is too limited to use at the moment.
+     *
+     * <p>The strings making up a QName are drawn from a process-wide pool, so
+     * copies are cheap and comparisons are usually a matter of comparing addresses.
      */
     class XMLTOOL_API QName
     {
@@ -61,44 +64,59 @@ namespace xmltooling {
          * @param prefix    namespace prefix (without the colon)
          */
         QName(const char* uri, const char* localPart, const char* prefix=nullptr);
-        
+
+        /**
+         * Copy constructor
+         *
+         * @param src   QName to copy
+         */
+        QName(const QName& src);
+
         ~QName();
+
+        /**
+         * Assignment operator
+         *
+         * @param src   QName to copy
+         * @return  this object
+         */
+        QName& operator=(const QName& src);
         
         /**
          * Indicates whether the QName has a prefix.
          * @return  true iff the prefix is non-empty
          */
-        bool hasPrefix() const { return !m_prefix.empty(); }
+        bool hasPrefix() const { return *m_prefix != 0; }
 
         /**
          * Indicates whether the QName has a non-empty namespace.
          * @return  true iff the namespace is non-empty
          */
-        bool hasNamespaceURI() const { return !m_uri.empty(); }
+        bool hasNamespaceURI() const { return *m_uri != 0; }
 
         /**
          * Indicates whether the QName has a non-empty local name.
          * @return  true iff the local name is non-empty
          */
-        bool hasLocalPart() const { return !m_local.empty(); }
+        bool hasLocalPart() const { return *m_local != 0; }
 
         /**
          * Returns the namespace prefix
          * @return  Null-terminated Unicode string containing the prefix, without the colon
          */
-        const XMLCh* getPrefix() const { return m_prefix.c_str(); }
+        const XMLCh* getPrefix() const { return m_prefix; }
 
         /**
          * Returns the namespace URI
          * @return  Null-terminated Unicode string containing the URI
          */
-        const XMLCh* getNamespaceURI() const { return m_uri.c_str(); }
+        const XMLCh* getNamespaceURI() const { return m_uri; }
 
         /**
          * Returns the local part of the name
          * @return  Null-terminated Unicode string containing the local name
          */
-        const XMLCh* getLocalPart() const { return m_local.c_str(); }
+        const XMLCh* getLocalPart() const { return m_local; }
 
         /**
          * Sets the namespace prefix
@@ -144,10 +162,18 @@ namespace xmltooling {
          */
         std::string toString() const;
         
+        /// @cond OFF
+        friend XMLTOOL_API bool operator<(const QName& op1, const QName& op2);
+        friend XMLTOOL_API bool operator==(const QName& op1, const QName& op2);
+        /// @endcond
+
     private:
-        xstring m_uri;
-        xstring m_local;
-        xstring m_prefix;
+        void assign(const XMLCh*& member, unsigned char flag, const XMLCh* value);
+
+        const XMLCh* m_uri;
+        const XMLCh* m_local;
+        const XMLCh* m_prefix;
+        unsigned char m_owned;
     };
 
 #if defined (_MSC_VER)
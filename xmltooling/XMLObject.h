@@ -52,6 +52,12 @@ namespace xmltooling {
     class XMLTOOL_API Credential;
 #endif
     class XMLTOOL_API QName;
+    class XMLTOOL_API AbstractComplexElement;
+    class XMLTOOL_API AbstractDOMCachingXMLObject;
+    class XMLTOOL_API XMLHelper;
+    class IDIndex;
+    template <class _Tx, class _Ty> class XMLObjectChildrenList;
+    template <class _Tx, class _Ty> class XMLObjectPairList;
 
     /**
      * Object that represents an XML Element that has been unmarshalled into this C++ object.
@@ -364,8 +370,31 @@ namespace xmltooling {
 
     protected:
         XMLObject();
+
+        /** Copy constructor, which does not carry over the position in a parent. */
+        XMLObject(const XMLObject& src);
+
     private:
         XMLObject& operator=(const XMLObject& src);
+
+        /// @cond OFF
+        // Position of this object in its parent's ordered child list, recorded when
+        // the child is added through a typed collection so it can be removed directly.
+        template <class _Tx, class _Ty> friend class XMLObjectChildrenList;
+        template <class _Tx, class _Ty> friend class XMLObjectPairList;
+        friend class AbstractComplexElement;
+        std::list<XMLObject*>::iterator m_slot;
+        bool m_slotted;
+
+        // Index of the IDs in the subtree rooted at this object, built by XMLHelper on
+        // lookup and discarded whenever the subtree changes. The flag is set on every
+        // object covered by an index when it's built, so that changes elsewhere don't
+        // have to look for indexes to discard.
+        friend class AbstractDOMCachingXMLObject;
+        friend class XMLHelper;
+        mutable IDIndex* m_idIndex;
+        mutable bool m_idIndexed;
+        /// @endcond
     };
 
 };
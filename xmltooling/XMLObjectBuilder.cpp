@@ -27,20 +27,94 @@
 #include "internal.h"
 #include "logging.h"
 #include "ConcreteXMLObjectBuilder.h"
+#include "io/AbstractXMLObjectUnmarshaller.h"
 #include "util/NDC.h"
+#include "util/XMLConstants.h"
 #include "util/XMLHelper.h"
 
+#include <vector>
+#include <xercesc/util/XMLUniDefs.hpp>
+
 using namespace xmltooling::logging;
 using namespace xmltooling;
 using namespace std;
 
+using xercesc::DOMAttr;
 using xercesc::DOMDocument;
 using xercesc::DOMElement;
+using xercesc::XMLString;
 using boost::scoped_ptr;
 
 map<QName,XMLObjectBuilder*> XMLObjectBuilder::m_map;
 XMLObjectBuilder* XMLObjectBuilder::m_default = nullptr;
 
+namespace {
+    // Hash index over m_map, probed with raw strings. The entries point at the
+    // strings inside the map's keys, which stay put until the key is erased.
+    struct BuilderEntry {
+        BuilderEntry(unsigned int h, const QName& key, XMLObjectBuilder* b)
+            : hash(h), ns(key.getNamespaceURI()), local(key.getLocalPart()), builder(b) {}
+        unsigned int hash;
+        const XMLCh* ns;
+        const XMLCh* local;
+        XMLObjectBuilder* builder;
+    };
+    typedef vector<BuilderEntry> BuilderBucket;
+
+    vector<BuilderBucket> g_builderIndex;
+    vector<BuilderBucket>::size_type g_builderCount = 0;
+
+    // Cached at registration time to avoid a Category lookup per element.
+    Category* g_builderLog = nullptr;
+
+    // FNV-1a over both parts, with null and empty namespaces hashing alike.
+    unsigned int hashName(const XMLCh* nsURI, const XMLCh* localName)
+    {
+        unsigned int h = 2166136261U;
+        if (nsURI) {
+            while (*nsURI)
+                h = (h ^ *nsURI++) * 16777619U;
+        }
+        h = (h ^ xercesc::chPipe) * 16777619U;
+        if (localName) {
+            while (*localName)
+                h = (h ^ *localName++) * 16777619U;
+        }
+        return h;
+    }
+
+    void indexBuilder(const QName& key, XMLObjectBuilder* builder)
+    {
+        if (g_builderCount >= g_builderIndex.size()) {
+            // Grow to keep chains short, rehashing the existing entries.
+            vector<BuilderBucket> rehashed(g_builderIndex.empty() ? 64 : g_builderIndex.size() * 2);
+            for (vector<BuilderBucket>::const_iterator b = g_builderIndex.begin(); b != g_builderIndex.end(); ++b) {
+                for (BuilderBucket::const_iterator e = b->begin(); e != b->end(); ++e)
+                    rehashed[e->hash & (rehashed.size() - 1)].push_back(*e);
+            }
+            g_builderIndex.swap(rehashed);
+        }
+        unsigned int h = hashName(key.getNamespaceURI(), key.getLocalPart());
+        g_builderIndex[h & (g_builderIndex.size() - 1)].push_back(BuilderEntry(h, key, builder));
+        ++g_builderCount;
+    }
+
+    void unindexBuilder(const QName& key)
+    {
+        if (g_builderIndex.empty())
+            return;
+        unsigned int h = hashName(key.getNamespaceURI(), key.getLocalPart());
+        BuilderBucket& bucket = g_builderIndex[h & (g_builderIndex.size() - 1)];
+        for (BuilderBucket::iterator e = bucket.begin(); e != bucket.end(); ++e) {
+            if (e->hash == h && XMLString::equals(e->local, key.getLocalPart()) && XMLString::equals(e->ns, key.getNamespaceURI())) {
+                bucket.erase(e);
+                --g_builderCount;
+                return;
+            }
+        }
+    }
+};
+
 XMLObjectBuilder::XMLObjectBuilder()
 {
 }
@@ -54,31 +128,47 @@ XMLObject* XMLObjectBuilder::buildFromQName(const QName& q) const
     return buildObject(q.getNamespaceURI(),q.getLocalPart(),q.getPrefix());
 }
 
-XMLObject* XMLObjectBuilder::buildFromElement(DOMElement* element, bool bindDocument) const
+XMLObject* XMLObjectBuilder::buildFromElement(DOMElement* element, bool bindDocument, bool lazy) const
 {
     scoped_ptr<QName> schemaType(XMLHelper::getXSIType(element));
     auto_ptr<XMLObject> ret(
         buildObject(element->getNamespaceURI(),element->getLocalName(),element->getPrefix(),schemaType.get())
         );
-    ret->unmarshall(element,bindDocument);
+    AbstractXMLObjectUnmarshaller* unmarshaller = lazy ? dynamic_cast<AbstractXMLObjectUnmarshaller*>(ret.get()) : nullptr;
+    if (unmarshaller)
+        unmarshaller->unmarshallLazily(element,bindDocument);
+    else
+        ret->unmarshall(element,bindDocument);
     return ret.release();
 }
 
-XMLObject* XMLObjectBuilder::buildFromDocument(DOMDocument* doc, bool bindDocument) const
+XMLObject* XMLObjectBuilder::buildFromDocument(DOMDocument* doc, bool bindDocument, bool lazy) const
 {
-    return buildFromElement(doc->getDocumentElement(),bindDocument);
+    return buildFromElement(doc->getDocumentElement(),bindDocument,lazy);
 }
 
-XMLObject* XMLObjectBuilder::buildOneFromElement(xercesc::DOMElement* element, bool bindDocument)
+XMLObject* XMLObjectBuilder::buildOneFromElement(xercesc::DOMElement* element, bool bindDocument, bool lazy)
 {
     const XMLObjectBuilder* b=getBuilder(element);
-    return b ? b->buildFromElement(element,bindDocument) : nullptr;
+    return b ? b->buildFromElement(element,bindDocument,lazy) : nullptr;
 }
 
 const XMLObjectBuilder* XMLObjectBuilder::getBuilder(const QName& key)
 {
-    map<QName,XMLObjectBuilder*>::const_iterator i=m_map.find(key);
-    return (i==m_map.end()) ? nullptr : i->second;
+    return getBuilder(key.getNamespaceURI(), key.getLocalPart());
+}
+
+const XMLObjectBuilder* XMLObjectBuilder::getBuilder(const XMLCh* nsURI, const XMLCh* localName)
+{
+    if (g_builderIndex.empty() || !localName)
+        return nullptr;
+    unsigned int h = hashName(nsURI, localName);
+    const BuilderBucket& bucket = g_builderIndex[h & (g_builderIndex.size() - 1)];
+    for (BuilderBucket::const_iterator e = bucket.begin(); e != bucket.end(); ++e) {
+        if (e->hash == h && XMLString::equals(e->local, localName) && XMLString::equals(e->ns, nsURI))
+            return e->builder;
+    }
+    return nullptr;
 }
 
 const XMLObjectBuilder* XMLObjectBuilder::getBuilder(const DOMElement* domElement)
@@ -86,28 +176,47 @@ const XMLObjectBuilder* XMLObjectBuilder::getBuilder(const DOMElement* domElemen
 #ifdef _DEBUG
     xmltooling::NDC ndc("getBuilder");
 #endif
-    Category& log=Category::getInstance(XMLTOOLING_LOGCAT ".XMLObjectBuilder");
- 
-    scoped_ptr<QName> schemaType(XMLHelper::getXSIType(domElement));
-    const XMLObjectBuilder* xmlObjectBuilder = schemaType.get() ? getBuilder(*(schemaType.get())) : nullptr;
-    if (xmlObjectBuilder) {
-        if (log.isDebugEnabled()) {
-            log.debug("located XMLObjectBuilder for schema type: %s", schemaType->toString().c_str());
+    static const XMLCh type[]= UNICODE_LITERAL_4(t,y,p,e);
+
+    const XMLObjectBuilder* xmlObjectBuilder = nullptr;
+
+    // Resolve any xsi:type in place rather than through XMLHelper::getXSIType.
+    const DOMAttr* typeAttr = domElement->getAttributeNodeNS(xmlconstants::XSI_NS, type);
+    const XMLCh* typeValue = typeAttr ? typeAttr->getNodeValue() : nullptr;
+    if (typeValue && *typeValue) {
+        int i = XMLString::indexOf(typeValue, xercesc::chColon);
+        if (i > 0) {
+            XMLCh prefixbuf[64];
+            XMLCh* prefix = (i < 64) ? prefixbuf : new XMLCh[i + 1];
+            auto_arrayptr<XMLCh> janitor(prefix != prefixbuf ? prefix : nullptr);
+            XMLString::subString(prefix, typeValue, 0, i);
+            prefix[i] = xercesc::chNull;
+            xmlObjectBuilder = getBuilder(domElement->lookupNamespaceURI(prefix), typeValue + i + 1);
+        }
+        else {
+            xmlObjectBuilder = getBuilder(domElement->lookupNamespaceURI(nullptr), typeValue);
+        }
+        if (xmlObjectBuilder) {
+            if (g_builderLog && g_builderLog->isDebugEnabled()) {
+                auto_ptr_char t(typeValue);
+                g_builderLog->debug("located XMLObjectBuilder for schema type: %s", t.get());
+            }
+            return xmlObjectBuilder;
         }
-        return xmlObjectBuilder;
     }
-    
-    scoped_ptr<QName> elementName(XMLHelper::getNodeQName(domElement));
-    xmlObjectBuilder = getBuilder(*(elementName.get()));
+
+    xmlObjectBuilder = getBuilder(domElement->getNamespaceURI(), domElement->getLocalName());
     if (xmlObjectBuilder) {
-        if (log.isDebugEnabled()) {
-            log.debug("located XMLObjectBuilder for element name: %s", elementName->toString().c_str());
+        if (g_builderLog && g_builderLog->isDebugEnabled()) {
+            scoped_ptr<QName> elementName(XMLHelper::getNodeQName(domElement));
+            g_builderLog->debug("located XMLObjectBuilder for element name: %s", elementName->toString().c_str());
         }
         return xmlObjectBuilder;
     }
 
-    if (log.isDebugEnabled()) {
-        log.debug("no XMLObjectBuilder registered for element (%s), returning default", elementName->toString().c_str());
+    if (g_builderLog && g_builderLog->isDebugEnabled()) {
+        scoped_ptr<QName> elementName(XMLHelper::getNodeQName(domElement));
+        g_builderLog->debug("no XMLObjectBuilder registered for element (%s), returning default", elementName->toString().c_str());
     }
     return m_default;
 }
@@ -124,20 +233,29 @@ const map<QName,XMLObjectBuilder*>& XMLObjectBuilder::getBuilders()
 
 void XMLObjectBuilder::registerBuilder(const QName& builderKey, XMLObjectBuilder* builder)
 {
+    if (!g_builderLog)
+        g_builderLog = &Category::getInstance(XMLTOOLING_LOGCAT ".XMLObjectBuilder");
     deregisterBuilder(builderKey);
-    m_map[builderKey]=builder;
+    map<QName,XMLObjectBuilder*>::iterator i = m_map.insert(make_pair(builderKey, builder)).first;
+    indexBuilder(i->first, builder);
 }
 
 void XMLObjectBuilder::registerDefaultBuilder(XMLObjectBuilder* builder)
 {
+    if (!g_builderLog)
+        g_builderLog = &Category::getInstance(XMLTOOLING_LOGCAT ".XMLObjectBuilder");
     deregisterDefaultBuilder();
     m_default=builder;
 }
 
 void XMLObjectBuilder::deregisterBuilder(const QName& builderKey)
 {
-    delete getBuilder(builderKey);
-    m_map.erase(builderKey);
+    map<QName,XMLObjectBuilder*>::iterator i = m_map.find(builderKey);
+    if (i != m_map.end()) {
+        unindexBuilder(i->first);
+        delete i->second;
+        m_map.erase(i);
+    }
 }
 
 void XMLObjectBuilder::deregisterDefaultBuilder()
@@ -150,6 +268,8 @@ void XMLObjectBuilder::destroyBuilders()
 {
     for_each(m_map.begin(),m_map.end(),cleanup_pair<QName,XMLObjectBuilder>());
     m_map.clear();
+    g_builderIndex.clear();
+    g_builderCount = 0;
     deregisterDefaultBuilder();
 }
 
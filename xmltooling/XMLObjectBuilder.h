@@ -80,9 +80,10 @@ namespace xmltooling {
          * 
          * @param element       the unmarshalling source
          * @param bindDocument  true iff the XMLObject should take ownership of the DOM Document
+         * @param lazy          true iff child elements should be unmarshalled on first access
          * @return the unmarshalled XMLObject
          */
-        XMLObject* buildFromElement(xercesc::DOMElement* element, bool bindDocument=false) const;
+        XMLObject* buildFromElement(xercesc::DOMElement* element, bool bindDocument=false, bool lazy=false) const;
 
         /**
          * Creates an unmarshalled XMLObject from the root of a DOM Document.
@@ -90,9 +91,10 @@ namespace xmltooling {
          * 
          * @param doc           the unmarshalling source
          * @param bindDocument  true iff the XMLObject should take ownership of the DOM Document
+         * @param lazy          true iff child elements should be unmarshalled on first access
          * @return the unmarshalled XMLObject
          */
-        XMLObject* buildFromDocument(xercesc::DOMDocument* doc, bool bindDocument=true) const;
+        XMLObject* buildFromDocument(xercesc::DOMDocument* doc, bool bindDocument=true, bool lazy=false) const;
 
         /**
          * Creates an unmarshalled XMLObject using the default build method, if a builder can be found.
@@ -100,9 +102,10 @@ namespace xmltooling {
          * 
          * @param element       the unmarshalling source
          * @param bindDocument  true iff the new XMLObject should take ownership of the DOM Document
+         * @param lazy          true iff child elements should be unmarshalled on first access
          * @return  the unmarshalled object or nullptr if no builder is available 
          */
-        static XMLObject* buildOneFromElement(xercesc::DOMElement* element, bool bindDocument=false);
+        static XMLObject* buildOneFromElement(xercesc::DOMElement* element, bool bindDocument=false, bool lazy=false);
 
         /**
          * Retrieves an XMLObjectBuilder using the key it was registered with.
@@ -112,9 +115,22 @@ namespace xmltooling {
          */
         static const XMLObjectBuilder* getBuilder(const QName& key);
 
+        /**
+         * Retrieves an XMLObjectBuilder using the namespace and local name of the key
+         * it was registered with, without constructing a QName.
+         * 
+         * @param nsURI     namespace URI of the key, or nullptr
+         * @param localName local name of the key
+         * @return the builder or nullptr
+         */
+        static const XMLObjectBuilder* getBuilder(const XMLCh* nsURI, const XMLCh* localName);
+
         /**
          * Retrieves an XMLObjectBuilder for a given DOM element.
          * If no match is found, the default builder is returned, if any.
+         *
+         * <p>Lookups take no locks and allocate no memory, so builders should be
+         * registered and deregistered only while no other threads are unmarshalling.
          * 
          * @param element the element for which to locate a builder
          * @return the builder or nullptr
@@ -396,6 +396,13 @@ bool XMLToolingInternalConfig::init(bool deprecationSupport)
         XMLPlatformUtils::Initialize();
         log.debug("Xerces %s initialization complete", XERCES_FULLVERSIONDOT);
 
+        StringPool::init();
+        initNamespaceSets();
+        initXMLObjectThreading();
+        initNamespaceScopes();
+        initSerializers();
+        initZlibCodecs();
+
 #ifndef XMLTOOLING_NO_XMLSEC
         XSECPlatformUtils::Initialise();
         XSECPlatformUtils::SetReferenceLoggingSink(TXFMOutputLogFactory);
@@ -403,6 +410,7 @@ bool XMLToolingInternalConfig::init(bool deprecationSupport)
         log.debug("XML-Security %s initialization complete", XSEC_FULLVERSIONDOT);
 #endif
 
+        ParserPool::initThreadCaches();
         m_parserPool.reset(new ParserPool());
         m_validatingPool.reset(new ParserPool(true,true));
 
@@ -542,10 +550,16 @@ void XMLToolingInternalConfig::term()
 
     m_parserPool.reset();
     m_validatingPool.reset();
+    ParserPool::termThreadCaches();
 
     for_each(m_namedLocks.begin(), m_namedLocks.end(), cleanup_pair<string,Mutex>());
     m_namedLocks.clear();
 
+    termZlibCodecs();
+    termSerializers();
+    termNamespaceScopes();
+    termXMLObjectThreading();
+
 #ifndef XMLTOOLING_NO_XMLSEC
     m_xsecProvider.reset();
     XSECPlatformUtils::Terminate();
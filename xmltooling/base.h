@@ -761,6 +761,8 @@
 
 /**
  * Implements get/set methods and a private member for a DateTime XML attribute.
+ * The value is kept in lexical and epoch form, and an XMLDateTime object is only
+ * built if the non-epoch getter is called.
  *
  * @param proper    the proper name of the attribute
  * @param fallback  epoch to return when attribute is NULL
@@ -768,28 +770,23 @@
  */
 #define IMPL_DATETIME_ATTRIB_EX(proper,fallback,duration) \
     protected: \
-        XMLDateTime* m_##proper; \
-        time_t m_##proper##Epoch; \
+        mutable XMLDateTime* m_##proper; \
+        xmltooling::DateTimeValue m_##proper##Value; \
     public: \
         const XMLDateTime* get##proper() const { \
-            return m_##proper; \
+            return getCachedDateTime(m_##proper, m_##proper##Value, duration); \
         } \
         time_t get##proper##Epoch() const { \
-            return m_##proper ? m_##proper##Epoch : fallback; \
+            return m_##proper##Value.empty() ? fallback : m_##proper##Value.getEpoch(); \
         } \
         void set##proper(const XMLDateTime* proper) { \
-            m_##proper = prepareForAssignment(m_##proper,proper); \
-            if (m_##proper) \
-                m_##proper##Epoch=m_##proper->getEpoch(duration); \
+            m_##proper = prepareForAssignment(m_##proper,m_##proper##Value,proper,duration); \
         } \
         void set##proper(time_t proper) { \
-            m_##proper = prepareForAssignment(m_##proper,proper,duration); \
-            m_##proper##Epoch = proper; \
+            m_##proper = prepareForAssignment(m_##proper,m_##proper##Value,proper,duration); \
         } \
         void set##proper(const XMLCh* proper) { \
-            m_##proper = prepareForAssignment(m_##proper,proper,duration); \
-            if (m_##proper) \
-                m_##proper##Epoch=m_##proper->getEpoch(duration); \
+            m_##proper = prepareForAssignment(m_##proper,m_##proper##Value,proper,duration); \
         }
 
 /**
@@ -937,9 +934,11 @@
         std::list<xmltooling::XMLObject*>::iterator m_pos_##proper; \
     public: \
         proper* get##proper() const { \
+            materializeContent(); \
             return m_##proper; \
         } \
         void set##proper(proper* child) { \
+            materializeContent(); \
             prepareForAssignment(m_##proper,child); \
             *m_pos_##proper = m_##proper = child; \
         }
@@ -957,9 +956,11 @@
         std::list<xmltooling::XMLObject*>::iterator m_pos_##proper; \
     public: \
         ns::proper* get##proper() const { \
+            materializeContent(); \
             return m_##proper; \
         } \
         void set##proper(ns::proper* child) { \
+            materializeContent(); \
             prepareForAssignment(m_##proper,child); \
             *m_pos_##proper = m_##proper = child; \
         }
@@ -975,9 +976,11 @@
         std::list<xmltooling::XMLObject*>::iterator m_pos_##proper; \
     public: \
         xmltooling::XMLObject* get##proper() const { \
+            materializeContent(); \
             return m_##proper; \
         } \
         void set##proper(xmltooling::XMLObject* child) { \
+            materializeContent(); \
             prepareForAssignment(m_##proper,child); \
             *m_pos_##proper = m_##proper = child; \
         }
@@ -1030,9 +1033,11 @@
         std::vector<proper*> m_##proper##s; \
     public: \
         VectorOf(proper) get##proper##s() { \
+            materializeContent(); \
             return VectorOf(proper)(this, m_##proper##s, &m_children, fence); \
         } \
         const std::vector<proper*>& get##proper##s() const { \
+            materializeContent(); \
             return m_##proper##s; \
         }
 
@@ -1049,9 +1054,11 @@
         std::vector<ns::proper*> m_##proper##s; \
     public: \
         VectorOf(ns::proper) get##proper##s() { \
+            materializeContent(); \
             return VectorOf(ns::proper)(this, m_##proper##s, &m_children, fence); \
         } \
         const std::vector<ns::proper*>& get##proper##s() const { \
+            materializeContent(); \
             return m_##proper##s; \
         }
 
@@ -1066,9 +1073,11 @@
         std::vector<xmltooling::XMLObject*> m_##proper##s; \
     public: \
         VectorOf(xmltooling::XMLObject) get##proper##s() { \
+            materializeContent(); \
             return VectorOf(xmltooling::XMLObject)(this, m_##proper##s, &m_children, fence); \
         } \
         const std::vector<xmltooling::XMLObject*>& get##proper##s() const { \
+            materializeContent(); \
             return m_##proper##s; \
         }
 
@@ -1092,8 +1101,8 @@
  * @param namespaceURI  the XML namespace of the attribute
  */
 #define MARSHALL_DATETIME_ATTRIB(proper,ucase,namespaceURI) \
-    if (m_##proper) { \
-        domElement->setAttributeNS(namespaceURI, ucase##_ATTRIB_NAME, m_##proper->getRawData()); \
+    if (!m_##proper##Value.empty()) { \
+        domElement->setAttributeNS(namespaceURI, ucase##_ATTRIB_NAME, m_##proper##Value.getRawData()); \
     }
 
 /**
@@ -1167,7 +1176,7 @@
  * @param namespaceURI  the XML namespace of the attribute
  */
 #define PROC_STRING_ATTRIB(proper,ucase,namespaceURI) \
-    if (xmltooling::XMLHelper::isNodeNamed(attribute, namespaceURI, ucase##_ATTRIB_NAME)) { \
+    if (xmltooling::XMLHelper::isNodeNamedInline(attribute, namespaceURI, ucase##_ATTRIB_NAME)) { \
         set##proper(attribute->getValue()); \
         return; \
     }
@@ -1180,7 +1189,7 @@
  * @param namespaceURI  the XML namespace of the attribute
  */
 # define PROC_ID_ATTRIB(proper,ucase,namespaceURI) \
-    if (xmltooling::XMLHelper::isNodeNamed(attribute, namespaceURI, ucase##_ATTRIB_NAME)) { \
+    if (xmltooling::XMLHelper::isNodeNamedInline(attribute, namespaceURI, ucase##_ATTRIB_NAME)) { \
         set##proper(attribute->getValue()); \
         attribute->getOwnerElement()->setIdAttributeNode(attribute, true); \
         return; \
@@ -1204,7 +1213,7 @@
  * @param namespaceURI  the XML namespace of the attribute
  */
 #define PROC_QNAME_ATTRIB(proper,ucase,namespaceURI) \
-    if (xmltooling::XMLHelper::isNodeNamed(attribute, namespaceURI, ucase##_ATTRIB_NAME)) { \
+    if (xmltooling::XMLHelper::isNodeNamedInline(attribute, namespaceURI, ucase##_ATTRIB_NAME)) { \
         boost::scoped_ptr<xmltooling::QName> q(xmltooling::XMLHelper::getNodeValueAsQName(attribute)); \
         set##proper(q.get()); \
         return; \
@@ -1238,7 +1247,7 @@
  * @param force         bypass use of hint and just cast down to check child
  */
 #define PROC_TYPED_CHILDREN(proper,namespaceURI,force) \
-    if (force || xmltooling::XMLHelper::isNodeNamed(root,namespaceURI,proper::LOCAL_NAME)) { \
+    if (force || xmltooling::XMLHelper::isNodeNamedInline(root,namespaceURI,proper::LOCAL_NAME)) { \
         proper* typesafe=dynamic_cast<proper*>(childXMLObject); \
         if (typesafe) { \
             get##proper##s().push_back(typesafe); \
@@ -1256,7 +1265,7 @@
  * @param force         bypass use of hint and just cast down to check child
  */
 #define PROC_TYPED_FOREIGN_CHILDREN(proper,ns,namespaceURI,force) \
-    if (force || xmltooling::XMLHelper::isNodeNamed(root,namespaceURI,ns::proper::LOCAL_NAME)) { \
+    if (force || xmltooling::XMLHelper::isNodeNamedInline(root,namespaceURI,ns::proper::LOCAL_NAME)) { \
         ns::proper* typesafe=dynamic_cast<ns::proper*>(childXMLObject); \
         if (typesafe) { \
             get##proper##s().push_back(typesafe); \
@@ -1272,7 +1281,7 @@
  * @param force         bypass use of hint and just cast down to check child
  */
 #define PROC_TYPED_CHILD(proper,namespaceURI,force) \
-    if (force || xmltooling::XMLHelper::isNodeNamed(root,namespaceURI,proper::LOCAL_NAME)) { \
+    if (force || xmltooling::XMLHelper::isNodeNamedInline(root,namespaceURI,proper::LOCAL_NAME)) { \
         proper* typesafe=dynamic_cast<proper*>(childXMLObject); \
         if (typesafe && !m_##proper) { \
             typesafe->setParent(this); \
@@ -1291,7 +1300,7 @@
  * @param force         bypass use of hint and just cast down to check child
  */
 #define PROC_TYPED_FOREIGN_CHILD(proper,ns,namespaceURI,force) \
-    if (force || xmltooling::XMLHelper::isNodeNamed(root,namespaceURI,ns::proper::LOCAL_NAME)) { \
+    if (force || xmltooling::XMLHelper::isNodeNamedInline(root,namespaceURI,ns::proper::LOCAL_NAME)) { \
         ns::proper* typesafe=dynamic_cast<ns::proper*>(childXMLObject); \
         if (typesafe && !m_##proper) { \
             typesafe->setParent(this); \
@@ -1307,7 +1316,7 @@
  * @param namespaceURI  the XML namespace of the child element
  */
 #define PROC_XMLOBJECT_CHILD(proper,namespaceURI) \
-    if (xmltooling::XMLHelper::isNodeNamed(root,namespaceURI,proper::LOCAL_NAME)) { \
+    if (xmltooling::XMLHelper::isNodeNamedInline(root,namespaceURI,proper::LOCAL_NAME)) { \
         if (!m_##proper) { \
             childXMLObject->setParent(this); \
             *m_pos_##proper = m_##proper = childXMLObject; \
@@ -1374,10 +1383,12 @@
         return dynamic_cast<cname*>(clone()); \
     } \
     xmltooling::XMLObject* clone() const { \
-        std::auto_ptr<xmltooling::XMLObject> domClone(xmltooling::AbstractDOMCachingXMLObject::clone()); \
-        cname##Impl* ret=dynamic_cast<cname##Impl*>(domClone.get()); \
-        if (ret) \
-            return domClone.release(); \
+        if (xmltooling::AbstractDOMCachingXMLObject::requiresDOMClone()) { \
+            std::auto_ptr<xmltooling::XMLObject> domClone(xmltooling::AbstractDOMCachingXMLObject::clone()); \
+            cname##Impl* ret=dynamic_cast<cname##Impl*>(domClone.get()); \
+            if (ret) \
+                return domClone.release(); \
+        } \
         return new cname##Impl(*this); \
     }
 
@@ -1396,10 +1407,12 @@
         return dynamic_cast<base*>(clone()); \
     } \
     xmltooling::XMLObject* clone() const { \
-        std::auto_ptr<xmltooling::XMLObject> domClone(xmltooling::AbstractDOMCachingXMLObject::clone()); \
-        cname##Impl* ret=dynamic_cast<cname##Impl*>(domClone.get()); \
-        if (ret) \
-            return domClone.release(); \
+        if (xmltooling::AbstractDOMCachingXMLObject::requiresDOMClone()) { \
+            std::auto_ptr<xmltooling::XMLObject> domClone(xmltooling::AbstractDOMCachingXMLObject::clone()); \
+            cname##Impl* ret=dynamic_cast<cname##Impl*>(domClone.get()); \
+            if (ret) \
+                return domClone.release(); \
+        } \
         return new cname##Impl(*this); \
     }
 
@@ -1414,10 +1427,12 @@
         return dynamic_cast<cname*>(clone()); \
     } \
     xmltooling::XMLObject* clone() const { \
-        std::auto_ptr<xmltooling::XMLObject> domClone(xmltooling::AbstractDOMCachingXMLObject::clone()); \
-        cname##Impl* ret=dynamic_cast<cname##Impl*>(domClone.get()); \
-        if (ret) \
-            return domClone.release(); \
+        if (xmltooling::AbstractDOMCachingXMLObject::requiresDOMClone()) { \
+            std::auto_ptr<xmltooling::XMLObject> domClone(xmltooling::AbstractDOMCachingXMLObject::clone()); \
+            cname##Impl* ret=dynamic_cast<cname##Impl*>(domClone.get()); \
+            if (ret) \
+                return domClone.release(); \
+        } \
         std::auto_ptr<cname##Impl> ret2(new cname##Impl(*this)); \
         ret2->_clone(*this); \
         return ret2.release(); \
@@ -1439,10 +1454,12 @@
         return dynamic_cast<base*>(clone()); \
     } \
     xmltooling::XMLObject* clone() const { \
-        std::auto_ptr<xmltooling::XMLObject> domClone(xmltooling::AbstractDOMCachingXMLObject::clone()); \
-        cname##Impl* ret=dynamic_cast<cname##Impl*>(domClone.get()); \
-        if (ret) \
-            return domClone.release(); \
+        if (xmltooling::AbstractDOMCachingXMLObject::requiresDOMClone()) { \
+            std::auto_ptr<xmltooling::XMLObject> domClone(xmltooling::AbstractDOMCachingXMLObject::clone()); \
+            cname##Impl* ret=dynamic_cast<cname##Impl*>(domClone.get()); \
+            if (ret) \
+                return domClone.release(); \
+        } \
         std::auto_ptr<cname##Impl> ret2(new cname##Impl(*this)); \
         ret2->_clone(*this); \
         return ret2.release(); \
@@ -1477,6 +1494,15 @@
 #define IMPL_CLONE_INTEGER_ATTRIB(proper) \
     set##proper(src.m_##proper)
 
+/**
+ * Implements cloning of a DateTime child attribute, for use in copy constructor or
+ * deferred clone methods, without building an XMLDateTime object.
+ *
+ * proper   the proper name of the attribute to clone
+ */
+#define IMPL_CLONE_DATETIME_ATTRIB(proper) \
+    set##proper(src.m_##proper##Value.getRawData())
+
 /**
  * Implements cloning of a boolean child attribute, for use in copy constructor or
  * deferred clone methods.
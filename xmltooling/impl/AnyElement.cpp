@@ -65,14 +65,16 @@ void AnyElementImpl::_clone(const AnyElementImpl& src)
 }
 
 XMLObject* AnyElementImpl::clone() const {
-    auto_ptr<XMLObject> domClone(AbstractDOMCachingXMLObject::clone());
-    AnyElementImpl* ret=dynamic_cast<AnyElementImpl*>(domClone.get());
-    if (ret) {
-        return domClone.release();
+    if (requiresDOMClone()) {
+        auto_ptr<XMLObject> domClone(AbstractDOMCachingXMLObject::clone());
+        AnyElementImpl* ret=dynamic_cast<AnyElementImpl*>(domClone.get());
+        if (ret) {
+            return domClone.release();
+        }
     }
 
     auto_ptr<AnyElementImpl> ret2(new AnyElementImpl(*this));
-    ret2->_clone(*ret2.get());
+    ret2->_clone(*this);
     return ret2.release();
 }
 
@@ -0,0 +1,166 @@
+/**
+ * Licensed to the University Corporation for Advanced Internet
+ * Development, Inc. (UCAID) under one or more contributor license
+ * agreements. See the NOTICE file distributed with this work for
+ * additional information regarding copyright ownership.
+ *
+ * UCAID licenses this file to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file except
+ * in compliance with the License. You may obtain a copy of the
+ * License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ */
+
+/**
+ * HashTable.h
+ *
+ * Internal open-addressed hash table for the storage service implementations.
+ */
+
+#ifndef __xmltooling_hashtable_h__
+#define __xmltooling_hashtable_h__
+
+#include "internal.h"
+
+#include <cstring>
+
+namespace xmltooling {
+
+    // FNV-1a, computed once per call and reused for every probe.
+    inline unsigned int hashKey(const char* key)
+    {
+        unsigned int h = 2166136261U;
+        for (const unsigned char* p = reinterpret_cast<const unsigned char*>(key); *p; ++p)
+            h = (h ^ *p) * 16777619U;
+        return h;
+    }
+
+    /**
+     * Open-addressed hash table of heap-allocated entries exposing "name" and "hash" members.
+     *
+     * <p>Slots carry the full hash next to the entry pointer so that probing rarely touches
+     * the entries themselves, and lookups compare directly against a C string key. Entries
+     * never move, so other structures can point at them.
+     */
+    template <class T> class XMLTOOL_DLLLOCAL HashTable
+    {
+        MAKE_NONCOPYABLE(HashTable);
+        struct Slot {
+            Slot() : entry(nullptr), hash(0), deleted(false) {}
+            T* entry;
+            unsigned int hash;
+            bool deleted;
+        };
+    public:
+        HashTable() : m_slots(nullptr), m_bits(0), m_count(0), m_used(0) {}
+
+        ~HashTable() {
+            for (size_t i = 0; i < capacity(); ++i)
+                delete m_slots[i].entry;
+            delete[] m_slots;
+        }
+
+        size_t size() const {
+            return m_count;
+        }
+
+        size_t capacity() const {
+            return m_slots ? (static_cast<size_t>(1) << m_bits) : 0;
+        }
+
+        // Returns the entry in a slot, or nullptr, for scanning the table.
+        T* at(size_t i) const {
+            return m_slots[i].entry;
+        }
+
+        T* find(const char* name, unsigned int hash) const {
+            if (!m_slots)
+                return nullptr;
+            const size_t mask = capacity() - 1;
+            for (size_t i = start(hash); ; i = (i + 1) & mask) {
+                const Slot& slot = m_slots[i];
+                if (slot.entry) {
+                    if (slot.hash == hash && !strcmp(slot.entry->name.c_str(), name))
+                        return slot.entry;
+                }
+                else if (!slot.deleted) {
+                    return nullptr;
+                }
+            }
+        }
+
+        // Takes ownership of an entry whose name isn't already present.
+        void insert(T* entry) {
+            if ((m_used + 1) * 4 > capacity() * 3)
+                rehash();
+            const size_t mask = capacity() - 1;
+            size_t i = start(entry->hash);
+            while (m_slots[i].entry)
+                i = (i + 1) & mask;
+            if (!m_slots[i].deleted)
+                ++m_used;
+            m_slots[i].entry = entry;
+            m_slots[i].hash = entry->hash;
+            m_slots[i].deleted = false;
+            ++m_count;
+        }
+
+        // Returns the first entry at or after a random slot, or nullptr if the table is empty.
+        T* sample(unsigned int r) const {
+            if (!m_count)
+                return nullptr;
+            const size_t mask = capacity() - 1;
+            size_t i = r & mask;
+            while (!m_slots[i].entry)
+                i = (i + 1) & mask;
+            return m_slots[i].entry;
+        }
+
+        // Removes an entry from the table, leaving it to the caller to delete.
+        void remove(T* entry) {
+            const size_t mask = capacity() - 1;
+            size_t i = start(entry->hash);
+            while (m_slots[i].entry != entry)
+                i = (i + 1) & mask;
+            m_slots[i].entry = nullptr;
+            m_slots[i].deleted = true;
+            --m_count;
+        }
+
+    private:
+        // Fibonacci hashing, so the high bits pick the slot and the low bits are free for sharding.
+        size_t start(unsigned int hash) const {
+            return (hash * 2654435769U) >> (32 - m_bits);
+        }
+
+        void rehash() {
+            // Grow if live entries justify it, otherwise just sweep out the tombstones.
+            unsigned int bits = m_bits ? m_bits : 4;
+            while ((m_count + 1) * 2 > (static_cast<size_t>(1) << bits))
+                ++bits;
+            Slot* old = m_slots;
+            size_t oldCapacity = capacity();
+            m_slots = new Slot[static_cast<size_t>(1) << bits];
+            m_bits = bits;
+            m_count = m_used = 0;
+            for (size_t i = 0; i < oldCapacity; ++i) {
+                if (old[i].entry)
+                    insert(old[i].entry);
+            }
+            delete[] old;
+        }
+
+        Slot* m_slots;
+        unsigned int m_bits;
+        size_t m_count,m_used;
+    };
+};
+
+#endif /* __xmltooling_hashtable_h__ */
@@ -0,0 +1,970 @@
+/**
+ * Licensed to the University Corporation for Advanced Internet
+ * Development, Inc. (UCAID) under one or more contributor license
+ * agreements. See the NOTICE file distributed with this work for
+ * additional information regarding copyright ownership.
+ *
+ * UCAID licenses this file to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file except
+ * in compliance with the License. You may obtain a copy of the
+ * License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ */
+
+/**
+ * MappedStorageService.cpp
+ *
+ * Persistent storage in a memory-mapped, append-only log file.
+ */
+
+#include "internal.h"
+#include "exceptions.h"
+#include "logging.h"
+#include "impl/HashTable.h"
+#include "util/NDC.h"
+#include "util/PathResolver.h"
+#include "util/StorageService.h"
+#include "util/Threads.h"
+#include "util/XMLHelper.h"
+
+#if defined(WIN32) || defined(HAVE_SYS_MMAN_H)
+
+#include <cstdio>
+#include <cstring>
+#ifdef WIN32
+# include <windows.h>
+#else
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <sys/file.h>
+# include <sys/mman.h>
+#endif
+#include <zlib.h>
+#include <xercesc/util/XMLUniDefs.hpp>
+
+using namespace xmltooling::logging;
+using namespace xmltooling;
+using boost::scoped_ptr;
+using namespace std;
+
+using xercesc::DOMElement;
+
+namespace {
+    // Identifies the file format, followed by padding out to the first entry.
+    static const char g_magic[8] = { 'X','T','S','T','O','R','E','1' };
+    static const size_t g_headerSize = 16;
+
+    // New logs start at this size and double as they fill up.
+    static const size_t g_initialSize = 1024 * 1024;
+
+    // Logs smaller than this are never worth compacting, unless configured otherwise.
+    static const size_t g_minimumCompaction = 4 * 1024 * 1024;
+
+    // Maximum number of records reaped or copied before the lock is released again.
+    static const unsigned long g_batch = 1000;
+
+    enum EntryType {
+        PUT_RECORD = 1,
+        DELETE_RECORD = 2,
+        UPDATE_CONTEXT = 3,
+        DELETE_CONTEXT = 4
+    };
+
+    // Fixed part of every log entry, which is followed by the null-terminated context, key, and value.
+    struct EntryHeader {
+        XMLUInt32 length;       // size of the whole entry, padded to a multiple of 8
+        XMLUInt32 checksum;     // CRC-32 of the entry, excluding this field
+        XMLInt64 expiration;
+        XMLInt64 stamp;         // time of a context update
+        XMLInt32 version;
+        XMLUInt32 valueLength;
+        XMLUInt16 contextLength;
+        XMLUInt16 keyLength;
+        unsigned char type;
+        unsigned char reserved[3];
+    };
+
+    XMLUInt32 checksum(const char* entry, size_t length)
+    {
+        uLong crc = crc32(0L, Z_NULL, 0);
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(entry), 4);
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(entry + 8), static_cast<uInt>(length - 8));
+        return static_cast<XMLUInt32>(crc);
+    }
+
+    const EntryHeader* entryAt(const char* log, size_t offset)
+    {
+        return reinterpret_cast<const EntryHeader*>(log + offset);
+    }
+
+    const char* contextOf(const EntryHeader* header)
+    {
+        return reinterpret_cast<const char*>(header) + sizeof(EntryHeader);
+    }
+
+    const char* keyOf(const EntryHeader* header)
+    {
+        return contextOf(header) + header->contextLength + 1;
+    }
+
+    const char* valueOf(const EntryHeader* header)
+    {
+        return keyOf(header) + header->keyLength + 1;
+    }
+
+    // Checks that a complete, undamaged entry starts at the offset.
+    bool validEntry(const char* log, size_t offset, size_t size)
+    {
+        if (offset + sizeof(EntryHeader) > size)
+            return false;
+        const EntryHeader* header = entryAt(log, offset);
+        if (header->length < sizeof(EntryHeader) || header->length % 8 || header->length > size - offset)
+            return false;
+        if (header->type < PUT_RECORD || header->type > DELETE_CONTEXT)
+            return false;
+        if (sizeof(EntryHeader) + header->contextLength + header->keyLength + header->valueLength + 3 > header->length)
+            return false;
+        return checksum(log + offset, header->length) == header->checksum;
+    }
+
+    // A file mapped for reading and writing that can be grown in place.
+    class MappedLog {
+        MAKE_NONCOPYABLE(MappedLog);
+    public:
+        MappedLog(const char* pathname, size_t minimum);
+        ~MappedLog();
+
+        char* data() const {
+            return m_data;
+        }
+
+        size_t size() const {
+            return m_size;
+        }
+
+        void resize(size_t size);
+        void sync(size_t offset, size_t length);
+
+    private:
+        void unmap();
+
+        string m_path;
+        char* m_data;
+        size_t m_size;
+#ifdef WIN32
+        HANDLE m_file,m_mapping;
+#else
+        int m_fd;
+#endif
+    };
+
+#ifdef WIN32
+    MappedLog::MappedLog(const char* pathname, size_t minimum) : m_path(pathname), m_data(nullptr), m_size(0), m_mapping(nullptr)
+    {
+        // No sharing, so only one log object at a time can use the file. Renaming is allowed
+        // so that compaction can move the file aside while it's still open.
+        m_file = CreateFileA(pathname, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_DELETE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE)
+            throw IOException("Unable to open storage file ($1), it may be in use by another process.", params(1, pathname));
+        LARGE_INTEGER len;
+        if (!GetFileSizeEx(m_file, &len)) {
+            CloseHandle(m_file);
+            throw IOException("Unable to determine size of storage file ($1).", params(1, pathname));
+        }
+        try {
+            m_size = static_cast<size_t>(len.QuadPart);
+            resize(max(m_size, minimum));
+        }
+        catch (exception&) {
+            CloseHandle(m_file);
+            throw;
+        }
+    }
+
+    MappedLog::~MappedLog()
+    {
+        unmap();
+        CloseHandle(m_file);
+    }
+
+    void MappedLog::unmap()
+    {
+        if (m_data)
+            UnmapViewOfFile(m_data);
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        m_data = nullptr;
+        m_mapping = nullptr;
+    }
+
+    void MappedLog::resize(size_t size)
+    {
+        // The new view is made before the old one is released, so a failure leaves the log as it was.
+        // Mapping past the end of the file extends it.
+        LARGE_INTEGER len;
+        len.QuadPart = size;
+        HANDLE mapping = CreateFileMapping(m_file, nullptr, PAGE_READWRITE, len.HighPart, len.LowPart, nullptr);
+        char* data = mapping ? reinterpret_cast<char*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0)) : nullptr;
+        if (!data) {
+            if (mapping)
+                CloseHandle(mapping);
+            throw IOException("Unable to map storage file ($1).", params(1, m_path.c_str()));
+        }
+        unmap();
+        m_mapping = mapping;
+        m_data = data;
+
+        // Windows doesn't promise that the extended region is zeroed.
+        size_t old = m_size;
+        m_size = size;
+        if (size > old)
+            memset(m_data + old, 0, size - old);
+    }
+
+    void MappedLog::sync(size_t offset, size_t length)
+    {
+        FlushViewOfFile(m_data + offset, length);
+        FlushFileBuffers(m_file);
+    }
+#else
+    MappedLog::MappedLog(const char* pathname, size_t minimum) : m_path(pathname), m_data(nullptr), m_size(0)
+    {
+        m_fd = open(pathname, O_RDWR | O_CREAT, 0600);
+        if (m_fd < 0)
+            throw IOException("Unable to open storage file ($1).", params(1, pathname));
+
+        // Only one process at a time can use a log. Record locks belong to the process,
+        // so flock() also stops a second log object in this process from opening it.
+        struct flock lck;
+        memset(&lck, 0, sizeof(lck));
+        lck.l_type = F_WRLCK;
+        lck.l_whence = SEEK_SET;
+        struct stat stat_buf;
+        if (flock(m_fd, LOCK_EX | LOCK_NB) != 0 || fcntl(m_fd, F_SETLK, &lck) != 0 || fstat(m_fd, &stat_buf) != 0) {
+            close(m_fd);
+            throw IOException("Unable to lock storage file ($1), it may be in use by another process.", params(1, pathname));
+        }
+
+        try {
+            m_size = stat_buf.st_size;
+            resize(max(m_size, minimum));
+        }
+        catch (exception&) {
+            close(m_fd);
+            throw;
+        }
+    }
+
+    MappedLog::~MappedLog()
+    {
+        unmap();
+        close(m_fd);
+    }
+
+    void MappedLog::unmap()
+    {
+        if (m_data)
+            munmap(m_data, m_size);
+        m_data = nullptr;
+    }
+
+    void MappedLog::resize(size_t size)
+    {
+        // The new mapping is made before the old one is released, so a failure leaves the log as it was.
+        // The file only ever grows, and the part past the old size is unused, so it's left as is on failure.
+        if (size != m_size && ftruncate(m_fd, size) != 0)
+            throw IOException("Unable to extend storage file ($1).", params(1, m_path.c_str()));
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        if (p == MAP_FAILED)
+            throw IOException("Unable to map storage file ($1).", params(1, m_path.c_str()));
+        unmap();
+        m_data = reinterpret_cast<char*>(p);
+        m_size = size;
+    }
+
+    void MappedLog::sync(size_t offset, size_t length)
+    {
+        // The range has to start on a page boundary.
+        size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t start = offset - (offset % pageSize);
+        msync(m_data + start, length + (offset - start), MS_SYNC);
+    }
+#endif
+
+    // Appends an entry at the end of a log, growing it as needed, and returns its offset.
+    size_t writeEntry(
+        MappedLog& log, size_t& end, unsigned char type, const char* context, const char* key,
+        const char* value, size_t valueLength, time_t expiration, time_t stamp, int version
+        )
+    {
+        size_t contextLength = strlen(context);
+        size_t keyLength = key ? strlen(key) : 0;
+        size_t length = (sizeof(EntryHeader) + contextLength + keyLength + valueLength + 3 + 7) & ~static_cast<size_t>(7);
+        if (end + length > log.size()) {
+            size_t size = log.size();
+            while (end + length > size)
+                size *= 2;
+            log.resize(size);
+        }
+
+        char* p = log.data() + end;
+        memset(p, 0, length);
+        EntryHeader* header = reinterpret_cast<EntryHeader*>(p);
+        header->length = static_cast<XMLUInt32>(length);
+        header->expiration = expiration;
+        header->stamp = stamp;
+        header->version = version;
+        header->valueLength = static_cast<XMLUInt32>(valueLength);
+        header->contextLength = static_cast<XMLUInt16>(contextLength);
+        header->keyLength = static_cast<XMLUInt16>(keyLength);
+        header->type = type;
+        memcpy(p + sizeof(EntryHeader), context, contextLength);
+        if (keyLength)
+            memcpy(p + sizeof(EntryHeader) + contextLength + 1, key, keyLength);
+        if (valueLength)
+            memcpy(p + sizeof(EntryHeader) + contextLength + keyLength + 2, value, valueLength);
+        header->checksum = checksum(p, length);
+
+        size_t offset = end;
+        end += length;
+        return offset;
+    }
+
+    // Copies an existing entry to the end of a log and returns its new offset.
+    size_t copyEntry(MappedLog& log, size_t& end, const EntryHeader* header)
+    {
+        if (end + header->length > log.size()) {
+            size_t size = log.size();
+            while (end + header->length > size)
+                size *= 2;
+            log.resize(size);
+        }
+        memcpy(log.data() + end, header, header->length);
+        size_t offset = end;
+        end += header->length;
+        return offset;
+    }
+
+    unsigned int sizeLimit(const DOMElement* e, const XMLCh* name, int defValue, unsigned int maxValue)
+    {
+        int limit = XMLHelper::getAttrInt(e, defValue, name);
+        if (limit < 255)
+            return 255;
+        return min(static_cast<unsigned int>(limit), maxValue);
+    }
+};
+
+namespace xmltooling {
+    class XMLTOOL_DLLLOCAL MappedStorageService : public StorageService
+    {
+    public:
+        MappedStorageService(const DOMElement* e);
+        virtual ~MappedStorageService();
+
+        const Capabilities& getCapabilities() const {
+            return m_caps;
+        }
+
+        bool createString(const char* context, const char* key, const char* value, time_t expiration);
+        int readString(const char* context, const char* key, string* pvalue=nullptr, time_t* pexpiration=nullptr, int version=0);
+        int updateString(const char* context, const char* key, const char* value=nullptr, time_t expiration=0, int version=0);
+        bool deleteString(const char* context, const char* key);
+
+        bool createText(const char* context, const char* key, const char* value, time_t expiration) {
+            return createString(context, key, value, expiration);
+        }
+        int readText(const char* context, const char* key, string* pvalue=nullptr, time_t* pexpiration=nullptr, int version=0) {
+            return readString(context, key, pvalue, pexpiration, version);
+        }
+        int updateText(const char* context, const char* key, const char* value=nullptr, time_t expiration=0, int version=0) {
+            return updateString(context, key, value, expiration, version);
+        }
+        bool deleteText(const char* context, const char* key) {
+            return deleteString(context, key);
+        }
+
+        void reap(const char* context);
+        void updateContext(const char* context, time_t expiration);
+        void deleteContext(const char* context);
+
+        bool getUsage(Usage& usage, const char* context=nullptr) const;
+
+    private:
+        struct XMLTOOL_DLLLOCAL Record;
+
+        // Records of a context ordered by expiration.
+        typedef multimap<time_t,Record*> ExpirationIndex;
+
+        struct XMLTOOL_DLLLOCAL Record {
+            Record(const char* key, unsigned int h) : name(key), hash(h), offset(0), length(0), expiration(0), version(1) {}
+            string name;
+            unsigned int hash;
+            size_t offset;      // location of the record's latest entry in the log
+            size_t length;
+            time_t expiration;
+            int version;
+            ExpirationIndex::iterator expires;
+        };
+
+        struct XMLTOOL_DLLLOCAL Context {
+            Context(const char* context, unsigned int h) : name(context), hash(h), bytes(0) {}
+            string name;
+            unsigned int hash;
+            unsigned long bytes;
+            HashTable<Record> m_records;
+            ExpirationIndex m_index;
+        };
+
+        // The records held by a log, rebuilt by replaying its entries in order.
+        struct XMLTOOL_DLLLOCAL Index {
+            Index() : records(0), bytes(0) {}
+            HashTable<Context> m_contexts;
+            unsigned long records,bytes;
+
+            Record* find(const char* context, const char* key) const;
+            void apply(const char* log, size_t offset);
+            void erase(Context* ctx, Record* record);
+            void eraseContext(Context* ctx);
+            unsigned long reap(Context* ctx, time_t exp, unsigned long limit);
+        };
+
+        size_t append(unsigned char type, const char* context, const char* key, const char* value, time_t expiration, time_t stamp, int version);
+        void recover();
+        void compact();
+        static void* cleanup_fn(void*);
+
+        string m_path;
+        Capabilities m_caps;
+        bool m_synchronous;
+        size_t m_compactionThreshold;
+        scoped_ptr<MappedLog> m_file;
+        scoped_ptr<Index> m_index;
+        size_t m_end,m_synced;
+        scoped_ptr<RWLock> m_lock;
+        scoped_ptr<CondWait> shutdown_wait;
+        scoped_ptr<Thread> cleanup_thread;
+        bool shutdown;
+        int m_cleanupInterval;
+        Category& m_log;
+    };
+
+    StorageService* XMLTOOL_DLLLOCAL MappedStorageServiceFactory(const DOMElement* const & e, bool deprecationSupport)
+    {
+        return new MappedStorageService(e);
+    }
+};
+
+static const XMLCh cleanupInterval[] = UNICODE_LITERAL_15(c,l,e,a,n,u,p,I,n,t,e,r,v,a,l);
+static const XMLCh compactionThreshold[] = UNICODE_LITERAL_19(c,o,m,p,a,c,t,i,o,n,T,h,r,e,s,h,o,l,d);
+static const XMLCh contextSize[] =     UNICODE_LITERAL_11(c,o,n,t,e,x,t,S,i,z,e);
+static const XMLCh keySize[] =         UNICODE_LITERAL_7(k,e,y,S,i,z,e);
+static const XMLCh path[] =            UNICODE_LITERAL_4(p,a,t,h);
+static const XMLCh stringSize[] =      UNICODE_LITERAL_10(s,t,r,i,n,g,S,i,z,e);
+static const XMLCh synchronous[] =     UNICODE_LITERAL_11(s,y,n,c,h,r,o,n,o,u,s);
+
+MappedStorageService::MappedStorageService(const DOMElement* e)
+    : m_path(XMLHelper::getAttrString(e, nullptr, path)),
+        m_caps(sizeLimit(e, contextSize, 255, 0xffff), sizeLimit(e, keySize, 255, 0xffff), sizeLimit(e, stringSize, 0x4000, 0x7fffffff)),
+        m_synchronous(XMLHelper::getAttrBool(e, false, synchronous)),
+        m_compactionThreshold(sizeLimit(e, compactionThreshold, g_minimumCompaction, 0x7fffffff)), m_end(g_headerSize), m_synced(0),
+        m_lock(RWLock::create()), shutdown_wait(CondWait::create()), shutdown(false),
+        m_cleanupInterval(XMLHelper::getAttrInt(e, 900, cleanupInterval)),
+        m_log(Category::getInstance(XMLTOOLING_LOGCAT ".StorageService"))
+{
+    if (m_path.empty())
+        throw IOException("MappedStorageService requires path XML attribute.");
+    XMLToolingConfig::getConfig().getPathResolver()->resolve(m_path, PathResolver::XMLTOOLING_CACHE_FILE);
+
+    m_file.reset(new MappedLog(m_path.c_str(), g_initialSize));
+
+    // A compaction interrupted by a crash leaves its unfinished copy behind. This waits
+    // until the log is open, since the copy may belong to another user of the file.
+    std::remove((m_path + ".compact").c_str());
+#ifdef WIN32
+    std::remove((m_path + ".old").c_str());
+#endif
+
+    m_index.reset(new Index());
+    recover();
+
+    cleanup_thread.reset(Thread::create(&cleanup_fn, (void*)this));
+}
+
+MappedStorageService::~MappedStorageService()
+{
+    // Shut down the cleanup thread and let it know...
+    shutdown = true;
+    shutdown_wait->signal();
+    cleanup_thread->join(nullptr);
+
+    if (m_end > m_synced)
+        m_file->sync(m_synced, m_end - m_synced);
+}
+
+void MappedStorageService::recover()
+{
+    char* log = m_file->data();
+    if (memcmp(log, g_magic, sizeof(g_magic))) {
+        // A new file is all zeros, anything else isn't ours to overwrite.
+        for (size_t i = 0; i < g_headerSize; ++i) {
+            if (log[i])
+                throw IOException("Storage file ($1) is not in a recognized format.", params(1, m_path.c_str()));
+        }
+        memcpy(log, g_magic, sizeof(g_magic));
+    }
+
+    // Replay entries up to the first incomplete or damaged one, which marks the end of the log.
+    unsigned long count = 0;
+    m_end = g_headerSize;
+    while (validEntry(log, m_end, m_file->size())) {
+        m_index->apply(log, m_end);
+        m_end += entryAt(log, m_end)->length;
+        ++count;
+    }
+
+    // Clear whatever follows so that it can never be mistaken for entries after new writes.
+    size_t last = m_file->size();
+    while (last > m_end && !log[last - 1])
+        --last;
+    if (last > m_end) {
+        m_log.warn(
+            "discarding %lu damaged or incomplete byte(s) at the end of storage file (%s)",
+            static_cast<unsigned long>(last - m_end), m_path.c_str()
+            );
+        memset(log + m_end, 0, last - m_end);
+    }
+    m_file->sync(0, m_file->size());
+    m_synced = m_end;
+
+    m_log.info("recovered %lu record(s) from %lu log entries in storage file (%s)", m_index->records, count, m_path.c_str());
+}
+
+void* MappedStorageService::cleanup_fn(void* pv)
+{
+    MappedStorageService* cache = reinterpret_cast<MappedStorageService*>(pv);
+
+#ifndef WIN32
+    // First, let's block all signals
+    Thread::mask_all_signals();
+#endif
+
+#ifdef _DEBUG
+    NDC ndc("cleanup");
+#endif
+
+    scoped_ptr<Mutex> mutex(Mutex::create());
+    mutex->lock();
+
+    cache->m_log.info("cleanup thread started...running every %d seconds", cache->m_cleanupInterval);
+
+    while (!cache->shutdown) {
+        cache->shutdown_wait->timedwait(mutex.get(), cache->m_cleanupInterval);
+        if (cache->shutdown)
+            break;
+
+        try {
+            // Expired records only need to leave the index, compaction drops them from the log.
+            unsigned long count=0,reaped;
+            time_t now = time(nullptr);
+            do {
+                reaped = 0;
+                cache->m_lock->wrlock();
+                SharedLock locker(cache->m_lock, false);
+                for (size_t i = 0; reaped < g_batch && i < cache->m_index->m_contexts.capacity(); ++i) {
+                    Context* ctx = cache->m_index->m_contexts.at(i);
+                    if (ctx) {
+                        reaped += cache->m_index->reap(ctx, now, g_batch - reaped);
+                        if (ctx->m_records.size() == 0)
+                            cache->m_index->eraseContext(ctx);
+                    }
+                }
+                count += reaped;
+            } while (reaped == g_batch);
+
+            if (count)
+                cache->m_log.info("purged %d expired record(s) from storage", count);
+
+            // Only the cleanup thread writes m_synced, so the shared lock is enough to move it on.
+            if (!cache->m_synchronous) {
+                SharedLock locker(cache->m_lock);
+                if (cache->m_end > cache->m_synced) {
+                    cache->m_file->sync(cache->m_synced, cache->m_end - cache->m_synced);
+                    cache->m_synced = cache->m_end;
+                }
+            }
+
+            cache->compact();
+        }
+        catch (exception& ex) {
+            cache->m_log.error("error maintaining storage file (%s): %s", cache->m_path.c_str(), ex.what());
+        }
+    }
+
+    cache->m_log.info("cleanup thread finished");
+
+    mutex->unlock();
+    return nullptr;
+}
+
+void MappedStorageService::compact()
+{
+    size_t start;
+    {
+        // Wait until at least half the log is superseded or expired.
+        SharedLock locker(m_lock);
+        if (m_end < m_compactionThreshold || m_end - g_headerSize < 2 * m_index->bytes)
+            return;
+        start = m_end;
+    }
+
+    m_log.info("compacting storage file (%s)", m_path.c_str());
+    string temp = m_path + ".compact";
+    scoped_ptr<MappedLog> target(new MappedLog(temp.c_str(), g_initialSize));
+    scoped_ptr<Index> index(new Index());
+    memcpy(target->data(), g_magic, sizeof(g_magic));
+    size_t end = g_headerSize;
+
+    // Copy live records written before the start, in slices under the shared lock so that
+    // readers carry on. Each record is rewritten with its current expiration and version.
+    time_t now = time(nullptr);
+    size_t offset = g_headerSize;
+    while (offset < start) {
+        SharedLock locker(m_lock);
+        const char* log = m_file->data();
+        for (unsigned long n = 0; n < g_batch && offset < start; ++n) {
+            const EntryHeader* header = entryAt(log, offset);
+            if (header->type == PUT_RECORD) {
+                const Record* record = m_index->find(contextOf(header), keyOf(header));
+                if (record && record->offset == offset && record->expiration > now) {
+                    size_t copied = writeEntry(
+                        *target, end, PUT_RECORD, contextOf(header), keyOf(header), valueOf(header), header->valueLength,
+                        record->expiration, 0, record->version
+                        );
+                    index->apply(target->data(), copied);
+                }
+            }
+            offset += header->length;
+        }
+    }
+
+    // The copy is private to this thread, so it's synced before writers are locked out.
+    target->sync(0, end);
+    size_t copied = end;
+
+    // Anything written since then is replayed as is, which supersedes the copies above where needed.
+    m_lock->wrlock();
+    SharedLock locker(m_lock, false);
+    const char* log = m_file->data();
+    for (offset = start; offset < m_end; offset += entryAt(log, offset)->length) {
+        size_t replayed = copyEntry(*target, end, entryAt(log, offset));
+        index->apply(target->data(), replayed);
+    }
+    if (end > copied)
+        target->sync(copied, end - copied);
+
+#ifdef WIN32
+    // Windows won't replace an open file, so the current log is moved aside while still open,
+    // and is kept until the compacted copy has been reopened in its place.
+    target.reset();
+    string old = m_path + ".old";
+    bool replaced = false;
+    if (MoveFileExA(m_path.c_str(), old.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        if (MoveFileExA(temp.c_str(), m_path.c_str(), 0)) {
+            try {
+                target.reset(new MappedLog(m_path.c_str(), g_initialSize));
+                m_file.swap(target);
+                target.reset();
+                std::remove(old.c_str());
+                replaced = true;
+            }
+            catch (exception&) {
+                MoveFileExA(m_path.c_str(), temp.c_str(), MOVEFILE_REPLACE_EXISTING);
+            }
+        }
+        if (!replaced && !MoveFileExA(old.c_str(), m_path.c_str(), 0))
+            m_log.crit("unable to restore storage file (%s), current data is in (%s)", m_path.c_str(), old.c_str());
+    }
+#else
+    bool replaced = rename(temp.c_str(), m_path.c_str()) == 0;
+    if (replaced)
+        m_file.swap(target);
+    target.reset();
+#endif
+    if (!replaced) {
+        std::remove(temp.c_str());
+        m_log.error("unable to replace storage file (%s) with compacted copy", m_path.c_str());
+        return;
+    }
+
+    m_log.info(
+        "compacted storage file (%s) from %lu to %lu bytes",
+        m_path.c_str(), static_cast<unsigned long>(m_end), static_cast<unsigned long>(end)
+        );
+    m_index.swap(index);
+    m_end = m_synced = end;
+}
+
+MappedStorageService::Record* MappedStorageService::Index::find(const char* context, const char* key) const
+{
+    const Context* ctx = m_contexts.find(context, hashKey(context));
+    return ctx ? ctx->m_records.find(key, hashKey(key)) : nullptr;
+}
+
+void MappedStorageService::Index::apply(const char* log, size_t offset)
+{
+    const EntryHeader* header = entryAt(log, offset);
+    const char* context = contextOf(header);
+    unsigned int hc = hashKey(context);
+    Context* ctx = m_contexts.find(context, hc);
+
+    switch (header->type) {
+        case PUT_RECORD:
+        {
+            // The entry supersedes any earlier one for the key.
+            unsigned int hk = hashKey(keyOf(header));
+            Record* record = ctx ? ctx->m_records.find(keyOf(header), hk) : nullptr;
+            if (record)
+                erase(ctx, record);
+            if (!ctx) {
+                ctx = new Context(context, hc);
+                m_contexts.insert(ctx);
+            }
+            record = new Record(keyOf(header), hk);
+            record->offset = offset;
+            record->length = header->length;
+            record->expiration = static_cast<time_t>(header->expiration);
+            record->version = header->version;
+            record->expires = ctx->m_index.insert(make_pair(record->expiration, record));
+            ctx->m_records.insert(record);
+            ctx->bytes += record->length;
+            bytes += record->length;
+            ++records;
+            break;
+        }
+
+        case DELETE_RECORD:
+        {
+            Record* record = ctx ? ctx->m_records.find(keyOf(header), hashKey(keyOf(header))) : nullptr;
+            if (record)
+                erase(ctx, record);
+            break;
+        }
+
+        case UPDATE_CONTEXT:
+        {
+            // Only records still valid at the time of the update change.
+            if (!ctx)
+                break;
+            time_t expiration = static_cast<time_t>(header->expiration);
+            ExpirationIndex::iterator i = ctx->m_index.upper_bound(static_cast<time_t>(header->stamp));
+            while (i != ctx->m_index.end()) {
+                ExpirationIndex::iterator cur = i++;
+                if (cur->first != expiration) {
+                    Record* record = cur->second;
+                    ctx->m_index.erase(cur);
+                    record->expiration = expiration;
+                    record->expires = ctx->m_index.insert(make_pair(expiration, record));
+                }
+            }
+            break;
+        }
+
+        case DELETE_CONTEXT:
+            if (ctx)
+                eraseContext(ctx);
+            break;
+    }
+}
+
+void MappedStorageService::Index::erase(Context* ctx, Record* record)
+{
+    ctx->bytes -= record->length;
+    bytes -= record->length;
+    --records;
+    ctx->m_index.erase(record->expires);
+    ctx->m_records.remove(record);
+    delete record;
+}
+
+void MappedStorageService::Index::eraseContext(Context* ctx)
+{
+    bytes -= ctx->bytes;
+    records -= ctx->m_records.size();
+    m_contexts.remove(ctx);
+    delete ctx;
+}
+
+unsigned long MappedStorageService::Index::reap(Context* ctx, time_t exp, unsigned long limit)
+{
+    // Garbage collect expired entries, which sit at the front of the index.
+    unsigned long count=0;
+    while (count < limit && !ctx->m_index.empty() && ctx->m_index.begin()->first <= exp) {
+        erase(ctx, ctx->m_index.begin()->second);
+        ++count;
+    }
+    return count;
+}
+
+size_t MappedStorageService::append(
+    unsigned char type, const char* context, const char* key, const char* value, time_t expiration, time_t stamp, int version
+    )
+{
+    size_t valueLength = value ? strlen(value) : 0;
+    if (strlen(context) > m_caps.getContextSize() || (key && strlen(key) > m_caps.getKeySize()) || valueLength > m_caps.getStringSize())
+        throw IOException("Record exceeds the size limits of the storage service.");
+    size_t offset = writeEntry(*m_file, m_end, type, context, key, value, valueLength, expiration, stamp, version);
+    if (m_synchronous)
+        m_file->sync(offset, m_end - offset);
+    return offset;
+}
+
+bool MappedStorageService::createString(const char* context, const char* key, const char* value, time_t expiration)
+{
+    m_lock->wrlock();
+    SharedLock locker(m_lock, false);
+
+    // Check for a duplicate that hasn't yet expired, any other is replaced.
+    const Record* record = m_index->find(context, key);
+    if (record && time(nullptr) < record->expiration)
+        return false;
+
+    size_t offset = append(PUT_RECORD, context, key, value, expiration, 0, 1);
+    m_index->apply(m_file->data(), offset);
+
+    m_log.debug("inserted record (%s) in context (%s) with expiration (%lu)", key, context, expiration);
+    return true;
+}
+
+int MappedStorageService::readString(const char* context, const char* key, string* pvalue, time_t* pexpiration, int version)
+{
+    SharedLock locker(m_lock);
+
+    const Record* record = m_index->find(context, key);
+    if (!record)
+        return 0;
+    else if (time(nullptr) >= record->expiration)
+        return 0;
+    if (pexpiration)
+        *pexpiration = record->expiration;
+    if (record->version == version)
+        return version; // nothing's changed, so just echo back the version
+    if (pvalue) {
+        const EntryHeader* header = entryAt(m_file->data(), record->offset);
+        pvalue->assign(valueOf(header), header->valueLength);
+    }
+    return record->version;
+}
+
+int MappedStorageService::updateString(const char* context, const char* key, const char* value, time_t expiration, int version)
+{
+    m_lock->wrlock();
+    SharedLock locker(m_lock, false);
+
+    const Record* record = m_index->find(context, key);
+    if (!record)
+        return 0;
+    else if (time(nullptr) >= record->expiration)
+        return 0;
+
+    if (version > 0 && version != record->version)
+        return -1;  // caller's out of sync
+
+    if (!value && (!expiration || expiration == record->expiration))
+        return record->version;
+
+    // The log may move when it grows, so an unchanged value is copied out first.
+    string current;
+    if (!value) {
+        const EntryHeader* header = entryAt(m_file->data(), record->offset);
+        current.assign(valueOf(header), header->valueLength);
+    }
+    int newVersion = value ? record->version + 1 : record->version;
+    time_t newExpiration = expiration ? expiration : record->expiration;
+
+    size_t offset = append(PUT_RECORD, context, key, value ? value : current.c_str(), newExpiration, 0, newVersion);
+    m_index->apply(m_file->data(), offset);
+
+    m_log.debug("updated record (%s) in context (%s) with expiration (%lu)", key, context, newExpiration);
+    return newVersion;
+}
+
+bool MappedStorageService::deleteString(const char* context, const char* key)
+{
+    m_lock->wrlock();
+    SharedLock locker(m_lock, false);
+
+    // Find the record.
+    if (m_index->find(context, key)) {
+        size_t offset = append(DELETE_RECORD, context, key, nullptr, 0, 0, 0);
+        m_index->apply(m_file->data(), offset);
+        m_log.debug("deleted record (%s) in context (%s)", key, context);
+        return true;
+    }
+
+    m_log.debug("deleting record (%s) in context (%s)....not found", key, context);
+    return false;
+}
+
+void MappedStorageService::reap(const char* context)
+{
+    time_t now = time(nullptr);
+    unsigned long count;
+    do {
+        count = 0;
+        m_lock->wrlock();
+        SharedLock locker(m_lock, false);
+        Context* ctx = m_index->m_contexts.find(context, hashKey(context));
+        if (ctx)
+            count = m_index->reap(ctx, now, g_batch);
+    } while (count == g_batch);
+}
+
+void MappedStorageService::updateContext(const char* context, time_t expiration)
+{
+    m_lock->wrlock();
+    SharedLock locker(m_lock, false);
+
+    if (m_index->m_contexts.find(context, hashKey(context))) {
+        size_t offset = append(UPDATE_CONTEXT, context, nullptr, nullptr, expiration, time(nullptr), 0);
+        m_index->apply(m_file->data(), offset);
+    }
+
+    m_log.debug("updated expiration of valid records in context (%s) to (%lu)", context, expiration);
+}
+
+void MappedStorageService::deleteContext(const char* context)
+{
+    m_lock->wrlock();
+    SharedLock locker(m_lock, false);
+
+    if (m_index->m_contexts.find(context, hashKey(context))) {
+        size_t offset = append(DELETE_CONTEXT, context, nullptr, nullptr, 0, 0, 0);
+        m_index->apply(m_file->data(), offset);
+    }
+}
+
+bool MappedStorageService::getUsage(Usage& usage, const char* context) const
+{
+    SharedLock locker(m_lock);
+    if (context) {
+        const Context* ctx = m_index->m_contexts.find(context, hashKey(context));
+        usage.records = ctx ? ctx->m_records.size() : 0;
+        usage.bytes = ctx ? ctx->bytes : 0;
+    }
+    else {
+        usage.records = m_index->records;
+        usage.bytes = m_index->bytes;
+    }
+    return true;
+}
+
+#endif
@@ -30,12 +30,15 @@
 #include "util/StorageService.h"
 #include "util/Threads.h"
 #include "util/XMLHelper.h"
+#include "impl/HashTable.h"
 
 #include <memory>
+#include <boost/ptr_container/ptr_vector.hpp>
 #include <xercesc/util/XMLUniDefs.hpp>
 
 using namespace xmltooling::logging;
 using namespace xmltooling;
+using boost::ptr_vector;
 using boost::scoped_ptr;
 using namespace std;
 
@@ -44,6 +47,12 @@ using xercesc::DOMElement;
 namespace {
     // Reasonably extended sizes to avoid callers needing to shrink unduly.
     static const XMLTOOL_DLLLOCAL StorageService::Capabilities g_memCaps(0x4000, 0x4000, 0x4000);
+
+    // Maximum number of records purged before a shard's lock is released again.
+    static const unsigned long g_reapBatch = 1000;
+
+    // Number of records compared when choosing one to evict.
+    static const unsigned int g_evictionSamples = 5;
 };
 
 namespace xmltooling {
@@ -77,47 +86,79 @@ namespace xmltooling {
 
         void reap(const char* context);
         void updateContext(const char* context, time_t expiration);
-        void deleteContext(const char* context) {
-            m_lock->wrlock();
-            m_contextMap.erase(context);
-            m_lock->unlock();
-        }
+        void deleteContext(const char* context);
+
+        bool getUsage(Usage& usage, const char* context=nullptr) const;
 
     private:
+        struct XMLTOOL_DLLLOCAL Record;
+        struct XMLTOOL_DLLLOCAL Shard;
+
+        // Records of a context ordered by expiration.
+        typedef multimap<time_t,Record*> ExpirationIndex;
+
         struct XMLTOOL_DLLLOCAL Record {
-            Record() : expiration(0), version(1) {}
-            Record(const string& s, time_t t) : data(s), expiration(t), version(1) {}
+            Record(const char* key, unsigned int h) : name(key), hash(h), expiration(0), version(1), stamp(0) {}
+            string name;
+            unsigned int hash;
             string data;
             time_t expiration;
             int version;
+            ExpirationIndex::iterator expires;
+            unsigned long stamp;    // shard clock value at the last write, for eviction
+
+            unsigned long footprint() const {
+                return sizeof(Record) + name.length() + data.length();
+            }
         };
 
         struct XMLTOOL_DLLLOCAL Context {
-            Context() {}
-            Context(const Context& src) {
-                m_dataMap = src.m_dataMap;
+            Context(const char* context, unsigned int h, Shard* s) : name(context), hash(h), shard(s), bytes(0) {}
+            string name;
+            unsigned int hash;
+            Shard* shard;
+            unsigned long bytes;
+            HashTable<Record> m_records;
+            ExpirationIndex m_index;
+
+            Record* insert(const char* key, unsigned int h, const char* value, time_t expiration);
+            void erase(Record* record);
+            void setData(Record* record, const char* value);
+            void setExpiration(Record* record, time_t expiration);
+            void touch(Record* record);
+            Record* victim(const Record* keep, time_t now, unsigned int samples) const;
+            unsigned long reap(time_t exp, unsigned long limit);
+            void updateExpiration(time_t now, time_t expiration);
+        };
+
+        // Each shard owns a slice of the key space for every context, under its own lock.
+        struct XMLTOOL_DLLLOCAL Shard {
+            Shard(unsigned int seed) : records(0), bytes(0), clock(0), m_seed(seed | 1), m_lock(RWLock::create()) {}
+            unsigned long records,bytes,clock;
+            unsigned int m_seed;
+            HashTable<Context> m_contexts;
+            scoped_ptr<RWLock> m_lock;
+
+            // xorshift, only called with the write lock held
+            unsigned int random() {
+                m_seed ^= m_seed << 13;
+                m_seed ^= m_seed >> 17;
+                m_seed ^= m_seed << 5;
+                return m_seed;
             }
-            map<string,Record> m_dataMap;
-            unsigned long reap(time_t exp);
         };
 
-        Context& readContext(const char* context) {
-            m_lock->rdlock();
-            map<string,Context>::iterator i = m_contextMap.find(context);
-            if (i != m_contextMap.end())
-                return i->second;
-            m_lock->unlock();
-            m_lock->wrlock();
-            return m_contextMap[context];
+        // With context limits in force, a context is kept whole in one shard so it can be checked against them.
+        Shard& getShard(unsigned int contextHash, unsigned int keyHash) {
+            return m_shards[(m_shardByContext ? contextHash : (contextHash ^ keyHash)) % m_shards.size()];
         }
 
-        Context& writeContext(const char* context) {
-            m_lock->wrlock();
-            return m_contextMap[context];
-        }
+        unsigned long reapShard(Shard& shard, const char* context, unsigned int contextHash, time_t now);
+        void evict(Shard& shard, Context& ctx, const Record* keep);
 
-        map<string,Context> m_contextMap;
-        scoped_ptr<RWLock> m_lock;
+        ptr_vector<Shard> m_shards;
+        unsigned long m_maxRecords,m_maxBytes,m_maxContextRecords,m_maxContextBytes;
+        bool m_shardByContext;
         scoped_ptr<CondWait> shutdown_wait;
         scoped_ptr<Thread> cleanup_thread;
         static void* cleanup_fn(void*);
@@ -133,12 +174,54 @@ namespace xmltooling {
 };
 
 static const XMLCh cleanupInterval[] = UNICODE_LITERAL_15(c,l,e,a,n,u,p,I,n,t,e,r,v,a,l);
+static const XMLCh maxBytes[] =        UNICODE_LITERAL_8(m,a,x,B,y,t,e,s);
+static const XMLCh maxContextBytes[] = UNICODE_LITERAL_15(m,a,x,C,o,n,t,e,x,t,B,y,t,e,s);
+static const XMLCh maxContextRecords[] = UNICODE_LITERAL_17(m,a,x,C,o,n,t,e,x,t,R,e,c,o,r,d,s);
+static const XMLCh maxRecords[] =      UNICODE_LITERAL_10(m,a,x,R,e,c,o,r,d,s);
+static const XMLCh shards[] =          UNICODE_LITERAL_6(s,h,a,r,d,s);
+
+namespace {
+    int getLimit(const DOMElement* e, const XMLCh* name, int& smallest)
+    {
+        int limit = XMLHelper::getAttrInt(e, 0, name);
+        if (limit <= 0)
+            return 0;
+        if (smallest == 0 || limit < smallest)
+            smallest = limit;
+        return limit;
+    }
+};
 
 MemoryStorageService::MemoryStorageService(const DOMElement* e)
-    : m_lock(RWLock::create()), shutdown_wait(CondWait::create()), shutdown(false),
+    : shutdown_wait(CondWait::create()), shutdown(false),
         m_cleanupInterval(XMLHelper::getAttrInt(e, 900, cleanupInterval)),
         m_log(Category::getInstance(XMLTOOLING_LOGCAT ".StorageService"))
 {
+    int smallest = 0, unused = 0;
+    int records = getLimit(e, maxRecords, smallest);
+    int bytes = getLimit(e, maxBytes, smallest);
+    int contextRecords = getLimit(e, maxContextRecords, unused);
+    int contextBytes = getLimit(e, maxContextBytes, unused);
+
+    int count = XMLHelper::getAttrInt(e, 16, shards);
+    if (count < 1)
+        count = 1;
+    if (smallest > 0 && smallest < count) {
+        // Each shard needs a share of at least one, or the configured limits would be exceeded.
+        m_log.warn("using %d shard(s) instead of %d so that a limit of %d can be enforced", smallest, count, smallest);
+        count = smallest;
+    }
+    for (int i = 0; i < count; ++i)
+        m_shards.push_back(new Shard(2166136261U + i));
+
+    // Storage limits are enforced per shard, so each gets an even share of the configured value,
+    // rounded down so the total never exceeds it. Context limits apply in full, because a context
+    // is then confined to a single shard.
+    m_maxRecords = records / count;
+    m_maxBytes = bytes / count;
+    m_maxContextRecords = contextRecords;
+    m_maxContextBytes = contextBytes;
+    m_shardByContext = (contextRecords > 0 || contextBytes > 0);
     cleanup_thread.reset(Thread::create(&cleanup_fn, (void*)this));
 }
 
@@ -175,10 +258,8 @@ void* MemoryStorageService::cleanup_fn(void* pv)
 
         unsigned long count=0;
         time_t now = time(nullptr);
-        cache->m_lock->wrlock();
-        SharedLock locker(cache->m_lock.get(), false);
-        for (map<string,Context>::iterator i=cache->m_contextMap.begin(); i!=cache->m_contextMap.end(); ++i)
-            count += i->second.reap(now);
+        for (ptr_vector<Shard>::iterator s=cache->m_shards.begin(); !cache->shutdown && s!=cache->m_shards.end(); ++s)
+            count += cache->reapShard(*s, nullptr, 0, now);
 
         if (count)
             cache->m_log.info("purged %d expired record(s) from storage", count);
@@ -190,48 +271,201 @@ void* MemoryStorageService::cleanup_fn(void* pv)
     return nullptr;
 }
 
+unsigned long MemoryStorageService::reapShard(Shard& shard, const char* context, unsigned int contextHash, time_t now)
+{
+    // Purge in slices, dropping the lock in between so other threads aren't stalled.
+    unsigned long total=0,count;
+    do {
+        count = 0;
+        shard.m_lock->wrlock();
+        SharedLock locker(shard.m_lock.get(), false);
+        if (context) {
+            Context* ctx = shard.m_contexts.find(context, contextHash);
+            if (ctx)
+                count = ctx->reap(now, g_reapBatch);
+        }
+        else {
+            for (size_t i = 0; count < g_reapBatch && i < shard.m_contexts.capacity(); ++i) {
+                Context* ctx = shard.m_contexts.at(i);
+                if (ctx) {
+                    count += ctx->reap(now, g_reapBatch - count);
+                    if (ctx->m_records.size() == 0) {
+                        shard.m_contexts.remove(ctx);
+                        delete ctx;
+                    }
+                }
+            }
+        }
+        total += count;
+    } while (count == g_reapBatch);
+    return total;
+}
+
 void MemoryStorageService::reap(const char* context)
 {
-    Context& ctx = writeContext(context);
-    SharedLock locker(m_lock.get(), false);
-    ctx.reap(time(nullptr));
+    unsigned int hc = hashKey(context);
+    time_t now = time(nullptr);
+    for (ptr_vector<Shard>::iterator s=m_shards.begin(); s!=m_shards.end(); ++s)
+        reapShard(*s, context, hc, now);
 }
 
-unsigned long MemoryStorageService::Context::reap(time_t exp)
+void MemoryStorageService::deleteContext(const char* context)
 {
-    // Garbage collect any expired entries.
-    unsigned long count=0;
-    map<string,Record>::iterator cur = m_dataMap.begin();
-    map<string,Record>::iterator stop = m_dataMap.end();
-    while (cur != stop) {
-        if (cur->second.expiration <= exp) {
-            map<string,Record>::iterator tmp = cur++;
-            m_dataMap.erase(tmp);
-            ++count;
-        }
-        else {
-            cur++;
+    unsigned int hc = hashKey(context);
+    for (ptr_vector<Shard>::iterator s=m_shards.begin(); s!=m_shards.end(); ++s) {
+        s->m_lock->wrlock();
+        SharedLock locker(s->m_lock.get(), false);
+        Context* ctx = s->m_contexts.find(context, hc);
+        if (ctx) {
+            s->records -= ctx->m_records.size();
+            s->bytes -= ctx->bytes;
+            s->m_contexts.remove(ctx);
+            delete ctx;
         }
     }
+}
+
+MemoryStorageService::Record* MemoryStorageService::Context::insert(
+    const char* key, unsigned int h, const char* value, time_t expiration
+    )
+{
+    Record* record = new Record(key, h);
+    record->data = value;
+    record->expiration = expiration;
+    record->expires = m_index.insert(make_pair(expiration, record));
+    m_records.insert(record);
+    touch(record);
+    bytes += record->footprint();
+    shard->bytes += record->footprint();
+    ++(shard->records);
+    return record;
+}
+
+void MemoryStorageService::Context::erase(Record* record)
+{
+    bytes -= record->footprint();
+    shard->bytes -= record->footprint();
+    --(shard->records);
+    m_index.erase(record->expires);
+    m_records.remove(record);
+    delete record;
+}
+
+void MemoryStorageService::Context::setData(Record* record, const char* value)
+{
+    bytes -= record->footprint();
+    shard->bytes -= record->footprint();
+    record->data = value;
+    bytes += record->footprint();
+    shard->bytes += record->footprint();
+}
+
+void MemoryStorageService::Context::touch(Record* record)
+{
+    record->stamp = ++(shard->clock);
+}
+
+MemoryStorageService::Record* MemoryStorageService::Context::victim(const Record* keep, time_t now, unsigned int samples) const
+{
+    // Anything already expired goes first, otherwise the least recently written of a few samples.
+    if (!m_index.empty() && m_index.begin()->first <= now && m_index.begin()->second != keep)
+        return m_index.begin()->second;
+    Record* oldest = nullptr;
+    for (unsigned int i = 0; i < samples; ++i) {
+        Record* candidate = m_records.sample(shard->random());
+        if (candidate && candidate != keep && (!oldest || candidate->stamp < oldest->stamp))
+            oldest = candidate;
+    }
+    return oldest;
+}
+
+void MemoryStorageService::Context::setExpiration(Record* record, time_t expiration)
+{
+    if (expiration != record->expiration) {
+        m_index.erase(record->expires);
+        record->expiration = expiration;
+        record->expires = m_index.insert(make_pair(expiration, record));
+    }
+}
+
+unsigned long MemoryStorageService::Context::reap(time_t exp, unsigned long limit)
+{
+    // Garbage collect expired entries, which sit at the front of the index.
+    unsigned long count=0;
+    while (count < limit && !m_index.empty() && m_index.begin()->first <= exp) {
+        erase(m_index.begin()->second);
+        ++count;
+    }
     return count;
 }
 
+void MemoryStorageService::Context::updateExpiration(time_t now, time_t expiration)
+{
+    // Only unexpired records change, and those follow "now" in the index.
+    ExpirationIndex::iterator i = m_index.upper_bound(now);
+    while (i != m_index.end()) {
+        ExpirationIndex::iterator cur = i++;
+        if (cur->first != expiration)
+            setExpiration(cur->second, expiration);
+    }
+}
+
+void MemoryStorageService::evict(Shard& shard, Context& ctx, const Record* keep)
+{
+    // Each pass removes one record, so the writer holding the lock only runs a little longer.
+    time_t now = time(nullptr);
+    while ((m_maxContextRecords && ctx.m_records.size() > m_maxContextRecords) ||
+            (m_maxContextBytes && ctx.bytes > m_maxContextBytes)) {
+        Record* record = ctx.victim(keep, now, g_evictionSamples);
+        if (!record)
+            return;
+        m_log.debug("evicting record (%s) in context (%s) to honor context limits", record->name.c_str(), ctx.name.c_str());
+        ctx.erase(record);
+    }
+
+    while ((m_maxRecords && shard.records > m_maxRecords) || (m_maxBytes && shard.bytes > m_maxBytes)) {
+        Record* record = nullptr;
+        Context* owner = nullptr;
+        for (unsigned int i = 0; i < g_evictionSamples; ++i) {
+            Context* candidateContext = shard.m_contexts.sample(shard.random());
+            Record* candidate = candidateContext ? candidateContext->victim(keep, now, 1) : nullptr;
+            if (candidate && (!record || candidate->stamp < record->stamp)) {
+                record = candidate;
+                owner = candidateContext;
+            }
+        }
+        if (!record)
+            return;
+        m_log.debug("evicting record (%s) in context (%s) to honor storage limits", record->name.c_str(), owner->name.c_str());
+        owner->erase(record);
+    }
+}
+
 bool MemoryStorageService::createString(const char* context, const char* key, const char* value, time_t expiration)
 {
-    Context& ctx = writeContext(context);
-    SharedLock locker(m_lock.get(), false);
+    unsigned int hc = hashKey(context), hk = hashKey(key);
+    Shard& shard = getShard(hc, hk);
+    shard.m_lock->wrlock();
+    SharedLock locker(shard.m_lock.get(), false);
+
+    Context* ctx = shard.m_contexts.find(context, hc);
+    if (!ctx) {
+        ctx = new Context(context, hc, &shard);
+        shard.m_contexts.insert(ctx);
+    }
 
     // Check for a duplicate.
-    map<string,Record>::iterator i=ctx.m_dataMap.find(key);
-    if (i!=ctx.m_dataMap.end()) {
+    Record* dup = ctx->m_records.find(key, hk);
+    if (dup) {
         // Not yet expired?
-        if (time(nullptr) < i->second.expiration)
+        if (time(nullptr) < dup->expiration)
             return false;
         // It's dead, so we can just remove it now and create the new record.
-        ctx.m_dataMap.erase(i);
+        ctx->erase(dup);
     }
 
-    ctx.m_dataMap[key]=Record(value,expiration);
+    Record* record = ctx->insert(key, hk, value, expiration);
+    evict(shard, *ctx, record);
 
     m_log.debug("inserted record (%s) in context (%s) with expiration (%lu)", key, context, expiration);
     return true;
@@ -239,58 +473,78 @@ bool MemoryStorageService::createString(const char* context, const char* key, co
 
 int MemoryStorageService::readString(const char* context, const char* key, string* pvalue, time_t* pexpiration, int version)
 {
-    Context& ctx = readContext(context);
-    SharedLock locker(m_lock.get(), false);
+    unsigned int hc = hashKey(context), hk = hashKey(key);
+    Shard& shard = getShard(hc, hk);
+    shard.m_lock->rdlock();
+    SharedLock locker(shard.m_lock.get(), false);
+
+    // A missing context just means a missing record, so there's nothing to create.
+    const Context* ctx = shard.m_contexts.find(context, hc);
+    if (!ctx)
+        return 0;
 
-    map<string,Record>::iterator i=ctx.m_dataMap.find(key);
-    if (i==ctx.m_dataMap.end())
+    const Record* record = ctx->m_records.find(key, hk);
+    if (!record)
         return 0;
-    else if (time(nullptr) >= i->second.expiration)
+    else if (time(nullptr) >= record->expiration)
         return 0;
     if (pexpiration)
-        *pexpiration = i->second.expiration;
-    if (i->second.version == version)
+        *pexpiration = record->expiration;
+    if (record->version == version)
         return version; // nothing's changed, so just echo back the version
     if (pvalue)
-        *pvalue = i->second.data;
-    return i->second.version;
+        *pvalue = record->data;
+    return record->version;
 }
 
 int MemoryStorageService::updateString(const char* context, const char* key, const char* value, time_t expiration, int version)
 {
-    Context& ctx = writeContext(context);
-    SharedLock locker(m_lock.get(), false);
+    unsigned int hc = hashKey(context), hk = hashKey(key);
+    Shard& shard = getShard(hc, hk);
+    shard.m_lock->wrlock();
+    SharedLock locker(shard.m_lock.get(), false);
 
-    map<string,Record>::iterator i=ctx.m_dataMap.find(key);
-    if (i==ctx.m_dataMap.end())
+    Context* ctx = shard.m_contexts.find(context, hc);
+    if (!ctx)
         return 0;
-    else if (time(nullptr) >= i->second.expiration)
+
+    Record* record = ctx->m_records.find(key, hk);
+    if (!record)
+        return 0;
+    else if (time(nullptr) >= record->expiration)
         return 0;
 
-    if (version > 0 && version != i->second.version)
+    if (version > 0 && version != record->version)
         return -1;  // caller's out of sync
 
     if (value) {
-        i->second.data = value;
-        ++(i->second.version);
+        ctx->setData(record, value);
+        ++(record->version);
     }
 
-    if (expiration && expiration != i->second.expiration)
-        i->second.expiration = expiration;
+    if (expiration)
+        ctx->setExpiration(record, expiration);
+
+    ctx->touch(record);
+    if (value)
+        evict(shard, *ctx, record);
 
-    m_log.debug("updated record (%s) in context (%s) with expiration (%lu)", key, context, i->second.expiration);
-    return i->second.version;
+    m_log.debug("updated record (%s) in context (%s) with expiration (%lu)", key, context, record->expiration);
+    return record->version;
 }
 
 bool MemoryStorageService::deleteString(const char* context, const char* key)
 {
-    Context& ctx = writeContext(context);
-    SharedLock locker(m_lock.get(), false);
+    unsigned int hc = hashKey(context), hk = hashKey(key);
+    Shard& shard = getShard(hc, hk);
+    shard.m_lock->wrlock();
+    SharedLock locker(shard.m_lock.get(), false);
 
     // Find the record.
-    map<string,Record>::iterator i=ctx.m_dataMap.find(key);
-    if (i!=ctx.m_dataMap.end()) {
-        ctx.m_dataMap.erase(i);
+    Context* ctx = shard.m_contexts.find(context, hc);
+    Record* record = ctx ? ctx->m_records.find(key, hk) : nullptr;
+    if (record) {
+        ctx->erase(record);
         m_log.debug("deleted record (%s) in context (%s)", key, context);
         return true;
     }
@@ -301,15 +555,36 @@ bool MemoryStorageService::deleteString(const char* context, const char* key)
 
 void MemoryStorageService::updateContext(const char* context, time_t expiration)
 {
-    Context& ctx = writeContext(context);
-    SharedLock locker(m_lock.get(), false);
-
+    unsigned int hc = hashKey(context);
     time_t now = time(nullptr);
-    map<string,Record>::iterator stop=ctx.m_dataMap.end();
-    for (map<string,Record>::iterator i = ctx.m_dataMap.begin(); i!=stop; ++i) {
-        if (now < i->second.expiration)
-            i->second.expiration = expiration;
+    for (ptr_vector<Shard>::iterator s=m_shards.begin(); s!=m_shards.end(); ++s) {
+        s->m_lock->wrlock();
+        SharedLock locker(s->m_lock.get(), false);
+        Context* ctx = s->m_contexts.find(context, hc);
+        if (ctx)
+            ctx->updateExpiration(now, expiration);
     }
 
     m_log.debug("updated expiration of valid records in context (%s) to (%lu)", context, expiration);
 }
+
+bool MemoryStorageService::getUsage(Usage& usage, const char* context) const
+{
+    usage.records = usage.bytes = 0;
+    unsigned int hc = context ? hashKey(context) : 0;
+    for (ptr_vector<Shard>::const_iterator s=m_shards.begin(); s!=m_shards.end(); ++s) {
+        SharedLock locker(s->m_lock);
+        if (context) {
+            const Context* ctx = s->m_contexts.find(context, hc);
+            if (ctx) {
+                usage.records += ctx->m_records.size();
+                usage.bytes += ctx->bytes;
+            }
+        }
+        else {
+            usage.records += s->records;
+            usage.bytes += s->bytes;
+        }
+    }
+    return true;
+}
@@ -31,8 +31,6 @@
 #include "util/NDC.h"
 #include "util/XMLHelper.h"
 
-#include <xercesc/framework/MemBufInputSource.hpp>
-#include <xercesc/framework/Wrapper4InputSource.hpp>
 #include <xercesc/util/XMLUniDefs.hpp>
 
 using namespace xmltooling::logging;
@@ -154,10 +152,8 @@ DOMElement* UnknownElementImpl::marshall(
     // If we get here, we didn't have a usable DOM.
     // We need to reparse the XML we saved off into a new DOM.
     bool bindDocument=false;
-    MemBufInputSource src(reinterpret_cast<const XMLByte*>(m_xml.c_str()),m_xml.length(),"UnknownElementImpl");
-    Wrapper4InputSource dsrc(&src,false);
     log.debug("parsing XML back into DOM tree");
-    DOMDocument* internalDoc=XMLToolingConfig::getConfig().getParser().parse(dsrc);
+    DOMDocument* internalDoc=XMLToolingConfig::getConfig().getParser().parse(m_xml.c_str(),m_xml.length(),"UnknownElementImpl");
     if (document) {
         // The caller insists on using his own document, so we now have to import the thing
         // into it. Then we're just dumping the one we built.
@@ -237,10 +233,8 @@ DOMElement* UnknownElementImpl::marshall(
     
     // If we get here, we didn't have a usable DOM (and/or we flushed the one we had).
     // We need to reparse the XML we saved off into a new DOM.
-    MemBufInputSource src(reinterpret_cast<const XMLByte*>(m_xml.c_str()),m_xml.length(),"UnknownElementImpl");
-    Wrapper4InputSource dsrc(&src,false);
     log.debug("parsing XML back into DOM tree");
-    DOMDocument* internalDoc=XMLToolingConfig::getConfig().getParser().parse(dsrc);
+    DOMDocument* internalDoc=XMLToolingConfig::getConfig().getParser().parse(m_xml.c_str(),m_xml.length(),"UnknownElementImpl");
     
     log.debug("reimporting new DOM into caller-supplied document");
     try {
@@ -58,6 +58,11 @@
 
 #define XMLTOOLING_ENTITY_EXPANSION_LIMIT 100
 
+#define XMLTOOLING_RESOURCE_CACHE_LIMIT (4 * 1024 * 1024)
+#define XMLTOOLING_RESOURCE_CACHE_BLOCKED 1024
+
+#define XMLTOOLING_INFLATE_RATIO 240
+
 // Macros for path and directory separators.
 #if defined __CYGWIN32__ && !defined __CYGWIN__
    /* For backwards compatibility with Cygwin b19 and
@@ -145,6 +150,86 @@ namespace xmltooling {
 #ifndef XMLTOOLING_NO_XMLSEC
     void log_openssl();
 #endif
+
+    // Pool of namespace sets shared between XMLObjects, created by library initialization.
+    void initNamespaceSets();
+
+    // Thread keys and locks used for XMLObject allocation and unmarshalling, set up by library initialization.
+    void initXMLObjectThreading();
+    void termXMLObjectThreading();
+
+    // Per-thread namespace scopes used by the marshaller.
+    void initNamespaceScopes();
+    void termNamespaceScopes();
+
+    // Per-thread serializers used by XMLHelper::serialize().
+    void initSerializers();
+    void termSerializers();
+
+    // Per-thread codecs handed out by ZlibCodec::getCodec().
+    void initZlibCodecs();
+    void termZlibCodecs();
+
+    // Process-wide, append-only pool of the strings held by QName and Namespace objects.
+    // Strings that are too long, or arrive once the pool is full, get private copies instead,
+    // so that names taken from untrusted input can't grow the pool without bound.
+    // Strings acquired before the library is initialized are always private copies.
+    class XMLTOOL_DLLLOCAL StringPool
+    {
+    public:
+        // Creates the pool; called once from library initialization.
+        static void init();
+
+        // Returns the pooled copy of a string, or a private copy if the pool declines it.
+        // Null and empty strings map to a shared empty string.
+        static const XMLCh* acquire(const XMLCh* s, bool& owned);
+
+        // Frees a string returned by acquire() if it was a private copy.
+        static void release(const XMLCh* s, bool owned);
+
+        // Compares two strings returned by acquire(); pooled strings compare by address.
+        static bool equals(const XMLCh* s1, bool owned1, const XMLCh* s2, bool owned2) {
+            return (s1 == s2) || ((owned1 || owned2) && xercesc::XMLString::equals(s1, s2));
+        }
+    };
+
+    // Scopes the namespace declarations made by AbstractXMLObjectMarshaller::marshallNamespaces()
+    // for an element to the marshalling of its content, so that they can be found without
+    // searching the DOM.
+    class XMLTOOL_DLLLOCAL NamespaceScopeGuard
+    {
+        MAKE_NONCOPYABLE(NamespaceScopeGuard);
+    public:
+        NamespaceScopeGuard(const xercesc::DOMElement* element);
+        ~NamespaceScopeGuard();
+    };
+
+    class XMLTOOL_API XMLObject;
+
+    // Hash index of the IDs in an XMLObject subtree, used by XMLHelper::getXMLObjectById().
+    // Entries point at the ID strings owned by the objects, so the index must be discarded
+    // whenever anything in the subtree changes.
+    class XMLTOOL_DLLLOCAL IDIndex
+    {
+        MAKE_NONCOPYABLE(IDIndex);
+    public:
+        IDIndex(const XMLObject& tree);
+
+        // Returns the first object in document order with the given ID, or nullptr.
+        const XMLObject* find(const XMLCh* id) const;
+
+    private:
+        void collect(const XMLObject& obj);
+
+        struct Entry {
+            unsigned int hash;
+            int next;
+            const XMLCh* id;
+            const XMLObject* obj;
+        };
+        std::vector<Entry> m_entries;
+        std::vector<int> m_buckets;
+    };
     
     /// @endcond
 
@@ -32,11 +32,14 @@
     #include "signature/Signature.h"
 #endif
 #include "util/NDC.h"
+#include "util/Threads.h"
 #include "util/XMLConstants.h"
 #include "util/XMLHelper.h"
 
 #include <algorithm>
 #include <functional>
+#include <set>
+#include <vector>
 #include <xercesc/util/XMLUniDefs.hpp>
 
 #ifndef XMLTOOLING_NO_XMLSEC
@@ -195,6 +198,22 @@ void AbstractXMLObjectMarshaller::marshallInto(
     ,const Credential* credential
 #endif
     ) const
+{
+    // Declarations made here are in scope until the content is marshalled.
+    NamespaceScopeGuard guard(targetElement);
+    marshallStartElement(targetElement);
+    
+#ifndef XMLTOOLING_NO_XMLSEC
+    marshallContent(targetElement,credential);
+    if (sigs) {
+        for_each(sigs->begin(),sigs->end(),bind2nd(mem_fun1_t<void,Signature,const Credential*>(&Signature::sign),credential));
+    }
+#else
+    marshallContent(targetElement);
+#endif
+}
+
+void AbstractXMLObjectMarshaller::marshallStartElement(DOMElement* targetElement) const
 {
     if (getElementQName().hasPrefix())
         targetElement->setPrefix(getElementQName().getPrefix());
@@ -243,15 +262,6 @@ void AbstractXMLObjectMarshaller::marshallInto(
     marshallElementType(targetElement);
     marshallNamespaces(targetElement);
     marshallAttributes(targetElement);
-    
-#ifndef XMLTOOLING_NO_XMLSEC
-    marshallContent(targetElement,credential);
-    if (sigs) {
-        for_each(sigs->begin(),sigs->end(),bind2nd(mem_fun1_t<void,Signature,const Credential*>(&Signature::sign),credential));
-    }
-#else
-    marshallContent(targetElement);
-#endif
 }
 
 void AbstractXMLObjectMarshaller::marshallElementType(DOMElement* domElement) const
@@ -288,39 +298,8 @@ void AbstractXMLObjectMarshaller::marshallElementType(DOMElement* domElement) co
     }
 }
 
-class _addns : public binary_function<DOMElement*,Namespace,void> {
-public:
-    void operator()(DOMElement* domElement, const Namespace& ns) const {
-        const XMLCh* prefix=ns.getNamespacePrefix();
-        const XMLCh* uri=ns.getNamespaceURI();
-        
-        // Check for xmlns:xml.
-        if (XMLString::equals(prefix, XML_PREFIX) && XMLString::equals(uri, XML_NS))
-            return;
-
-        // Check to see if the prefix is already declared properly above this node.
-        if (!ns.alwaysDeclare()) {
-            const XMLCh* declared=lookupNamespaceURI(domElement->getParentNode(),prefix);
-            if (declared && XMLString::equals(declared,uri))
-                return;
-        }
-            
-        if (prefix && *prefix) {
-            XMLCh* xmlns=new XMLCh[XMLString::stringLen(XMLNS_PREFIX) + XMLString::stringLen(prefix) + 2*sizeof(XMLCh)];
-            *xmlns=chNull;
-            XMLString::catString(xmlns,XMLNS_PREFIX);
-            static const XMLCh colon[] = {chColon, chNull};
-            XMLString::catString(xmlns,colon);
-            XMLString::catString(xmlns,prefix);
-            domElement->setAttributeNS(XMLNS_NS, xmlns, uri);
-            delete[] xmlns;
-        }
-        else {
-            domElement->setAttributeNS(XMLNS_NS, XMLNS_PREFIX, uri);
-        }
-    }
-
-    const XMLCh* lookupNamespaceURI(const DOMNode* n, const XMLCh* prefix) const {
+namespace {
+    const XMLCh* lookupNamespaceURI(const DOMNode* n, const XMLCh* prefix) {
         // Return nullptr if no declaration in effect. The empty string signifies the null namespace.
         if (!n || n->getNodeType()!=DOMNode::ELEMENT_NODE) {
             // At the root, the default namespace is set to the null namespace.
@@ -349,13 +328,166 @@ public:
         // Defer to parent.
         return lookupNamespaceURI(n->getParentNode(),prefix);
     }
+
+    // Tracks the namespace declarations made by the marshaller on the current thread, so that
+    // checking for a declaration in scope doesn't require searching every ancestor's attributes.
+    // A frame is pushed for each element being marshalled, and frames for elements marshalled
+    // into the element of the frame below them form a chain of ancestors. Declarations above
+    // the first element in a chain are looked up in the DOM. Every thread's scope is tracked
+    // so that library shutdown can free them all.
+    class NamespaceScope {
+    public:
+        // Created by library initialization.
+        static ThreadKey* s_key;
+        static Mutex* s_lock;
+        static set<NamespaceScope*>* s_scopes;
+
+        static void destroy(void* scope) {
+            if (scope) {
+                Lock lock(s_lock);
+                s_scopes->erase(reinterpret_cast<NamespaceScope*>(scope));
+            }
+            delete reinterpret_cast<NamespaceScope*>(scope);
+        }
+
+        static NamespaceScope& getScope() {
+            NamespaceScope* scope = reinterpret_cast<NamespaceScope*>(s_key->getData());
+            if (!scope) {
+                scope = new NamespaceScope();
+                Lock lock(s_lock);
+                s_scopes->insert(scope);
+                s_key->setData(scope);
+            }
+            return *scope;
+        }
+
+        void push(const DOMElement* element) {
+            m_frames.push_back(Frame(element, m_bindings.size()));
+            if (m_frames.size() > 1 && m_frames[m_frames.size() - 2].element == element->getParentNode())
+                m_frames.back().base = m_frames[m_frames.size() - 2].base;
+            else
+                m_frames.back().base = m_frames.size() - 1;
+        }
+
+        void pop() {
+            m_bindings.resize(m_frames.back().mark);
+            m_frames.pop_back();
+        }
+
+        bool isCurrent(const DOMElement* element) const {
+            return !m_frames.empty() && m_frames.back().element == element;
+        }
+
+        // The strings must remain valid until the current frame is popped.
+        void declare(const XMLCh* prefix, const XMLCh* uri) {
+            m_bindings.push_back(make_pair(prefix, uri));
+        }
+
+        // Returns the URI bound to a prefix above the current element.
+        const XMLCh* lookup(const XMLCh* prefix) const {
+            const Frame& base = m_frames[m_frames.back().base];
+            for (vector<Binding>::size_type i = m_frames.back().mark; i > base.mark; --i) {
+                if (XMLString::equals(prefix, m_bindings[i - 1].first))
+                    return m_bindings[i - 1].second;
+            }
+            return lookupNamespaceURI(base.element->getParentNode(), prefix);
+        }
+
+    private:
+        typedef pair<const XMLCh*,const XMLCh*> Binding;
+        struct Frame {
+            Frame(const DOMElement* e, vector<Binding>::size_type m) : element(e), mark(m), base(0) {}
+            const DOMElement* element;
+            vector<Binding>::size_type mark;
+            size_t base;
+        };
+
+        vector<Binding> m_bindings;
+        vector<Frame> m_frames;
+    };
+
+    ThreadKey* NamespaceScope::s_key = nullptr;
+    Mutex* NamespaceScope::s_lock = nullptr;
+    set<NamespaceScope*>* NamespaceScope::s_scopes = nullptr;
 };
 
+void xmltooling::initNamespaceScopes()
+{
+    NamespaceScope::s_lock = Mutex::create();
+    NamespaceScope::s_scopes = new set<NamespaceScope*>();
+    NamespaceScope::s_key = ThreadKey::create(&NamespaceScope::destroy);
+}
+
+void xmltooling::termNamespaceScopes()
+{
+    // Deleting the key doesn't clean up any thread's scope, so they all go now.
+    NamespaceScope::s_key->setData(nullptr);
+    delete NamespaceScope::s_key;
+    NamespaceScope::s_key = nullptr;
+    set<NamespaceScope*> scopes;
+    {
+        Lock lock(NamespaceScope::s_lock);
+        scopes.swap(*NamespaceScope::s_scopes);
+    }
+    for_each(scopes.begin(), scopes.end(), xmltooling::cleanup<NamespaceScope>());
+    delete NamespaceScope::s_scopes;
+    NamespaceScope::s_scopes = nullptr;
+    delete NamespaceScope::s_lock;
+    NamespaceScope::s_lock = nullptr;
+}
+
+NamespaceScopeGuard::NamespaceScopeGuard(const DOMElement* element)
+{
+    NamespaceScope::getScope().push(element);
+}
+
+NamespaceScopeGuard::~NamespaceScopeGuard()
+{
+    NamespaceScope::getScope().pop();
+}
+
 void AbstractXMLObjectMarshaller::marshallNamespaces(DOMElement* domElement) const
 {
     m_log.debug("marshalling namespace attributes for XMLObject");
+
+    // If called outside of marshallInto(), fall back to searching the DOM.
+    NamespaceScope& scope = NamespaceScope::getScope();
+    bool scoped = scope.isCurrent(domElement);
+
     const set<Namespace>& namespaces = getNamespaces();
-    for_each(namespaces.begin(),namespaces.end(),bind1st(_addns(),domElement));
+    for (set<Namespace>::const_iterator ns = namespaces.begin(); ns != namespaces.end(); ++ns) {
+        const XMLCh* prefix=ns->getNamespacePrefix();
+        const XMLCh* uri=ns->getNamespaceURI();
+
+        // Check for xmlns:xml.
+        if (XMLString::equals(prefix, XML_PREFIX) && XMLString::equals(uri, XML_NS))
+            continue;
+
+        // Check to see if the prefix is already declared properly above this node.
+        if (!ns->alwaysDeclare()) {
+            const XMLCh* declared = scoped ? scope.lookup(prefix) : lookupNamespaceURI(domElement->getParentNode(),prefix);
+            if (declared && XMLString::equals(declared,uri))
+                continue;
+        }
+
+        if (prefix && *prefix) {
+            XMLCh* xmlns=new XMLCh[XMLString::stringLen(XMLNS_PREFIX) + XMLString::stringLen(prefix) + 2*sizeof(XMLCh)];
+            *xmlns=chNull;
+            XMLString::catString(xmlns,XMLNS_PREFIX);
+            static const XMLCh colon[] = {chColon, chNull};
+            XMLString::catString(xmlns,colon);
+            XMLString::catString(xmlns,prefix);
+            domElement->setAttributeNS(XMLNS_NS, xmlns, uri);
+            delete[] xmlns;
+        }
+        else {
+            domElement->setAttributeNS(XMLNS_NS, XMLNS_PREFIX, uri);
+        }
+
+        // The object's namespaces aren't modified while its content is marshalled.
+        if (scoped)
+            scope.declare(prefix, uri);
+    }
 }
 
 void AbstractXMLObjectMarshaller::marshallContent(
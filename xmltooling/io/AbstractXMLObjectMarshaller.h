@@ -41,6 +41,7 @@ namespace xmltooling {
      */
     class XMLTOOL_API AbstractXMLObjectMarshaller : public virtual AbstractXMLObject
     {
+        friend class StreamingMarshaller;
     public:
         virtual ~AbstractXMLObjectMarshaller();
 
@@ -99,6 +100,16 @@ namespace xmltooling {
         void marshallInto(xercesc::DOMElement* targetElement) const;
 #endif
     
+        /**
+         * Marshalls the namespace declarations and attributes of the XMLObject into the given DOM Element,
+         * without its content.
+         *
+         * @param targetElement the Element into which the XMLObject is marshalled into
+         *
+         * @throws MarshallingException thrown if there is a problem marshalling the object
+         */
+        void marshallStartElement(xercesc::DOMElement* targetElement) const;
+
         /**
          * Creates an xsi:type attribute, corresponding to the given type of the XMLObject, on the DOM element.
          * 
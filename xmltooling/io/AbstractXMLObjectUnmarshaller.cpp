@@ -71,12 +71,30 @@ XMLObject* AbstractXMLObjectUnmarshaller::unmarshall(DOMElement* element, bool b
         unmarshallAttributes(element);
     }
 
-    unmarshallContent(element);
+    if (m_lazy && XMLHelper::getFirstChildElement(element)) {
+        m_log.debug("deferring unmarshalling of child nodes until first accessed");
+        m_deferredContent = element;
+    }
+    else {
+        // Nothing worth deferring, so content accessors can skip the check.
+        m_lazy = false;
+        unmarshallContent(element);
+    }
 
     setDOM(element,bindDocument);
     return this;
 }
 
+XMLObject* AbstractXMLObjectUnmarshaller::unmarshallLazily(DOMElement* element, bool bindDocument)
+{
+    if (getDOM() || hasParent())
+        throw UnmarshallingException("Object already contains data, it cannot be unmarshalled at this stage.");
+
+    // Subclasses may override unmarshall(), so the mode is passed along as state.
+    m_lazy = true;
+    return unmarshall(element, bindDocument);
+}
+
 void AbstractXMLObjectUnmarshaller::unmarshallAttributes(const DOMElement* domElement)
 {
 #ifdef _DEBUG
@@ -199,7 +217,7 @@ void AbstractXMLObjectUnmarshaller::unmarshallContent(const DOMElement* domEleme
             }
 
             // Retain ownership of the unmarshalled child until it's processed by the parent.
-            auto_ptr<XMLObject> childObject(builder->buildFromElement(static_cast<DOMElement*>(childNode)));
+            auto_ptr<XMLObject> childObject(builder->buildFromElement(static_cast<DOMElement*>(childNode), false, m_lazy));
             processChildElement(childObject.get(), static_cast<DOMElement*>(childNode));
             childObject.release();
             
@@ -41,10 +41,30 @@ namespace xmltooling {
      */
     class XMLTOOL_API AbstractXMLObjectUnmarshaller : public virtual AbstractXMLObject
     {
+        friend class AbstractXMLObject;
+        friend class StreamingUnmarshaller;
     public:
         virtual ~AbstractXMLObjectUnmarshaller();
 
         XMLObject* unmarshall(xercesc::DOMElement* element, bool bindDocument=false);
+
+        /**
+         * Unmarshalls the given DOM element into the XMLObject like unmarshall(), but leaves
+         * any child elements, and the text around them, in the DOM until the object's children
+         * or text content are first accessed. Children are then unmarshalled lazily in turn,
+         * so subtrees that are never accessed are never unmarshalled.
+         *
+         * <p>The DOM must remain available for as long as content may still be unmarshalled,
+         * so the document should normally be bound to the object. Errors in deferred content are
+         * only reported when it is accessed.
+         *
+         * @param element       the DOM element to unmarshall
+         * @param bindDocument  true iff the resulting XMLObject should take ownership of the DOM's Document
+         * @return the unmarshalled XMLObject
+         *
+         * @throws UnmarshallingException thrown if an error occurs unmarshalling the DOM element into the XMLObject
+         */
+        XMLObject* unmarshallLazily(xercesc::DOMElement* element, bool bindDocument=false);
             
     protected:
         AbstractXMLObjectUnmarshaller();
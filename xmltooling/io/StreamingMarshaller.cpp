@@ -0,0 +1,410 @@
+/**
+ * Licensed to the University Corporation for Advanced Internet
+ * Development, Inc. (UCAID) under one or more contributor license
+ * agreements. See the NOTICE file distributed with this work for
+ * additional information regarding copyright ownership.
+ *
+ * UCAID licenses this file to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file except
+ * in compliance with the License. You may obtain a copy of the
+ * License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ */
+
+/**
+ * StreamingMarshaller.cpp
+ * 
+ * Serializes XMLObject trees directly to UTF-8.
+ */
+
+#include "internal.h"
+#include "exceptions.h"
+#include "XMLObject.h"
+#include "io/AbstractXMLObjectMarshaller.h"
+#include "io/StreamingMarshaller.h"
+#include "util/NDC.h"
+#include "util/XMLConstants.h"
+#include "util/XMLHelper.h"
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <set>
+#include <vector>
+#include <boost/scoped_ptr.hpp>
+
+using namespace xmltooling;
+using namespace xercesc;
+using namespace std;
+
+using boost::scoped_ptr;
+
+namespace {
+    // Characters escaped by the DOM serializer in text and attribute values.
+    const char TEXT_ESCAPES[] = "&<>";
+    const char ATTR_ESCAPES[] = "&<\"\n\r\t";
+
+    // Amount of output buffered before writing to a stream.
+    const string::size_type CHUNK_SIZE = 8192;
+
+    void useNamespace(const XMLCh* prefix, const XMLCh* uri, const set<xstring>& declared, map<xstring,xstring>& used) {
+        xstring p(prefix ? prefix : &chNull);
+        if (p != xmlconstants::XML_PREFIX && declared.find(p) == declared.end() && used.find(p) == used.end())
+            used[p] = uri ? uri : &chNull;
+    }
+
+    // Records the prefixes used in a subtree that aren't declared within it, along
+    // with the namespace each is expected to be bound to. The default namespace
+    // has an empty prefix, and no namespace an empty URI.
+    void collectNamespaces(const DOMElement* element, set<xstring>& declared, map<xstring,xstring>& used) {
+        vector<xstring> added;
+        DOMNamedNodeMap* attributes = element->getAttributes();
+        XMLSize_t count = attributes ? attributes->getLength() : 0;
+        for (XMLSize_t i = 0; i < count; ++i) {
+            const DOMNode* attribute = attributes->item(i);
+            if (XMLString::equals(attribute->getNamespaceURI(), xmlconstants::XMLNS_NS)) {
+                xstring p(XMLString::equals(attribute->getLocalName(), xmlconstants::XMLNS_PREFIX) ? &chNull : attribute->getLocalName());
+                if (declared.insert(p).second)
+                    added.push_back(p);
+            }
+        }
+
+        useNamespace(element->getPrefix(), element->getNamespaceURI(), declared, used);
+        for (XMLSize_t i = 0; i < count; ++i) {
+            const DOMNode* attribute = attributes->item(i);
+            if (attribute->getPrefix() && !XMLString::equals(attribute->getNamespaceURI(), xmlconstants::XMLNS_NS))
+                useNamespace(attribute->getPrefix(), attribute->getNamespaceURI(), declared, used);
+        }
+
+        for (const DOMElement* child = XMLHelper::getFirstChildElement(element); child; child = XMLHelper::getNextSiblingElement(child))
+            collectNamespaces(child, declared, used);
+
+        for (vector<xstring>::const_iterator i = added.begin(); i != added.end(); ++i)
+            declared.erase(*i);
+    }
+};
+
+StreamingMarshaller::StreamingMarshaller() : m_document(nullptr), m_buf(nullptr), m_out(nullptr)
+{
+}
+
+StreamingMarshaller::~StreamingMarshaller()
+{
+}
+
+void StreamingMarshaller::marshall(const XMLObject& xmlObject, string& buf)
+{
+#ifdef _DEBUG
+    xmltooling::NDC ndc("marshall");
+#endif
+
+    m_document = DOMImplementationRegistry::getDOMImplementation(nullptr)->createDocument();
+    XercesJanitor<DOMDocument> janitor(m_document);
+    m_buf = &buf;
+    m_out = nullptr;
+    try {
+        writeObject(xmlObject, m_document);
+    }
+    catch (...) {
+        m_document = nullptr;
+        m_buf = nullptr;
+        throw;
+    }
+    m_document = nullptr;
+    m_buf = nullptr;
+}
+
+ostream& StreamingMarshaller::marshall(const XMLObject& xmlObject, ostream& out)
+{
+#ifdef _DEBUG
+    xmltooling::NDC ndc("marshall");
+#endif
+
+    m_document = DOMImplementationRegistry::getDOMImplementation(nullptr)->createDocument();
+    XercesJanitor<DOMDocument> janitor(m_document);
+    m_chunk.erase();
+    m_buf = &m_chunk;
+    m_out = &out;
+    try {
+        writeObject(xmlObject, m_document);
+        flush();
+    }
+    catch (...) {
+        m_document = nullptr;
+        m_buf = nullptr;
+        m_out = nullptr;
+        m_chunk.erase();
+        throw;
+    }
+    m_document = nullptr;
+    m_buf = nullptr;
+    m_out = nullptr;
+    return out;
+}
+
+void StreamingMarshaller::writeObject(const XMLObject& xmlObject, DOMNode* parent)
+{
+    // A cached DOM is written as is, so that signed content keeps its exact form.
+    if (xmlObject.getDOM()) {
+        writeCachedNode(xmlObject.getDOM(), parent);
+        return;
+    }
+
+    const AbstractXMLObjectMarshaller* marshaller = dynamic_cast<const AbstractXMLObjectMarshaller*>(&xmlObject);
+    if (!marshaller) {
+        // Marshall a copy of the object, so the original isn't left holding onto our document.
+        scoped_ptr<XMLObject> copy(xmlObject.clone());
+        DOMElement* dom;
+        if (parent == m_document)
+            dom = copy->marshall(m_document);
+        else
+            dom = copy->marshall(static_cast<DOMElement*>(parent));
+        writeNode(dom);
+        parent->removeChild(dom);
+        return;
+    }
+
+    // The element only lives long enough to collect the attributes and to
+    // provide the namespace context for the children.
+    marshaller->prepareForMarshalling();
+    DOMElement* element = m_document->createElementNS(
+        xmlObject.getElementQName().getNamespaceURI(), xmlObject.getElementQName().getLocalPart()
+        );
+    parent->appendChild(element);
+    {
+        NamespaceScopeGuard guard(element);
+        marshaller->marshallStartElement(element);
+        writeStartTag(element);
+
+        // This mirrors AbstractXMLObjectMarshaller::marshallContent().
+        unsigned int pos = 0;
+        const XMLCh* val = xmlObject.getTextContent(pos);
+        if ((!val || !*val) && !xmlObject.hasChildren()) {
+            write("/>", 2);
+        }
+        else {
+            write(">", 1);
+            if (val && *val)
+                write(val, TEXT_ESCAPES);
+            const list<XMLObject*>& children = xmlObject.getOrderedChildren();
+            for (list<XMLObject*>::const_iterator i = children.begin(); i != children.end(); ++i) {
+                if (*i) {
+                    writeObject(*(*i), element);
+                    val = xmlObject.getTextContent(++pos);
+                    if (val && *val)
+                        write(val, TEXT_ESCAPES);
+                }
+            }
+            write("</", 2);
+            write(element->getNodeName());
+            write(">", 1);
+        }
+    }
+    parent->removeChild(element);
+    element->release();
+}
+
+void StreamingMarshaller::writeCachedNode(const DOMElement* element, const DOMNode* parent)
+{
+    // The DOM may belong to another document, and rely on declarations made by its
+    // ancestors there, so any that aren't in scope where it's written are added.
+    set<xstring> declared;
+    map<xstring,xstring> used;
+    collectNamespaces(element, declared, used);
+
+    writeStartTag(element);
+    for (map<xstring,xstring>::const_iterator i = used.begin(); i != used.end(); ++i) {
+        const XMLCh* current = nullptr;
+        if (parent->getNodeType() == DOMNode::ELEMENT_NODE)
+            current = parent->lookupNamespaceURI(i->first.empty() ? nullptr : i->first.c_str());
+        if (XMLString::equals(current ? current : &chNull, i->second.c_str()))
+            continue;
+        write(" xmlns", 6);
+        if (!i->first.empty()) {
+            write(":", 1);
+            write(i->first.c_str());
+        }
+        write("=\"", 2);
+        write(i->second.c_str(), ATTR_ESCAPES);
+        write("\"", 1);
+    }
+    writeContent(element);
+}
+
+void StreamingMarshaller::writeNode(const DOMNode* node)
+{
+    switch (node->getNodeType()) {
+        case DOMNode::ELEMENT_NODE:
+            writeStartTag(static_cast<const DOMElement*>(node));
+            writeContent(static_cast<const DOMElement*>(node));
+            break;
+
+        case DOMNode::TEXT_NODE:
+            write(node->getNodeValue(), TEXT_ESCAPES);
+            break;
+
+        case DOMNode::CDATA_SECTION_NODE:
+        {
+            // Sections containing the terminator are split around it.
+            static const XMLCh terminator[] = { chCloseSquare, chCloseSquare, chCloseAngle, chNull };
+            const XMLCh* val = node->getNodeValue();
+            int split = XMLString::patternMatch(val, terminator);
+            write("<![CDATA[", 9);
+            while (split >= 0) {
+                XMLCh* part = XMLString::replicate(val);
+                part[split + 2] = chNull;
+                write(part);
+                XMLString::release(&part);
+                write("]]><![CDATA[", 12);
+                val += split + 2;
+                split = XMLString::patternMatch(val, terminator);
+            }
+            write(val);
+            write("]]>", 3);
+            break;
+        }
+
+        case DOMNode::COMMENT_NODE:
+            write("<!--", 4);
+            write(node->getNodeValue());
+            write("-->", 3);
+            break;
+
+        case DOMNode::PROCESSING_INSTRUCTION_NODE:
+            write("<?", 2);
+            write(node->getNodeName());
+            if (node->getNodeValue() && *node->getNodeValue()) {
+                write(" ", 1);
+                write(node->getNodeValue());
+            }
+            write("?>", 2);
+            break;
+
+        case DOMNode::ENTITY_REFERENCE_NODE:
+            write("&", 1);
+            write(node->getNodeName());
+            write(";", 1);
+            break;
+
+        default:
+            break;
+    }
+}
+
+void StreamingMarshaller::writeContent(const DOMElement* element)
+{
+    if (element->hasChildNodes()) {
+        write(">", 1);
+        for (const DOMNode* child = element->getFirstChild(); child; child = child->getNextSibling())
+            writeNode(child);
+        write("</", 2);
+        write(element->getNodeName());
+        write(">", 1);
+    }
+    else {
+        write("/>", 2);
+    }
+}
+
+void StreamingMarshaller::writeStartTag(const DOMElement* element)
+{
+    write("<", 1);
+    write(element->getNodeName());
+    DOMNamedNodeMap* attributes = element->getAttributes();
+    XMLSize_t count = attributes ? attributes->getLength() : 0;
+    for (XMLSize_t i = 0; i < count; ++i) {
+        const DOMAttr* attribute = static_cast<const DOMAttr*>(attributes->item(i));
+        // Defaulted attributes are discarded, as by the serializer.
+        if (!attribute->getSpecified())
+            continue;
+        write(" ", 1);
+        write(attribute->getNodeName());
+        write("=\"", 2);
+        write(attribute->getNodeValue(), ATTR_ESCAPES);
+        write("\"", 1);
+    }
+}
+
+void StreamingMarshaller::write(const char* s, size_t len)
+{
+    m_buf->append(s, len);
+    if (m_out && m_buf->size() >= CHUNK_SIZE)
+        flush();
+}
+
+void StreamingMarshaller::write(const XMLCh* s, const char* escapes)
+{
+    if (!s)
+        return;
+
+    for (; *s; ++s) {
+        unsigned long ch = *s;
+        if (ch < 0x80) {
+            if (escapes && strchr(escapes, static_cast<int>(ch))) {
+                switch (ch) {
+                    case chAmpersand:
+                        m_buf->append("&amp;");
+                        break;
+                    case chOpenAngle:
+                        m_buf->append("&lt;");
+                        break;
+                    case chCloseAngle:
+                        m_buf->append("&gt;");
+                        break;
+                    case chDoubleQuote:
+                        m_buf->append("&quot;");
+                        break;
+                    default:
+                    {
+                        // Whitespace in attributes is written as a character reference.
+                        char ref[8];
+                        sprintf(ref, "&#x%lX;", ch);
+                        m_buf->append(ref);
+                    }
+                }
+            }
+            else {
+                m_buf->push_back(static_cast<char>(ch));
+            }
+            continue;
+        }
+
+        // Combine surrogate pairs before encoding.
+        if (ch >= 0xD800 && ch <= 0xDBFF && s[1] >= 0xDC00 && s[1] <= 0xDFFF) {
+            ch = 0x10000 + ((ch - 0xD800) << 10) + (s[1] - 0xDC00);
+            ++s;
+        }
+        if (ch < 0x800) {
+            m_buf->push_back(static_cast<char>(0xC0 | (ch >> 6)));
+        }
+        else {
+            if (ch < 0x10000) {
+                m_buf->push_back(static_cast<char>(0xE0 | (ch >> 12)));
+            }
+            else {
+                m_buf->push_back(static_cast<char>(0xF0 | (ch >> 18)));
+                m_buf->push_back(static_cast<char>(0x80 | ((ch >> 12) & 0x3F)));
+            }
+            m_buf->push_back(static_cast<char>(0x80 | ((ch >> 6) & 0x3F)));
+        }
+        m_buf->push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+    }
+
+    if (m_out && m_buf->size() >= CHUNK_SIZE)
+        flush();
+}
+
+void StreamingMarshaller::flush()
+{
+    if (m_out && !m_chunk.empty()) {
+        m_out->write(m_chunk.data(), m_chunk.size());
+        m_chunk.erase();
+    }
+}
@@ -0,0 +1,112 @@
+/**
+ * Licensed to the University Corporation for Advanced Internet
+ * Development, Inc. (UCAID) under one or more contributor license
+ * agreements. See the NOTICE file distributed with this work for
+ * additional information regarding copyright ownership.
+ *
+ * UCAID licenses this file to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file except
+ * in compliance with the License. You may obtain a copy of the
+ * License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ */
+
+/**
+ * @file xmltooling/io/StreamingMarshaller.h
+ * 
+ * Serializes XMLObject trees directly to UTF-8.
+ */
+
+#ifndef __xmltooling_streammarshaller_h__
+#define __xmltooling_streammarshaller_h__
+
+#include <xmltooling/base.h>
+
+#include <ostream>
+#include <string>
+#include <xercesc/dom/DOM.hpp>
+
+#if defined (_MSC_VER)
+    #pragma warning( push )
+    #pragma warning( disable : 4250 4251 )
+#endif
+
+namespace xmltooling {
+
+    class XMLTOOL_API XMLObject;
+
+    /**
+     * Serializes XMLObject trees directly to UTF-8, without first marshalling
+     * the entire tree into a DOM.
+     *
+     * <p>Each element is written out as soon as its attributes have been marshalled
+     * into a transient element, which is discarded once its content has been written,
+     * so no DOM is cached by the objects. For objects without a DOM, the output is the
+     * same as serializing the result of XMLObject::marshall() with XMLHelper::serialize().
+     *
+     * <p>Any object in the tree that already has a DOM is serialized from it unchanged,
+     * rather than being marshalled again, with declarations added for any namespaces it
+     * uses that were declared outside of it. The result is equivalent to marshalling the
+     * tree, but need not be identical to it: for example, a child that came from another
+     * document would be marshalled again with its own declarations.
+     * Objects that do not derive from AbstractXMLObjectMarshaller are copied, and the copy
+     * is marshalled and serialized, so the tree itself is never modified. No signatures
+     * are computed, so content to be signed must be marshalled as usual. Instances are
+     * not thread-safe.
+     */
+    class XMLTOOL_API StreamingMarshaller
+    {
+        MAKE_NONCOPYABLE(StreamingMarshaller);
+    public:
+        StreamingMarshaller();
+        ~StreamingMarshaller();
+
+        /**
+         * Serializes an object, appending the result to a buffer.
+         *
+         * @param xmlObject object to serialize
+         * @param buf       buffer to append to
+         * @throws MarshallingException thrown if there was a problem marshalling an object
+         */
+        void marshall(const XMLObject& xmlObject, std::string& buf);
+
+        /**
+         * Serializes an object to a stream.
+         *
+         * @param xmlObject object to serialize
+         * @param out       stream to write to
+         * @return reference to output stream
+         * @throws MarshallingException thrown if there was a problem marshalling an object
+         */
+        std::ostream& marshall(const XMLObject& xmlObject, std::ostream& out);
+
+    private:
+        void writeObject(const XMLObject& xmlObject, xercesc::DOMNode* parent);
+        void writeCachedNode(const xercesc::DOMElement* element, const xercesc::DOMNode* parent);
+        void writeNode(const xercesc::DOMNode* node);
+        void writeStartTag(const xercesc::DOMElement* element);
+        void writeContent(const xercesc::DOMElement* element);
+        void write(const char* s, size_t len);
+        void write(const XMLCh* s, const char* escapes=nullptr);
+        void flush();
+
+        xercesc::DOMDocument* m_document;
+        std::string* m_buf;
+        std::ostream* m_out;
+        std::string m_chunk;
+    };
+
+};
+
+#if defined (_MSC_VER)
+    #pragma warning( pop )
+#endif
+
+#endif /* __xmltooling_streammarshaller_h__ */
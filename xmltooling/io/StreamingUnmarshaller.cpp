@@ -0,0 +1,288 @@
+/**
+ * Licensed to the University Corporation for Advanced Internet
+ * Development, Inc. (UCAID) under one or more contributor license
+ * agreements. See the NOTICE file distributed with this work for
+ * additional information regarding copyright ownership.
+ *
+ * UCAID licenses this file to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file except
+ * in compliance with the License. You may obtain a copy of the
+ * License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ */
+
+/**
+ * StreamingUnmarshaller.cpp
+ * 
+ * Unmarshalls XMLObject trees directly from SAX2 events.
+ */
+
+#include "internal.h"
+#include "exceptions.h"
+#include "logging.h"
+#include "XMLObjectBuilder.h"
+#include "XMLToolingConfig.h"
+#include "io/AbstractXMLObjectUnmarshaller.h"
+#include "io/StreamingUnmarshaller.h"
+#include "util/NDC.h"
+#include "util/ParserPool.h"
+#include "util/XMLConstants.h"
+
+#include <xercesc/sax/SAXParseException.hpp>
+#include <xercesc/sax2/Attributes.hpp>
+#include <xercesc/sax2/XMLReaderFactory.hpp>
+#include <xercesc/util/XMLUniDefs.hpp>
+
+using namespace xmlconstants;
+using namespace xmltooling::logging;
+using namespace xmltooling;
+using namespace xercesc;
+using namespace std;
+
+StreamingUnmarshaller::StreamingUnmarshaller()
+    : m_security(new SecurityManager()), m_reader(XMLReaderFactory::createXMLReader()),
+        m_doc(nullptr), m_current(nullptr), m_depth(0), m_root(nullptr), m_streamRoot(nullptr), m_position(0)
+{
+    int expLimit = 0;
+    const char* env = getenv("XMLTOOLING_ENTITY_EXPANSION_LIMIT");
+    if (env) {
+        expLimit = atoi(env);
+    }
+    if (expLimit <= 0)
+        expLimit = XMLTOOLING_ENTITY_EXPANSION_LIMIT;
+    m_security->setEntityExpansionLimit(expLimit);
+
+    m_reader->setFeature(XMLUni::fgSAX2CoreNameSpaces, true);
+    m_reader->setFeature(XMLUni::fgSAX2CoreNameSpacePrefixes, true);
+    m_reader->setFeature(XMLUni::fgSAX2CoreValidation, false);
+    m_reader->setFeature(XMLUni::fgXercesLoadExternalDTD, false);
+    m_reader->setFeature(XMLUni::fgXercesDisableDefaultEntityResolution, true);
+    m_reader->setFeature(XMLUni::fgXercesDisallowDoctype, true);
+    m_reader->setProperty(XMLUni::fgXercesSecurityManager, m_security.get());
+    m_reader->setContentHandler(this);
+    m_reader->setErrorHandler(this);
+}
+
+StreamingUnmarshaller::~StreamingUnmarshaller()
+{
+    reset();
+}
+
+void StreamingUnmarshaller::reset()
+{
+    delete m_root;
+    m_root = nullptr;
+    m_streamRoot = nullptr;
+    if (m_doc) {
+        m_doc->release();
+        m_doc = nullptr;
+    }
+    m_current = nullptr;
+    m_depth = m_position = 0;
+    m_text.erase();
+}
+
+XMLObject* StreamingUnmarshaller::unmarshall(istream& is)
+{
+    StreamInputSource src(is);
+    return unmarshall(src);
+}
+
+XMLObject* StreamingUnmarshaller::unmarshall(InputSource& input)
+{
+#ifdef _DEBUG
+    xmltooling::NDC ndc("unmarshall");
+#endif
+
+    reset();
+    m_doc = XMLToolingConfig::getConfig().getParser().newDocument();
+    try {
+        m_reader->parse(input);
+    }
+    catch (const SAXException& ex) {
+        reset();
+        auto_ptr_char temp(ex.getMessage());
+        throw XMLParserException(string("SAX error during parsing: ") + (temp.get() ? temp.get() : "no message"));
+    }
+    catch (const XMLException& ex) {
+        reset();
+        auto_ptr_char temp(ex.getMessage());
+        throw XMLParserException(string("Xerces error during parsing: ") + (temp.get() ? temp.get() : "no message"));
+    }
+    catch (const DOMException& ex) {
+        reset();
+        auto_ptr_char temp(ex.getMessage());
+        throw XMLParserException(string("DOM error during parsing: ") + (temp.get() ? temp.get() : "no message"));
+    }
+    catch (const XMLToolingException&) {
+        reset();
+        throw;
+    }
+
+    if (!m_root) {
+        reset();
+        throw XMLParserException("No document element found during parsing.");
+    }
+
+    XMLObject* ret = m_root;
+    m_root = nullptr;
+    reset();
+    return ret;
+}
+
+void StreamingUnmarshaller::startElement(const XMLCh* const uri, const XMLCh* const, const XMLCh* const qname, const Attributes& attrs)
+{
+    static const XMLCh xmlnsColon[] = { chLatin_x, chLatin_m, chLatin_l, chLatin_n, chLatin_s, chColon, chNull };
+
+    DOMElement* e = m_doc->createElementNS((uri && *uri) ? uri : nullptr, qname);
+    for (XMLSize_t i = 0; i < attrs.getLength(); ++i) {
+        const XMLCh* aname = attrs.getQName(i);
+        const XMLCh* auri = attrs.getURI(i);
+        if (XMLString::equals(aname, XMLNS_PREFIX) || XMLString::startsWith(aname, xmlnsColon))
+            auri = XMLNS_NS;
+        e->setAttributeNS((auri && *auri) ? auri : nullptr, aname, attrs.getValue(i));
+    }
+
+    if (m_depth == 0) {
+        m_doc->appendChild(e);
+        m_current = e;
+        ++m_depth;
+
+        const XMLObjectBuilder* builder = XMLObjectBuilder::getBuilder(e);
+        if (!builder)
+            throw UnmarshallingException("Unable to locate builder for document element, and no default builder was found.");
+
+        // Build the root from its start tag, and feed it children as they complete.
+        m_root = builder->buildFromElement(e);
+        m_streamRoot = dynamic_cast<AbstractXMLObjectUnmarshaller*>(m_root);
+        if (!m_streamRoot) {
+            Category::getInstance(XMLTOOLING_LOGCAT ".StreamingUnmarshaller").debug(
+                "document element does not support incremental unmarshalling, building from complete DOM"
+                );
+            delete m_root;
+            m_root = nullptr;
+        }
+        return;
+    }
+
+    if (m_depth == 1 && m_streamRoot)
+        flushText();
+    m_current->appendChild(e);
+    m_current = e;
+    ++m_depth;
+}
+
+void StreamingUnmarshaller::endElement(const XMLCh* const, const XMLCh* const, const XMLCh* const)
+{
+    DOMElement* completed = m_current;
+    DOMNode* parent = completed->getParentNode();
+    m_current = (parent && parent->getNodeType() == DOMNode::ELEMENT_NODE) ? static_cast<DOMElement*>(parent) : nullptr;
+    --m_depth;
+
+    if (m_depth == 0) {
+        if (m_streamRoot) {
+            flushText();
+            m_root->releaseDOM();
+        }
+        else {
+            const XMLObjectBuilder* builder = XMLObjectBuilder::getBuilder(completed);
+            if (!builder)
+                throw UnmarshallingException("Unable to locate builder for document element, and no default builder was found.");
+            m_root = builder->buildFromElement(completed, true);
+            m_doc = nullptr;    // now bound to the object
+        }
+    }
+    else if (m_depth == 1 && m_streamRoot) {
+        unmarshallChild(completed);
+    }
+}
+
+void StreamingUnmarshaller::unmarshallChild(DOMElement* child)
+{
+    const XMLObjectBuilder* builder = XMLObjectBuilder::getBuilder(child);
+    if (!builder)
+        throw UnmarshallingException("Unmarshaller found unknown child element, but no default builder was found.");
+
+    // Retain ownership of the unmarshalled child until it's processed by the parent.
+    auto_ptr<XMLObject> childObject(builder->buildFromElement(child));
+    m_streamRoot->processChildElement(childObject.get(), child);
+    XMLObject* processed = childObject.release();
+
+    // The fragment is discarded, so the child can't keep a reference to it.
+    processed->releaseThisAndChildrenDOM();
+    m_current->removeChild(child)->release();
+
+    // Advance the text node position marker.
+    ++m_position;
+}
+
+void StreamingUnmarshaller::characters(const XMLCh* const chars, const XMLSize_t length)
+{
+    if (m_depth == 1 && m_streamRoot)
+        m_text.append(chars, length);
+    else if (m_depth > 0)
+        appendText(chars, length);
+}
+
+void StreamingUnmarshaller::appendText(const XMLCh* chars, XMLSize_t length)
+{
+    xstring text(chars, length);
+    DOMNode* last = m_current->getLastChild();
+    if (last && last->getNodeType() == DOMNode::TEXT_NODE)
+        static_cast<DOMText*>(last)->appendData(text.c_str());
+    else
+        m_current->appendChild(m_doc->createTextNode(text.c_str()));
+}
+
+void StreamingUnmarshaller::flushText()
+{
+    if (!m_text.empty()) {
+        m_root->setTextContent(m_text.c_str(), m_position);
+        m_text.erase();
+    }
+}
+
+void StreamingUnmarshaller::processingInstruction(const XMLCh* const target, const XMLCh* const data)
+{
+    // Instructions outside the document element are ignored, as with a DOM parse.
+    if (m_depth == 1 && m_streamRoot)
+        throw UnmarshallingException("Unmarshaller found unsupported node type.");
+    else if (m_depth > 0)
+        m_current->appendChild(m_doc->createProcessingInstruction(target, data));
+}
+
+void StreamingUnmarshaller::warning(const SAXParseException& e)
+{
+    auto_ptr_char temp(e.getMessage());
+    Category::getInstance(XMLTOOLING_LOGCAT ".StreamingUnmarshaller").warnStream()
+        << "warning on line " << e.getLineNumber()
+        << ", column " << e.getColumnNumber()
+        << ", message: " << temp.get() << logging::eol;
+}
+
+void StreamingUnmarshaller::error(const SAXParseException& e)
+{
+    auto_ptr_char temp(e.getMessage());
+    Category::getInstance(XMLTOOLING_LOGCAT ".StreamingUnmarshaller").errorStream()
+        << "error on line " << e.getLineNumber()
+        << ", column " << e.getColumnNumber()
+        << ", message: " << temp.get() << logging::eol;
+    throw e;
+}
+
+void StreamingUnmarshaller::fatalError(const SAXParseException& e)
+{
+    auto_ptr_char temp(e.getMessage());
+    Category::getInstance(XMLTOOLING_LOGCAT ".StreamingUnmarshaller").errorStream()
+        << "fatal error on line " << e.getLineNumber()
+        << ", column " << e.getColumnNumber()
+        << ", message: " << temp.get() << logging::eol;
+    throw e;
+}
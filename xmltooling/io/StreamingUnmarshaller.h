@@ -0,0 +1,133 @@
+/**
+ * Licensed to the University Corporation for Advanced Internet
+ * Development, Inc. (UCAID) under one or more contributor license
+ * agreements. See the NOTICE file distributed with this work for
+ * additional information regarding copyright ownership.
+ *
+ * UCAID licenses this file to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file except
+ * in compliance with the License. You may obtain a copy of the
+ * License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ */
+
+/**
+ * @file xmltooling/io/StreamingUnmarshaller.h
+ * 
+ * Unmarshalls XMLObject trees directly from SAX2 events.
+ */
+
+#ifndef __xmltooling_streamunmarshaller_h__
+#define __xmltooling_streamunmarshaller_h__
+
+#include <xmltooling/unicode.h>
+
+#include <istream>
+#include <boost/scoped_ptr.hpp>
+#include <xercesc/dom/DOM.hpp>
+#include <xercesc/sax/InputSource.hpp>
+#include <xercesc/sax2/DefaultHandler.hpp>
+#include <xercesc/sax2/SAX2XMLReader.hpp>
+#include <xercesc/util/SecurityManager.hpp>
+
+#if defined (_MSC_VER)
+    #pragma warning( push )
+    #pragma warning( disable : 4250 4251 )
+#endif
+
+namespace xmltooling {
+
+    class XMLTOOL_API AbstractXMLObjectUnmarshaller;
+    class XMLTOOL_API XMLObject;
+
+    /**
+     * Unmarshalls XMLObject trees directly from SAX2 events, without first
+     * parsing the entire document into a DOM.
+     *
+     * <p>The document element is built as soon as its start tag is seen, and each
+     * of its children is built from a transient DOM fragment that is discarded as
+     * soon as the child has been handed to the parent through the normal
+     * unmarshalling hooks. Peak memory is therefore bounded by the size of the
+     * largest top-level child rather than the whole document.
+     *
+     * <p>The resulting objects carry no DOM. A DOM is rebuilt on demand by
+     * XMLObject::marshall(), as for any object created programmatically. Content
+     * that must be preserved byte-for-byte (e.g. to verify a signature over the
+     * original document) should continue to be parsed with a ParserPool.
+     *
+     * <p>If the document element's implementation does not support incremental
+     * unmarshalling, the whole document is parsed into a DOM and the object is
+     * built from it, exactly as with XMLObjectBuilder::buildFromDocument().
+     *
+     * <p>Parsing is non-validating and applies the same entity and DOCTYPE
+     * restrictions as the non-validating ParserPool. Instances are not thread-safe.
+     */
+    class XMLTOOL_API StreamingUnmarshaller : public xercesc::DefaultHandler
+    {
+        MAKE_NONCOPYABLE(StreamingUnmarshaller);
+    public:
+        StreamingUnmarshaller();
+        virtual ~StreamingUnmarshaller();
+
+        /**
+         * Parses and unmarshalls a document from an input source.
+         *
+         * @param input source of the document
+         * @return  the unmarshalled document element, owned by the caller
+         * @throws XMLParserException thrown if there was a problem reading or parsing the XML
+         * @throws UnmarshallingException thrown if there was a problem building the objects
+         */
+        XMLObject* unmarshall(xercesc::InputSource& input);
+
+        /**
+         * Parses and unmarshalls a document from an input stream.
+         *
+         * @param is    stream containing the document
+         * @return  the unmarshalled document element, owned by the caller
+         * @throws XMLParserException thrown if there was a problem reading or parsing the XML
+         * @throws UnmarshallingException thrown if there was a problem building the objects
+         */
+        XMLObject* unmarshall(std::istream& is);
+
+        /// @cond off
+        void startElement(const XMLCh* const uri, const XMLCh* const localname, const XMLCh* const qname, const xercesc::Attributes& attrs);
+        void endElement(const XMLCh* const uri, const XMLCh* const localname, const XMLCh* const qname);
+        void characters(const XMLCh* const chars, const XMLSize_t length);
+        void processingInstruction(const XMLCh* const target, const XMLCh* const data);
+        void warning(const xercesc::SAXParseException& e);
+        void error(const xercesc::SAXParseException& e);
+        void fatalError(const xercesc::SAXParseException& e);
+        /// @endcond
+
+    private:
+        void reset();
+        void appendText(const XMLCh* chars, XMLSize_t length);
+        void flushText();
+        void unmarshallChild(xercesc::DOMElement* child);
+
+        boost::scoped_ptr<xercesc::SecurityManager> m_security;
+        boost::scoped_ptr<xercesc::SAX2XMLReader> m_reader;
+
+        xercesc::DOMDocument* m_doc;
+        xercesc::DOMElement* m_current;
+        unsigned int m_depth;
+        XMLObject* m_root;
+        AbstractXMLObjectUnmarshaller* m_streamRoot;
+        unsigned int m_position;
+        xstring m_text;
+    };
+
+};
+
+#if defined (_MSC_VER)
+    #pragma warning( pop )
+#endif
+
+#endif /* __xmltooling_streamunmarshaller_h__ */
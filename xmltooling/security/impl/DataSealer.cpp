@@ -27,6 +27,7 @@
 #include "internal.h"
 #include "security/DataSealer.h"
 #include "util/XMLHelper.h"
+#include "util/ZlibCodec.h"
 
 #include <sstream>
 #include <xercesc/util/Base64.hpp>
@@ -136,11 +137,13 @@ string DataSealer::wrap(const char* s, time_t exp) const
     m_log.debug("deflating data");
 
     // zip the plaintext packet
-    unsigned int len;
-    char* deflated = XMLHelper::deflate(const_cast<char*>(sb.c_str()), sb.length(), &len);
-    if (!deflated || !len)
+    string deflated;
+    ZlibCodec& deflater = ZlibCodec::getCodec(ZlibCodec::DEFLATE);
+    deflater.setParameters(9);
+    deflater.update(sb.data(), sb.length(), deflated);
+    deflater.finish(deflated);
+    if (deflated.empty())
         throw IOException("Failed to deflate data.");
-    auto_arrayptr<char> arrayjan(deflated);
 
     // Finally we encrypt the data. We have to hack this a bit to reuse the xmlsec routines.
 
@@ -151,7 +154,7 @@ string DataSealer::wrap(const char* s, time_t exp) const
     scoped_ptr<XSECEnv> env(new XSECEnv(dummydoc));
 
     TXFMChar* ct = new TXFMChar(dummydoc);
-    ct->setInput(deflated, len);
+    ct->setInput(deflated.data(), deflated.length());
     TXFMChain tx(ct);
 
     safeBuffer ciphertext;
@@ -258,12 +261,18 @@ string DataSealer::unwrap(const char* s) const
 
     m_log.debug("inflating data");
 
-    stringstream out;
-    if (XMLHelper::inflate(const_cast<char*>(plaintext.rawCharBuffer()), len, out) == 0) {
+    string decrypted;
+    try {
+        ZlibCodec& inflater = ZlibCodec::getCodec(ZlibCodec::INFLATE);
+        inflater.update(plaintext.rawCharBuffer(), len, decrypted);
+        inflater.finish(decrypted);
+    }
+    catch (const IOException& ex) {
+        m_log.error("zlib inflate failed: %s", ex.what());
         throw IOException("Unable to inflate wrapped data.");
     }
-
-    string decrypted = out.str();
+    if (decrypted.empty())
+        throw IOException("Unable to inflate wrapped data.");
 
     // Pull off the key label to verify it.
     size_t i = decrypted.find(':');
@@ -677,10 +677,12 @@ namespace xmlsignature {
 
     public:
         VectorOfPairs(SPKISexp,XMLObject) getSPKISexps() {
+            materializeContent();
             return VectorOfPairs(SPKISexp,XMLObject)(this, m_SPKISexps, &m_children, m_children.end());
         }
         
         const vector< pair<SPKISexp*,XMLObject*> >& getSPKISexps() const {
+            materializeContent();
             return m_SPKISexps;
         }
         
@@ -36,8 +36,6 @@
 #include "util/XMLConstants.h"
 #include "util/XMLHelper.h"
 
-#include <xercesc/framework/MemBufInputSource.hpp>
-#include <xercesc/framework/Wrapper4InputSource.hpp>
 #include <xercesc/util/XMLUniDefs.hpp>
 #include <xsec/dsig/DSIGKeyInfoX509.hpp>
 #include <xsec/dsig/DSIGReference.hpp>
@@ -290,10 +288,8 @@ DOMElement* XMLSecSignatureImpl::marshall(DOMDocument* document, const vector<Si
     }
     else {
         // We need to reparse the XML we saved off into a new DOM.
-        MemBufInputSource src(reinterpret_cast<const XMLByte*>(m_xml.c_str()),m_xml.length(),"XMLSecSignatureImpl");
-        Wrapper4InputSource dsrc(&src,false);
         log.debug("parsing Signature XML back into DOM tree");
-        DOMDocument* internalDoc=XMLToolingConfig::getConfig().getParser().parse(dsrc);
+        DOMDocument* internalDoc=XMLToolingConfig::getConfig().getParser().parse(m_xml.c_str(),m_xml.length(),"XMLSecSignatureImpl");
         if (document) {
             // The caller insists on using his own document, so we now have to import the thing
             // into it. Then we're just dumping the one we built.
@@ -398,10 +394,8 @@ DOMElement* XMLSecSignatureImpl::marshall(DOMElement* parentElement, const vecto
         m_signature = temp;
     }
     else {
-        MemBufInputSource src(reinterpret_cast<const XMLByte*>(m_xml.c_str()),m_xml.length(),"XMLSecSignatureImpl");
-        Wrapper4InputSource dsrc(&src,false);
         log.debug("parsing XML back into DOM tree");
-        DOMDocument* internalDoc=XMLToolingConfig::getConfig().getParser().parse(dsrc);
+        DOMDocument* internalDoc=XMLToolingConfig::getConfig().getParser().parse(m_xml.c_str(),m_xml.length(),"XMLSecSignatureImpl");
         
         log.debug("reimporting new DOM into caller-supplied document");
         try {
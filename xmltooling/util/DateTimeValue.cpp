@@ -0,0 +1,324 @@
+/**
+ * Licensed to the University Corporation for Advanced Internet
+ * Development, Inc. (UCAID) under one or more contributor license
+ * agreements. See the NOTICE file distributed with this work for
+ * additional information regarding copyright ownership.
+ *
+ * UCAID licenses this file to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file except
+ * in compliance with the License. You may obtain a copy of the
+ * License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ */
+
+/**
+ * DateTimeValue.cpp
+ *
+ * Storage for xsd:dateTime and xsd:duration attribute values in lexical and epoch form.
+ */
+
+#include "internal.h"
+#include "exceptions.h"
+#include "util/DateTimeValue.h"
+
+#include <cstdio>
+#include <memory>
+#include <xercesc/util/XMLUniDefs.hpp>
+
+using namespace xmltooling;
+using namespace xercesc;
+using namespace std;
+
+namespace {
+    inline bool isDigit(XMLCh ch)
+    {
+        return ch >= chDigit_0 && ch <= chDigit_9;
+    }
+
+    // Reads exactly n digits.
+    bool readDigits(const XMLCh*& p, int n, int& value)
+    {
+        value = 0;
+        while (n--) {
+            if (!isDigit(*p))
+                return false;
+            value = (value * 10) + (*p++ - chDigit_0);
+        }
+        return true;
+    }
+
+    bool isLeapYear(int year)
+    {
+        return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    }
+
+    int daysInMonth(int year, int month)
+    {
+        static const int days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+        return (month == 2 && isLeapYear(year)) ? 29 : days[month - 1];
+    }
+
+    // Days since 1970-01-01 in the proleptic Gregorian calendar.
+    time_t daysFromCivil(int year, int month, int day)
+    {
+        year -= (month <= 2) ? 1 : 0;
+        const int era = (year >= 0 ? year : year - 399) / 400;
+        const int yoe = year - era * 400;
+        const int doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+        const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return static_cast<time_t>(era) * 146097 + doe - 719468;
+    }
+
+    // The inverse of daysFromCivil.
+    void civilFromDays(time_t days, int& year, int& month, int& day)
+    {
+        days += 719468;
+        const time_t era = (days >= 0 ? days : days - 146096) / 146097;
+        const int doe = static_cast<int>(days - era * 146097);
+        const int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        const int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        const int mp = (5 * doy + 2) / 153;
+        day = doy - (153 * mp + 2) / 5 + 1;
+        month = mp < 10 ? mp + 3 : mp - 9;
+        year = static_cast<int>(yoe + era * 400) + (month <= 2 ? 1 : 0);
+    }
+};
+
+DateTimeValue::DateTimeValue() : m_raw(nullptr), m_epoch(0)
+{
+}
+
+DateTimeValue::~DateTimeValue()
+{
+    XMLString::release(&m_raw);
+}
+
+void DateTimeValue::set(const XMLCh* value, bool duration)
+{
+    if (!value || !*value) {
+        clear();
+        return;
+    }
+
+    time_t epoch;
+    if (!(duration ? parseDuration(value, epoch) : parseDateTime(value, epoch))) {
+        // Leave anything unusual to Xerces, which also rejects invalid values.
+        try {
+            XMLDateTime dt(value);
+            if (duration)
+                dt.parseDuration();
+            else
+                dt.parseDateTime();
+            epoch = dt.getEpoch(duration);
+        }
+        catch (const XMLException& e) {
+            auto_ptr_char temp(e.getMessage());
+            throw XMLObjectException(temp.get() ? temp.get() : "XMLException creating XMLDateTime object");
+        }
+    }
+
+    XMLCh* raw = XMLString::replicate(value);
+    XMLString::release(&m_raw);
+    m_raw = raw;
+    m_epoch = epoch;
+}
+
+void DateTimeValue::set(time_t value, bool duration)
+{
+    // Produces the same forms as XMLDateTime does for an epoch.
+    char buf[64];
+    if (duration) {
+        time_t secs = (value < 0) ? -value : value;
+        sprintf(buf, "%sP%ldDT%dH%dM%dS", (value < 0) ? "-" : "",
+            static_cast<long>(secs / 86400), static_cast<int>(secs % 86400 / 3600),
+            static_cast<int>(secs % 3600 / 60), static_cast<int>(secs % 60));
+    }
+    else {
+        time_t days = value / 86400;
+        time_t secs = value % 86400;
+        if (secs < 0) {
+            secs += 86400;
+            --days;
+        }
+        int year, month, day;
+        civilFromDays(days, year, month, day);
+        sprintf(buf, "%04d-%02d-%02dT%02d:%02d:%02dZ", year, month, day,
+            static_cast<int>(secs / 3600), static_cast<int>(secs % 3600 / 60), static_cast<int>(secs % 60));
+    }
+
+    XMLCh widened[sizeof(buf)];
+    XMLSize_t i = 0;
+    for (; buf[i]; ++i)
+        widened[i] = static_cast<XMLCh>(buf[i]);
+    widened[i] = chNull;
+
+    XMLCh* raw = XMLString::replicate(widened);
+    XMLString::release(&m_raw);
+    m_raw = raw;
+    m_epoch = value;
+}
+
+void DateTimeValue::set(const XMLDateTime* value, bool duration)
+{
+    if (value)
+        set(value->getRawData(), duration);
+    else
+        clear();
+}
+
+void DateTimeValue::clear()
+{
+    XMLString::release(&m_raw);
+    m_epoch = 0;
+}
+
+XMLDateTime* DateTimeValue::toXMLDateTime(bool duration) const
+{
+    if (!m_raw)
+        return nullptr;
+
+    try {
+        auto_ptr<XMLDateTime> ret(new XMLDateTime(m_raw));
+        if (duration)
+            ret->parseDuration();
+        else
+            ret->parseDateTime();
+        return ret.release();
+    }
+    catch (const XMLException& e) {
+        auto_ptr_char temp(e.getMessage());
+        throw XMLObjectException(temp.get() ? temp.get() : "XMLException creating XMLDateTime object");
+    }
+}
+
+bool DateTimeValue::parseDateTime(const XMLCh* value, time_t& epoch)
+{
+    if (!value)
+        return false;
+
+    const XMLCh* p = value;
+    int year, month, day, hour, minute, second;
+    if (!readDigits(p, 4, year) || *p++ != chDash ||
+            !readDigits(p, 2, month) || *p++ != chDash ||
+            !readDigits(p, 2, day) || *p++ != chLatin_T ||
+            !readDigits(p, 2, hour) || *p++ != chColon ||
+            !readDigits(p, 2, minute) || *p++ != chColon ||
+            !readDigits(p, 2, second))
+        return false;
+    if (year == 0 || month < 1 || month > 12 || day < 1 || day > daysInMonth(year, month) ||
+            hour > 23 || minute > 59 || second > 59)
+        return false;
+
+    // Fractional seconds are dropped, as XMLDateTime does.
+    if (*p == chPeriod) {
+        if (!isDigit(*++p))
+            return false;
+        while (isDigit(*p))
+            ++p;
+    }
+
+    time_t offset = 0;
+    if (*p == chLatin_Z) {
+        ++p;
+    }
+    else if (*p == chPlus || *p == chDash) {
+        bool negative = (*p++ == chDash);
+        int tzhour, tzminute;
+        if (!readDigits(p, 2, tzhour) || *p++ != chColon || !readDigits(p, 2, tzminute) ||
+                tzhour > 14 || tzminute > 59 || (tzhour == 14 && tzminute > 0))
+            return false;
+        offset = (tzhour * 3600) + (tzminute * 60);
+        if (negative)
+            offset = -offset;
+    }
+    if (*p)
+        return false;
+
+    epoch = (daysFromCivil(year, month, day) * 86400) + (hour * 3600) + (minute * 60) + second - offset;
+    return true;
+}
+
+bool DateTimeValue::parseDuration(const XMLCh* value, time_t& epoch)
+{
+    if (!value)
+        return false;
+
+    const XMLCh* p = value;
+    bool negative = (*p == chDash);
+    if (negative)
+        ++p;
+    if (*p++ != chLatin_P || !*p)
+        return false;
+
+    // Years and months have no fixed length, so they're left to XMLDateTime.
+    time_t total = 0;
+    bool inTime = false;
+    int last = 0;
+    while (*p) {
+        if (*p == chLatin_T) {
+            if (inTime || !*++p)
+                return false;
+            inTime = true;
+            continue;
+        }
+
+        time_t n = 0;
+        int count = 0;
+        while (isDigit(*p)) {
+            if (++count > 9)
+                return false;
+            n = (n * 10) + (*p++ - chDigit_0);
+        }
+        if (!count)
+            return false;
+
+        XMLCh unit = *p++;
+        if (unit == chPeriod) {
+            if (!isDigit(*p))
+                return false;
+            while (isDigit(*p))
+                ++p;
+            if (*p++ != chLatin_S)
+                return false;
+            unit = chLatin_S;
+        }
+
+        int rank;
+        time_t scale;
+        if (unit == chLatin_D && !inTime) {
+            rank = 1;
+            scale = 86400;
+        }
+        else if (unit == chLatin_H && inTime) {
+            rank = 2;
+            scale = 3600;
+        }
+        else if (unit == chLatin_M && inTime) {
+            rank = 3;
+            scale = 60;
+        }
+        else if (unit == chLatin_S && inTime) {
+            rank = 4;
+            scale = 1;
+        }
+        else {
+            return false;
+        }
+        if (rank <= last)
+            return false;
+        last = rank;
+        total += n * scale;
+    }
+    if (!last)
+        return false;
+
+    epoch = negative ? -total : total;
+    return true;
+}
@@ -0,0 +1,145 @@
+/**
+ * Licensed to the University Corporation for Advanced Internet
+ * Development, Inc. (UCAID) under one or more contributor license
+ * agreements. See the NOTICE file distributed with this work for
+ * additional information regarding copyright ownership.
+ *
+ * UCAID licenses this file to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file except
+ * in compliance with the License. You may obtain a copy of the
+ * License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ */
+
+/**
+ * @file xmltooling/util/DateTimeValue.h
+ *
+ * Storage for xsd:dateTime and xsd:duration attribute values in lexical and epoch form.
+ */
+
+#ifndef __xmltooling_dtvalue_h__
+#define __xmltooling_dtvalue_h__
+
+#include <xmltooling/base.h>
+
+#include <ctime>
+#include <xercesc/util/XMLDateTime.hpp>
+
+namespace xmltooling {
+
+    /**
+     * Holds the value of an xsd:dateTime or xsd:duration attribute as its lexical
+     * form and the equivalent epoch, so that the common case of comparing times
+     * never needs a Xerces XMLDateTime object.
+     *
+     * <p>Values in the forms found in practice are converted by a dedicated
+     * parser that does not allocate. Anything else is handed to XMLDateTime,
+     * which remains the authority on what is valid.
+     */
+    class XMLTOOL_API DateTimeValue
+    {
+        MAKE_NONCOPYABLE(DateTimeValue);
+    public:
+        DateTimeValue();
+
+        ~DateTimeValue();
+
+        /**
+         * Returns true iff no value is set.
+         *
+         * @return  true iff the value is unset
+         */
+        bool empty() const {
+            return m_raw == nullptr;
+        }
+
+        /**
+         * Returns the lexical form of the value.
+         *
+         * @return  the lexical value, or nullptr
+         */
+        const XMLCh* getRawData() const {
+            return m_raw;
+        }
+
+        /**
+         * Returns the value as an epoch, or as a number of seconds for a duration.
+         *
+         * @return  the epoch value, or 0 if the value is unset
+         */
+        time_t getEpoch() const {
+            return m_epoch;
+        }
+
+        /**
+         * Sets the value from its lexical form.
+         *
+         * @param value     the lexical value, or nullptr/empty to clear it
+         * @param duration  true iff the value is an xsd:duration
+         *
+         * @throws XMLObjectException if the value is malformed
+         */
+        void set(const XMLCh* value, bool duration=false);
+
+        /**
+         * Sets the value from an epoch, or a number of seconds for a duration.
+         *
+         * @param value     the epoch value
+         * @param duration  true iff the value is an xsd:duration
+         */
+        void set(time_t value, bool duration=false);
+
+        /**
+         * Sets the value from a parsed XMLDateTime object.
+         *
+         * @param value     the object to copy the value from, or nullptr to clear it
+         * @param duration  true iff the value is an xsd:duration
+         */
+        void set(const xercesc::XMLDateTime* value, bool duration=false);
+
+        /** Clears the value. */
+        void clear();
+
+        /**
+         * Returns a new, parsed XMLDateTime object with the value.
+         *
+         * @param duration  true iff the value is an xsd:duration
+         * @return  a new object owned by the caller, or nullptr if the value is unset
+         */
+        xercesc::XMLDateTime* toXMLDateTime(bool duration=false) const;
+
+        /**
+         * Converts an xsd:dateTime of the form YYYY-MM-DDThh:mm:ss[.s+][Z|(+|-)hh:mm]
+         * into an epoch, without allocating memory.
+         *
+         * @param value the lexical value
+         * @param epoch receives the epoch
+         * @return  true iff the value was in the supported form and valid
+         */
+        static bool parseDateTime(const XMLCh* value, time_t& epoch);
+
+        /**
+         * Converts an xsd:duration made up of days, hours, minutes and seconds
+         * into a number of seconds, without allocating memory.
+         *
+         * @param value the lexical value
+         * @param epoch receives the number of seconds
+         * @return  true iff the value was in the supported form and valid
+         */
+        static bool parseDuration(const XMLCh* value, time_t& epoch);
+
+    private:
+        XMLCh* m_raw;
+        time_t m_epoch;
+    };
+
+};
+
+#endif /* __xmltooling_dtvalue_h__ */
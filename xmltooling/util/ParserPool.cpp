@@ -37,6 +37,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fstream>
 #include <algorithm>
 #include <functional>
 #include <boost/algorithm/string.hpp>
@@ -48,6 +49,8 @@
 #include <xercesc/framework/MemBufInputSource.hpp>
 #include <xercesc/framework/LocalFileInputSource.hpp>
 #include <xercesc/framework/Wrapper4InputSource.hpp>
+#include <xercesc/internal/XMLGrammarPoolImpl.hpp>
+#include <xercesc/validators/common/Grammar.hpp>
 
 using namespace xmltooling::logging;
 using namespace xmltooling;
@@ -102,11 +105,136 @@ namespace {
             return false;
         }
     };
+
+    unsigned int getLimit(const char* name)
+    {
+        const char* env = getenv(name);
+        int val = env ? atoi(env) : 0;
+        return (val > 0) ? val : 0;
+    }
+
+    // Serves cached resource bytes, holding a reference so they outlive a cache flush.
+    class CachedInputSource : public MemBufInputSource {
+    public:
+        CachedInputSource(const boost::shared_ptr<const string>& bytes, const XMLCh* systemId)
+            : MemBufInputSource(reinterpret_cast<const XMLByte*>(bytes->data()), bytes->size(), systemId, false), m_bytes(bytes) {
+        }
+
+    private:
+        boost::shared_ptr<const string> m_bytes;
+    };
 }
 
 
+namespace xmltooling {
+    // A compiled grammar pool, counting the pool itself and each parser built against it.
+    // The count is only touched under the pool lock, and the last reference frees it.
+    struct ParserPool::SharedGrammars {
+        SharedGrammars(XMLGrammarPool* p) : pool(p), refs(1) {}
+        ~SharedGrammars() {
+            delete pool;
+        }
+        void release() {
+            if (--refs == 0)
+                delete this;
+        }
+        XMLGrammarPool* pool;
+        unsigned int refs;
+    };
+
+    // A pooled parser and the error handler bound to it for its lifetime.
+    struct ParserPool::PooledParser {
+        PooledParser(DOMLSParser* p) : parser(p), grammars(nullptr), schemaVersion(0), cached(false) {}
+        ~PooledParser() {
+            // The parser goes first, since it refers to the grammars.
+            parser->release();
+            if (grammars)
+                grammars->release();
+        }
+        DOMLSParser* parser;
+        MyErrorHandler handler;
+        ParserPool::SharedGrammars* grammars;
+        unsigned int schemaVersion;
+        bool cached;    // taken from a thread's cache, and counted as reused when handed back
+    };
+
+    // The parser kept by a thread between calls. The pool is cleared if it's destroyed
+    // before the thread exits. The owning thread takes the parser without locking, but
+    // the pool can take it back under its lock, so the slot is swapped atomically.
+    struct ParserPool::ThreadCache {
+        ThreadCache(ParserPool* p, unsigned long id) : pool(p), poolId(id), parser(nullptr) {}
+
+        ParserPool::PooledParser* take() {
+            void** slot = reinterpret_cast<void**>(&parser);
+            void* p = XMLPlatformUtils::compareAndSwap(slot, nullptr, nullptr);
+            while (p) {
+                void* prev = XMLPlatformUtils::compareAndSwap(slot, nullptr, p);
+                if (prev == p)
+                    break;
+                p = prev;
+            }
+            return reinterpret_cast<ParserPool::PooledParser*>(p);
+        }
+
+        bool park(ParserPool::PooledParser* p) {
+            return XMLPlatformUtils::compareAndSwap(reinterpret_cast<void**>(&parser), p, nullptr) == nullptr;
+        }
+
+        ParserPool* pool;
+        unsigned long poolId;
+        ParserPool::PooledParser* parser;
+    };
+};
+
+namespace {
+    // One key for every pool, holding a thread's caches for the pools it has used.
+    ThreadKey* g_threadCaches = nullptr;
+
+    // Guards the link between a cache and its pool, and numbers the pools,
+    // since a new pool can take the address of one that's gone.
+    Mutex* g_cacheLock = nullptr;
+    unsigned long g_poolCount = 0;
+
+    // Every thread's caches, so that library shutdown can free them all.
+    set<void*>* g_threadCacheSets = nullptr;
+};
+
+void ParserPool::initThreadCaches()
+{
+    g_cacheLock = Mutex::create();
+    g_threadCacheSets = new set<void*>();
+    g_threadCaches = ThreadKey::create(releaseThreadCaches);
+}
+
+void ParserPool::termThreadCaches()
+{
+    // Deleting the key doesn't clean up any thread's caches, so they all go now.
+    g_threadCaches->setData(nullptr);
+    delete g_threadCaches;
+    g_threadCaches = nullptr;
+    set<void*> caches;
+    {
+        Lock registry(g_cacheLock);
+        caches.swap(*g_threadCacheSets);
+    }
+    for_each(caches.begin(), caches.end(), releaseThreadCaches);
+    delete g_threadCacheSets;
+    g_threadCacheSets = nullptr;
+    delete g_cacheLock;
+    g_cacheLock = nullptr;
+}
+
 ParserPool::ParserPool(bool namespaceAware, bool schemaAware)
-        : m_namespaceAware(namespaceAware), m_schemaAware(schemaAware), m_lock(Mutex::create()), m_security(new SecurityManager()) {
+        : m_schemaVersion(0), m_grammarVersion(0), m_grammars(nullptr), m_compiling(false), m_namespaceAware(namespaceAware), m_schemaAware(schemaAware),
+          m_maxIdle(0), m_maxActive(0), m_active(0), m_waiters(0), m_created(0), m_reused(0), m_waited(0), m_id(0),
+          m_lock(Mutex::create()), m_available(CondWait::create()),
+          m_security(new SecurityManager()), m_resourceBytes(0), m_resourceLock(RWLock::create()) {
+
+    // Without the library's thread key, parsers aren't kept by threads.
+    if (g_cacheLock) {
+        Lock lock(g_cacheLock);
+        m_id = ++g_poolCount;
+    }
 
     int expLimit = 0;
     const char* env = getenv("XMLTOOLING_ENTITY_EXPANSION_LIMIT");
@@ -116,14 +244,68 @@ ParserPool::ParserPool(bool namespaceAware, bool schemaAware)
     if (expLimit <= 0)
         expLimit = XMLTOOLING_ENTITY_EXPANSION_LIMIT;
     m_security->setEntityExpansionLimit(expLimit);
+
+    setLimits(getLimit("XMLTOOLING_PARSER_POOL_MAX_IDLE"), getLimit("XMLTOOLING_PARSER_POOL_MAX_ACTIVE"));
+    warmUp(getLimit("XMLTOOLING_PARSER_POOL_WARMUP"));
 }
 
 ParserPool::~ParserPool()
 {
+    // Parsers held by threads are released here, and their caches are left for the threads to free.
+    if (g_cacheLock) {
+        Lock lock(g_cacheLock);
+        for (set<ThreadCache*>::const_iterator i = m_caches.begin(); i != m_caches.end(); ++i) {
+            delete (*i)->take();
+            (*i)->pool = nullptr;
+        }
+    }
     while(!m_pool.empty()) {
-        m_pool.top()->release();
+        delete m_pool.top();
+        m_pool.pop();
+    }
+    if (m_grammars)
+        m_grammars->release();
+}
+
+void ParserPool::setLimits(unsigned int maxIdle, unsigned int maxActive)
+{
+    Lock lock(m_lock);
+    m_maxIdle = maxIdle;
+    m_maxActive = maxActive;
+    if (m_maxIdle > 0 || m_maxActive > 0) {
+        // Threads don't keep parsers from a bounded pool, so any they have come back.
+        for (set<ThreadCache*>::const_iterator i = m_caches.begin(); i != m_caches.end(); ++i) {
+            PooledParser* p = (*i)->take();
+            if (p)
+                m_pool.push(p);
+        }
+    }
+    while (m_maxIdle > 0 && m_pool.size() > m_maxIdle) {
+        delete m_pool.top();
         m_pool.pop();
+        --m_active;
     }
+    m_available->broadcast();
+}
+
+void ParserPool::warmUp(unsigned int count)
+{
+    Lock lock(m_lock);
+    while (count-- > 0 && (m_maxIdle == 0 || m_pool.size() < m_maxIdle)) {
+        m_pool.push(createBuilder());
+        ++m_created;
+        ++m_active;
+    }
+}
+
+ParserPool::Statistics ParserPool::getStatistics() const
+{
+    Lock lock(m_lock);
+    Statistics stats;
+    stats.created = m_created;
+    stats.reused = m_reused;
+    stats.waited = m_waited;
+    return stats;
 }
 
 DOMDocument* ParserPool::newDocument()
@@ -133,47 +315,40 @@ DOMDocument* ParserPool::newDocument()
 
 DOMDocument* ParserPool::parse(DOMLSInput& domsrc)
 {
-    DOMLSParser* parser=checkoutBuilder();
-    XercesJanitor<DOMLSParser> janitor(parser);
+    // The error handler and document adoption are set once when the parser is built.
+    PooledParser* builder=checkoutBuilder();
     try {
-        MyErrorHandler deh;
-        parser->getDomConfig()->setParameter(XMLUni::fgDOMErrorHandler, dynamic_cast<DOMErrorHandler*>(&deh));
-        DOMDocument* doc=parser->parse(&domsrc);
-        if (deh.errors) {
+        builder->handler.errors = 0;
+        DOMDocument* doc=builder->parser->parse(&domsrc);
+        if (builder->handler.errors) {
             if (doc)
                 doc->release();
             throw XMLParserException("XML error(s) during parsing, check log for specifics");
         }
-        parser->getDomConfig()->setParameter(XMLUni::fgDOMErrorHandler, (void*)nullptr);
-        parser->getDomConfig()->setParameter(XMLUni::fgXercesUserAdoptsDOMDocument, true);
-        checkinBuilder(janitor.release());
+        checkinBuilder(builder);
         return doc;
     }
     catch (const DOMException& ex) {
-        parser->getDomConfig()->setParameter(XMLUni::fgDOMErrorHandler, (void*)nullptr);
-        parser->getDomConfig()->setParameter(XMLUni::fgXercesUserAdoptsDOMDocument, true);
-        checkinBuilder(janitor.release());
+        checkinBuilder(builder);
         auto_ptr_char temp(ex.getMessage());
         throw XMLParserException(string("DOM error during parsing: ") + (temp.get() ? temp.get() : "no message"));
     }
     catch (const SAXException& ex) {
-        parser->getDomConfig()->setParameter(XMLUni::fgDOMErrorHandler, (void*)nullptr);
-        parser->getDomConfig()->setParameter(XMLUni::fgXercesUserAdoptsDOMDocument, true);
-        checkinBuilder(janitor.release());
+        checkinBuilder(builder);
         auto_ptr_char temp(ex.getMessage());
         throw XMLParserException(string("SAX error during parsing: ") + (temp.get() ? temp.get() : "no message"));
     }
     catch (const XMLException& ex) {
-        parser->getDomConfig()->setParameter(XMLUni::fgDOMErrorHandler, (void*)nullptr);
-        parser->getDomConfig()->setParameter(XMLUni::fgXercesUserAdoptsDOMDocument, true);
-        checkinBuilder(janitor.release());
+        checkinBuilder(builder);
         auto_ptr_char temp(ex.getMessage());
         throw XMLParserException(string("Xerces error during parsing: ") + (temp.get() ? temp.get() : "no message"));
     }
     catch (const XMLToolingException&) {
-        parser->getDomConfig()->setParameter(XMLUni::fgDOMErrorHandler, (void*)nullptr);
-        parser->getDomConfig()->setParameter(XMLUni::fgXercesUserAdoptsDOMDocument, true);
-        checkinBuilder(janitor.release());
+        checkinBuilder(builder);
+        throw;
+    }
+    catch (...) {
+        discardBuilder(builder);
         throw;
     }
 }
@@ -185,6 +360,26 @@ DOMDocument* ParserPool::parse(istream& is)
     return parse(domsrc);
 }
 
+DOMDocument* ParserPool::parse(const char* buf, size_t len, const char* systemId)
+{
+    MemBufInputSource src(reinterpret_cast<const XMLByte*>(buf), len, systemId ? systemId : "ParserPool");
+    Wrapper4InputSource domsrc(&src, false);
+    return parse(domsrc);
+}
+
+DOMDocument* ParserPool::parseFile(const char* pathname)
+{
+    // Checked up front so a missing file reports its name rather than a generic parse error.
+    if (!ifstream(pathname, ios::in | ios::binary))
+        throw XMLParserException("Unable to open file ($1) for parsing.", params(1, pathname));
+
+    // The file is streamed through Xerces' own buffering, so no copy of it is held in memory.
+    auto_ptr_XMLCh widenit(pathname);
+    LocalFileInputSource src(widenit.get());
+    Wrapper4InputSource domsrc(&src, false);
+    return parse(domsrc);
+}
+
 // Functor to double its argument separated by a character and append to a buffer
 template <class T> class doubleit {
 public:
@@ -225,6 +420,8 @@ bool ParserPool::loadSchema(const XMLCh* nsURI, const XMLCh* pathname)
     m_schemaLocMap[nsURI] = temp.get();
     m_schemaLocations.erase();
     for_each(m_schemaLocMap.begin(), m_schemaLocMap.end(), doubleit<xstring>(m_schemaLocations,chSpace));
+    ++m_schemaVersion;
+    clearResources();
 
     return true;
 }
@@ -313,6 +510,8 @@ bool ParserPool::loadCatalog(const XMLCh* pathname)
         }
         m_schemaLocations.erase();
         for_each(m_schemaLocMap.begin(), m_schemaLocMap.end(), doubleit<xstring>(m_schemaLocations,chSpace));
+        ++m_schemaVersion;
+        clearResources();
     }
     catch (std::exception& e) {
         log.error("catalog loader caught exception: %s", e.what());
@@ -344,10 +543,17 @@ DOMLSInput* ParserPool::resolveResource(
         log.debug("asked to resolve %s with baseURI %s",sysId.get(),base.get() ? base.get() : "(null)");
     }
 
+    static const XMLByte nullbuf[] = {0};
+    {
+        SharedLock locker(m_resourceLock);
+        if (m_blockedResources.find(sysId) != m_blockedResources.end())
+            return new Wrapper4InputSource(new MemBufInputSource(nullbuf, 0, systemId));
+    }
+
     // Find well-known schemas in the specified location.
     map<xstring,xstring>::const_iterator i = m_schemaLocMap.find(sysId);
     if (i != m_schemaLocMap.end())
-        return new Wrapper4InputSource(new LocalFileInputSource(baseURI, i->second.c_str()));
+        return resolveFile(baseURI, i->second.c_str());
 
     // Check for entity as a suffix of a value in the map.
     bool (*p_ends_with)(const xstring&, const xstring&) = ends_with;
@@ -356,34 +562,185 @@ DOMLSInput* ParserPool::resolveResource(
         boost::bind(p_ends_with, boost::bind(&map<xstring,xstring>::value_type::second, _1), boost::ref(sysId))
         );
     if (i != m_schemaLocMap.end())
-        return new Wrapper4InputSource(new LocalFileInputSource(baseURI, i->second.c_str()));
+        return resolveFile(baseURI, i->second.c_str());
 
     // We'll allow anything without embedded slashes.
     if (XMLString::indexOf(systemId, chForwardSlash) == -1 && XMLString::indexOf(systemId, chBackSlash) == -1)
-        return new Wrapper4InputSource(new LocalFileInputSource(baseURI, systemId));
+        return resolveFile(baseURI, systemId);
 
     // Shortcircuit the request.
     auto_ptr_char temp(systemId);
     log.debug("unauthorized entity request (%s), blocking it", temp.get());
-    static const XMLByte nullbuf[] = {0};
+    m_resourceLock->wrlock();
+    SharedLock locker(m_resourceLock, false);
+    if (m_blockedResources.size() >= XMLTOOLING_RESOURCE_CACHE_BLOCKED)
+        m_blockedResources.clear();
+    m_blockedResources.insert(sysId);
     return new Wrapper4InputSource(new MemBufInputSource(nullbuf, 0, systemId));
 }
 
-DOMLSParser* ParserPool::createBuilder()
+DOMLSInput* ParserPool::resolveFile(const XMLCh* baseURI, const XMLCh* path)
+{
+    // The file source resolves the path against the base, and the result keys the cache.
+    auto_ptr<LocalFileInputSource> src(new LocalFileInputSource(baseURI, path));
+    xstring key(src->getSystemId());
+    {
+        SharedLock locker(m_resourceLock);
+        map< xstring,boost::shared_ptr<const string> >::const_iterator i = m_resources.find(key);
+        if (i != m_resources.end())
+            return new Wrapper4InputSource(new CachedInputSource(i->second, key.c_str()));
+    }
+
+    // If the file can't be read, leave it to the parser to report.
+    scoped_ptr<BinInputStream> in(src->makeStream());
+    if (!in)
+        return new Wrapper4InputSource(src.release());
+
+    boost::shared_ptr<string> bytes(new string());
+    XMLByte buf[8192];
+    XMLSize_t len;
+    while ((len = in->readBytes(buf, sizeof(buf))) > 0)
+        bytes->append(reinterpret_cast<const char*>(buf), len);
+
+    m_resourceLock->wrlock();
+    SharedLock locker(m_resourceLock, false);
+    if (m_resourceBytes + bytes->size() <= XMLTOOLING_RESOURCE_CACHE_LIMIT) {
+        if (m_resources.insert(make_pair(key, boost::shared_ptr<const string>(bytes))).second)
+            m_resourceBytes += bytes->size();
+    }
+    return new Wrapper4InputSource(new CachedInputSource(bytes, key.c_str()));
+}
+
+void ParserPool::clearResources()
 {
+    m_resourceLock->wrlock();
+    SharedLock locker(m_resourceLock, false);
+    m_resources.clear();
+    m_blockedResources.clear();
+    m_resourceBytes = 0;
+}
+
+void ParserPool::loadGrammars()
+{
+    // Caller must not hold the pool lock, since compiling can take a while.
+    map<xstring,xstring> schemaLocMap;
+    unsigned int version;
+    {
+        Lock lock(m_lock);
+        if (m_grammarVersion == m_schemaVersion || m_compiling)
+            return;
+        // Other threads carry on with the current grammars until the new ones are in.
+        m_compiling = true;
+        version = m_schemaVersion;
+        schemaLocMap = m_schemaLocMap;
+    }
+
+    SharedGrammars* grammars = nullptr;
+    try {
+        grammars = compileGrammars(schemaLocMap);
+    }
+    catch (...) {
+        Lock lock(m_lock);
+        m_compiling = false;
+        throw;
+    }
+
+    Lock lock(m_lock);
+    m_compiling = false;
+    // Parsers built against the old pool keep it alive until they're released.
+    if (m_grammars)
+        m_grammars->release();
+    m_grammars = grammars;
+    m_grammarVersion = version;
+}
+
+ParserPool::SharedGrammars* ParserPool::compileGrammars(const map<xstring,xstring>& schemaLocMap)
+{
+    if (schemaLocMap.empty())
+        return nullptr;
+
+#if _DEBUG
+    xmltooling::NDC ndc("loadGrammars");
+#endif
+    Category& log=Category::getInstance(XMLTOOLING_LOGCAT ".ParserPool");
+
     static const XMLCh impltype[] = { chLatin_L, chLatin_S, chNull };
     DOMImplementation* impl=DOMImplementationRegistry::getDOMImplementation(impltype);
-    DOMLSParser* parser=static_cast<DOMImplementationLS*>(impl)->createLSParser(DOMImplementationLS::MODE_SYNCHRONOUS,nullptr);
+    auto_ptr<XMLGrammarPool> grammars(new XMLGrammarPoolImpl(XMLPlatformUtils::fgMemoryManager));
+    DOMLSParser* parser=static_cast<DOMImplementationLS*>(impl)->createLSParser(
+        DOMImplementationLS::MODE_SYNCHRONOUS, nullptr, XMLPlatformUtils::fgMemoryManager, grammars.get()
+        );
+    XercesJanitor<DOMLSParser> janitor(parser);
+    MyErrorHandler deh;
+    parser->getDomConfig()->setParameter(XMLUni::fgDOMNamespaces, true);
+    parser->getDomConfig()->setParameter(XMLUni::fgXercesSchema, true);
+    parser->getDomConfig()->setParameter(XMLUni::fgXercesDisableDefaultEntityResolution, true);
+    parser->getDomConfig()->setParameter(XMLUni::fgDOMResourceResolver, dynamic_cast<DOMLSResourceResolver*>(this));
+    parser->getDomConfig()->setParameter(XMLUni::fgXercesSecurityManager, m_security.get());
+    parser->getDomConfig()->setParameter(XMLUni::fgDOMErrorHandler, dynamic_cast<DOMErrorHandler*>(&deh));
+
+    unsigned int loaded = 0;
+    for (map<xstring,xstring>::const_iterator i = schemaLocMap.begin(); i != schemaLocMap.end(); ++i) {
+        deh.errors = 0;
+        try {
+            if (parser->loadGrammar(i->second.c_str(), Grammar::SchemaGrammarType, true) && !deh.errors) {
+                ++loaded;
+                continue;
+            }
+        }
+        catch (const XMLException& ex) {
+            auto_ptr_char temp(ex.getMessage());
+            log.error("Xerces error while compiling schema: %s", temp.get() ? temp.get() : "no message");
+        }
+        catch (const DOMException& ex) {
+            auto_ptr_char temp(ex.getMessage());
+            log.error("DOM error while compiling schema: %s", temp.get() ? temp.get() : "no message");
+        }
+        auto_ptr_char n(i->first.c_str());
+        log.warn("schema for (%s) left out of shared grammar pool, parsers will compile it themselves", n.get());
+    }
+
+    // Locking the pool makes it read-only, which is what allows parsers to share it.
+    grammars->lockPool();
+    log.debug("compiled %u schema(s) into shared grammar pool", loaded);
+    SharedGrammars* shared = new SharedGrammars(grammars.get());
+    grammars.release();
+    return shared;
+}
+
+ParserPool::PooledParser* ParserPool::createBuilder()
+{
+    // Caller must hold the pool lock.
+    static const XMLCh impltype[] = { chLatin_L, chLatin_S, chNull };
+    DOMImplementation* impl=DOMImplementationRegistry::getDOMImplementation(impltype);
+    SharedGrammars* grammars = m_schemaAware ? m_grammars : nullptr;
+    DOMLSParser* parser=static_cast<DOMImplementationLS*>(impl)->createLSParser(
+        DOMImplementationLS::MODE_SYNCHRONOUS, nullptr, XMLPlatformUtils::fgMemoryManager, grammars ? grammars->pool : nullptr
+        );
+    auto_ptr<PooledParser> builder(new PooledParser(parser));
+    if (grammars) {
+        ++grammars->refs;
+        builder->grammars = grammars;
+    }
     parser->getDomConfig()->setParameter(XMLUni::fgDOMNamespaces, m_namespaceAware);
     if (m_schemaAware) {
         parser->getDomConfig()->setParameter(XMLUni::fgDOMNamespaces, true);
         parser->getDomConfig()->setParameter(XMLUni::fgXercesSchema, true);
         parser->getDomConfig()->setParameter(XMLUni::fgDOMValidate, true);
-        parser->getDomConfig()->setParameter(XMLUni::fgXercesCacheGrammarFromParse, true);
+        if (grammars) {
+            // The shared pool is locked, so grammars found during a parse stay with that parse.
+            parser->getDomConfig()->setParameter(XMLUni::fgXercesUseCachedGrammarInParse, true);
+            parser->getDomConfig()->setParameter(XMLUni::fgXercesCacheGrammarFromParse, false);
+        }
+        else {
+            parser->getDomConfig()->setParameter(XMLUni::fgXercesCacheGrammarFromParse, true);
+        }
 
         // We build a "fake" schema location hint that binds each namespace to itself.
         // This ensures the entity resolver will be given the namespace as a systemId it can check.
         parser->getDomConfig()->setParameter(XMLUni::fgXercesSchemaExternalSchemaLocation, const_cast<XMLCh*>(m_schemaLocations.c_str()));
+        // While new grammars are being compiled, the parser is checked again on every checkout.
+        builder->schemaVersion = m_grammarVersion;
     }
     parser->getDomConfig()->setParameter(XMLUni::fgXercesUserAdoptsDOMDocument, true);
     parser->getDomConfig()->setParameter(XMLUni::fgXercesDisableDefaultEntityResolution, true);
@@ -391,29 +748,153 @@ DOMLSParser* ParserPool::createBuilder()
     parser->getDomConfig()->setParameter(XMLUni::fgDOMComments, false);
     parser->getDomConfig()->setParameter(XMLUni::fgDOMResourceResolver, dynamic_cast<DOMLSResourceResolver*>(this));
     parser->getDomConfig()->setParameter(XMLUni::fgXercesSecurityManager, m_security.get());
-    return parser;
+    parser->getDomConfig()->setParameter(XMLUni::fgDOMErrorHandler, dynamic_cast<DOMErrorHandler*>(&builder->handler));
+    return builder.release();
 }
 
-DOMLSParser* ParserPool::checkoutBuilder()
+ParserPool::ThreadCache* ParserPool::getThreadCache()
 {
+    if (!m_id)
+        return nullptr;
+
+    vector<ThreadCache*>* caches = reinterpret_cast<vector<ThreadCache*>*>(g_threadCaches->getData());
+    if (caches) {
+        for (vector<ThreadCache*>::const_iterator i = caches->begin(); i != caches->end(); ++i) {
+            if ((*i)->poolId == m_id)
+                return *i;
+        }
+    }
+
+    // First use of this pool by the thread, so drop any caches belonging to destroyed pools.
+    Lock registry(g_cacheLock);
+    if (!caches) {
+        caches = new vector<ThreadCache*>();
+        g_threadCacheSets->insert(caches);
+        g_threadCaches->setData(caches);
+    }
+    for (vector<ThreadCache*>::iterator i = caches->begin(); i != caches->end();) {
+        if (!(*i)->pool) {
+            delete *i;
+            i = caches->erase(i);
+        }
+        else {
+            ++i;
+        }
+    }
+    ThreadCache* cache = new ThreadCache(this, m_id);
+    caches->push_back(cache);
     Lock lock(m_lock);
-    if (m_pool.empty()) {
-        DOMLSParser* builder=createBuilder();
-        return builder;
-    }
-    DOMLSParser* p=m_pool.top();
-    m_pool.pop();
-    if (m_schemaAware)
-        p->getDomConfig()->setParameter(XMLUni::fgXercesSchemaExternalSchemaLocation, const_cast<XMLCh*>(m_schemaLocations.c_str()));
+    m_caches.insert(cache);
+    return cache;
+}
+
+ParserPool::PooledParser* ParserPool::checkoutBuilder()
+{
+    if (m_schemaAware && m_grammarVersion != m_schemaVersion)
+        loadGrammars();
+
+    // The calling thread's own parser is taken without locking.
+    ThreadCache* cache = getThreadCache();
+    PooledParser* p = cache ? cache->take() : nullptr;
+    if (p) {
+        p->cached = true;
+    }
+    else {
+        Lock lock(m_lock);
+        if (m_pool.empty() && m_maxActive > 0 && m_active >= m_maxActive) {
+            // Threads don't keep parsers from a bounded pool, so the wait ends when one is returned.
+            ++m_waited;
+            ++m_waiters;
+            while (m_pool.empty() && m_maxActive > 0 && m_active >= m_maxActive)
+                m_available->wait(m_lock.get());
+            --m_waiters;
+        }
+        if (m_pool.empty()) {
+            p = createBuilder();
+            ++m_created;
+            ++m_active;
+            return p;
+        }
+        p = m_pool.top();
+        m_pool.pop();
+        ++m_reused;
+    }
+
+    if (m_schemaAware && p->schemaVersion != m_schemaVersion) {
+        Lock lock(m_lock);
+        if (p->grammars != m_grammars) {
+            // A parser's grammar pool is fixed at creation, so replace it.
+            delete p;
+            p = nullptr;
+            p = createBuilder();
+            ++m_created;
+        }
+        else {
+            p->parser->getDomConfig()->setParameter(XMLUni::fgXercesSchemaExternalSchemaLocation, const_cast<XMLCh*>(m_schemaLocations.c_str()));
+            p->schemaVersion = m_grammarVersion;
+        }
+    }
     return p;
 }
 
-void ParserPool::checkinBuilder(DOMLSParser* builder)
+void ParserPool::checkinBuilder(PooledParser* builder)
 {
     if (builder) {
+        // Keep the parser on this thread unless the pool is bounded.
+        ThreadCache* cache = getThreadCache();
         Lock lock(m_lock);
+        if (builder->cached) {
+            builder->cached = false;
+            ++m_reused;
+        }
+        if (cache && m_maxIdle == 0 && m_maxActive == 0 && cache->park(builder))
+            return;
+        returnBuilder(builder);
+    }
+}
+
+void ParserPool::returnBuilder(PooledParser* builder)
+{
+    // Caller must hold the pool lock.
+    if (m_maxIdle > 0 && m_pool.size() >= m_maxIdle) {
+        delete builder;
+        --m_active;
+    }
+    else {
         m_pool.push(builder);
     }
+    m_available->signal();
+}
+
+void ParserPool::discardBuilder(PooledParser* builder)
+{
+    Lock lock(m_lock);
+    if (builder->cached)
+        ++m_reused;
+    delete builder;
+    --m_active;
+    m_available->signal();
+}
+
+void ParserPool::releaseThreadCaches(void* data)
+{
+    vector<ThreadCache*>* caches = reinterpret_cast<vector<ThreadCache*>*>(data);
+    if (!caches)
+        return;
+    Lock registry(g_cacheLock);
+    g_threadCacheSets->erase(caches);
+    for (vector<ThreadCache*>::const_iterator i = caches->begin(); i != caches->end(); ++i) {
+        ParserPool* pool = (*i)->pool;
+        if (pool) {
+            Lock lock(pool->m_lock);
+            pool->m_caches.erase(*i);
+            PooledParser* p = (*i)->take();
+            if (p)
+                pool->returnBuilder(p);
+        }
+        delete *i;
+    }
+    delete caches;
 }
 
 StreamInputSource::StreamInputSource(istream& is, const char* systemId) : InputSource(systemId), m_is(is)
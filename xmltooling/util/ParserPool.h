@@ -31,11 +31,15 @@
 
 #include <map>
 #include <memory>
+#include <set>
 #include <stack>
 #include <string>
+#include <vector>
 #include <istream>
 #include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 #include <xercesc/dom/DOM.hpp>
+#include <xercesc/framework/XMLGrammarPool.hpp>
 #include <xercesc/sax/InputSource.hpp>
 #include <xercesc/util/BinInputStream.hpp>
 #include <xercesc/util/SecurityManager.hpp>
@@ -52,10 +56,22 @@
 
 namespace xmltooling {
 
+    class XMLTOOL_API CondWait;
     class XMLTOOL_API Mutex;
+    class XMLTOOL_API RWLock;
 
     /**
      * A thread-safe pool of DOMBuilders that share characteristics.
+     *
+     * <p>Unless the pool is bounded with setLimits(), each thread keeps the parser it last
+     * used, so repeated parsing on one thread doesn't contend with other threads. Parsers
+     * beyond that are held in a shared stack.
+     *
+     * <p>A schema-aware pool compiles the schemas registered with it once, into a grammar
+     * pool shared by all of its parsers, and recompiles them when the set changes.
+     *
+     * <p>Local resources handed to parsers are kept in memory, up to a fixed budget, along
+     * with the entity requests that were refused, until the schema set changes.
      */
     class XMLTOOL_API ParserPool : public xercesc::DOMLSResourceResolver
     {
@@ -70,6 +86,42 @@ namespace xmltooling {
         ParserPool(bool namespaceAware=true, bool schemaAware=false);
         ~ParserPool();
 
+        /**
+         * Usage counters for a pool.
+         */
+        struct Statistics {
+            unsigned long created;  ///< parsers created by the pool
+            unsigned long reused;   ///< parses served by an existing parser
+            unsigned long waited;   ///< checkouts that had to wait for a parser to be returned
+        };
+
+        /**
+         * Bounds the number of parsers the pool keeps and creates.
+         *
+         * <p>Parsers returned while the shared stack holds maxIdle entries are released.
+         * Once maxActive parsers exist, a thread needing one waits until another thread
+         * returns one. While either limit is set, threads don't keep parsers between calls,
+         * and any they were keeping are returned to the shared stack.
+         *
+         * @param maxIdle   limit on parsers held in the shared stack, or 0 for no limit
+         * @param maxActive limit on parsers in existence, or 0 for no limit
+         */
+        void setLimits(unsigned int maxIdle, unsigned int maxActive);
+
+        /**
+         * Creates parsers ahead of need and places them in the shared stack.
+         *
+         * @param count number of parsers to create
+         */
+        void warmUp(unsigned int count);
+
+        /**
+         * Returns the pool's usage counters.
+         *
+         * @return a snapshot of the counters
+         */
+        Statistics getStatistics() const;
+
         /**
          * Creates a new document using a parser from this pool.
          *
@@ -96,6 +148,26 @@ namespace xmltooling {
          */
         xercesc::DOMDocument* parse(std::istream& is);
 
+        /**
+         * Parses a document held in memory, reading it in place
+         *
+         * @param buf       buffer containing the content to be parsed
+         * @param len       length of the content in bytes
+         * @param systemId  optional system identifier to attach to the content
+         * @return The DOM document resulting from the parse
+         * @throws XMLParserException thrown if there was a problem reading, parsing, or validating the XML
+         */
+        xercesc::DOMDocument* parse(const char* buf, size_t len, const char* systemId=nullptr);
+
+        /**
+         * Parses a local file, streaming it from disk
+         *
+         * @param pathname  path to the file to be parsed
+         * @return The DOM document resulting from the parse
+         * @throws XMLParserException thrown if there was a problem reading, parsing, or validating the XML
+         */
+        xercesc::DOMDocument* parseFile(const char* pathname);
+
         /**
          * Load OASIS catalog files to map schema namespace URIs to filenames.
          *
@@ -155,17 +227,44 @@ namespace xmltooling {
             );
 
     private:
-        xercesc::DOMLSParser* createBuilder();
-        xercesc::DOMLSParser* checkoutBuilder();
-        void checkinBuilder(xercesc::DOMLSParser* builder);
+        friend class XMLToolingInternalConfig;
+        static void initThreadCaches();
+        static void termThreadCaches();
+
+        struct PooledParser;
+        struct ThreadCache;
+        struct SharedGrammars;
+        ThreadCache* getThreadCache();
+        PooledParser* createBuilder();
+        PooledParser* checkoutBuilder();
+        void checkinBuilder(PooledParser* builder);
+        void returnBuilder(PooledParser* builder);
+        void discardBuilder(PooledParser* builder);
+        void loadGrammars();
+        SharedGrammars* compileGrammars(const std::map<xstring,xstring>& schemaLocMap);
+        xercesc::DOMLSInput* resolveFile(const XMLCh* baseURI, const XMLCh* path);
+        void clearResources();
+        static void releaseThreadCaches(void* data);
 
         xstring m_schemaLocations;
         std::map<xstring,xstring> m_schemaLocMap;
+        unsigned int m_schemaVersion,m_grammarVersion;
+        SharedGrammars* m_grammars;
+        bool m_compiling;
 
         bool m_namespaceAware,m_schemaAware;
-        std::stack<xercesc::DOMLSParser*> m_pool;
+        std::stack<PooledParser*> m_pool;
+        std::set<ThreadCache*> m_caches;
+        unsigned int m_maxIdle,m_maxActive,m_active,m_waiters;
+        unsigned long m_created,m_reused,m_waited,m_id;
         boost::scoped_ptr<Mutex> m_lock;
+        boost::scoped_ptr<CondWait> m_available;
         boost::scoped_ptr<xercesc::SecurityManager> m_security;
+
+        std::map< xstring,boost::shared_ptr<const std::string> > m_resources;
+        std::set<xstring> m_blockedResources;
+        size_t m_resourceBytes;
+        boost::scoped_ptr<RWLock> m_resourceLock;
     };
 
     /**
@@ -36,12 +36,18 @@ namespace {
 
 namespace xmltooling {
     XMLTOOL_DLLLOCAL PluginManager<StorageService,string,const xercesc::DOMElement*>::Factory MemoryStorageServiceFactory; 
+#if defined(WIN32) || defined(HAVE_SYS_MMAN_H)
+    XMLTOOL_DLLLOCAL PluginManager<StorageService,string,const xercesc::DOMElement*>::Factory MappedStorageServiceFactory;
+#endif
 };
 
 void XMLTOOL_API xmltooling::registerStorageServices()
 {
     XMLToolingConfig& conf=XMLToolingConfig::getConfig();
     conf.StorageServiceManager.registerFactory(MEMORY_STORAGE_SERVICE, MemoryStorageServiceFactory);
+#if defined(WIN32) || defined(HAVE_SYS_MMAN_H)
+    conf.StorageServiceManager.registerFactory(MAPPED_STORAGE_SERVICE, MappedStorageServiceFactory);
+#endif
 }
 
 StorageService::StorageService()
@@ -57,6 +63,11 @@ const StorageService::Capabilities& StorageService::getCapabilities() const
     return g_ssCaps;
 }
 
+bool StorageService::getUsage(Usage& usage, const char* context) const
+{
+    return false;
+}
+
 StorageService::Capabilities::Capabilities(unsigned int contextSize, unsigned int keySize, unsigned int stringSize)
     : m_contextSize(contextSize), m_keySize(keySize), m_stringSize(stringSize)
 {
@@ -239,6 +239,27 @@ namespace xmltooling {
          */
         virtual void deleteContext(const char* context)=0;
 
+        /**
+         * Resource usage of the whole service or of a single context.
+         */
+        struct Usage {
+            Usage() : records(0), bytes(0) {}
+            /** Number of records held. */
+            unsigned long records;
+            /** Approximate memory held by those records, in bytes. */
+            unsigned long bytes;
+        };
+
+        /**
+         * Reports current resource usage, if the implementation keeps track of it.
+         * <p>The default implementation reports nothing and returns false.
+         *
+         * @param usage     populated with the current usage
+         * @param context   a storage context label, or nullptr for the whole service
+         * @return  true iff usage was reported
+         */
+        virtual bool getUsage(Usage& usage, const char* context=nullptr) const;
+
     protected:
         StorageService();
     };
@@ -250,6 +271,9 @@ namespace xmltooling {
 
     /** StorageService based on in-memory caching. */
     #define MEMORY_STORAGE_SERVICE  "Memory"
+
+    /** StorageService based on a memory-mapped log file that survives restarts. */
+    #define MAPPED_STORAGE_SERVICE  "Mapped"
 };
 
 #endif /* __xmltooling_storage_h__ */
@@ -29,17 +29,20 @@
 #include "exceptions.h"
 #include "QName.h"
 #include "XMLObject.h"
+#include "util/Threads.h"
 #include "util/XMLHelper.h"
+#include "util/ZlibCodec.h"
 #include "util/XMLConstants.h"
 
+#include <algorithm>
 #include <strstream>
 #include <boost/lambda/bind.hpp>
 #include <boost/lambda/if.hpp>
 #include <boost/lambda/lambda.hpp>
 
-#include <xercesc/framework/MemBufFormatTarget.hpp>
+#include <xercesc/framework/XMLFormatter.hpp>
+#include <xercesc/util/PlatformUtils.hpp>
 #include <xercesc/util/XMLUniDefs.hpp>
-#include <zlib.h>
 
 using namespace xmltooling::logging;
 using namespace xmltooling;
@@ -97,42 +100,124 @@ DOMAttr* XMLHelper::getIdAttribute(const DOMElement* domElement)
     return nullptr;
 }
 
-const XMLObject* XMLHelper::getXMLObjectById(const XMLObject& tree, const XMLCh* id)
-{
-    if (XMLString::equals(id, tree.getXMLID()))
-        return &tree;
-    
-    const XMLObject* ret;
-    const list<XMLObject*>& children = tree.getOrderedChildren();
-    for (list<XMLObject*>::const_iterator i = children.begin(); i != children.end(); ++i) {
-        if (*i) {
-            ret = getXMLObjectById(*(*i), id);
-            if (ret)
-                return ret;
+namespace {
+    // FNV-1a over the UTF-16 code units.
+    unsigned int hashID(const XMLCh* id)
+    {
+        unsigned int h = 2166136261U;
+        while (*id) {
+            h ^= static_cast<unsigned int>(*id++);
+            h *= 16777619U;
         }
+        return h;
+    }
+
+    const XMLObject* searchXMLObjectById(const XMLObject& tree, const XMLCh* id)
+    {
+        if (XMLString::equals(id, tree.getXMLID()))
+            return &tree;
+
+        const XMLObject* ret;
+        const list<XMLObject*>& children = tree.getOrderedChildren();
+        for (list<XMLObject*>::const_iterator i = children.begin(); i != children.end(); ++i) {
+            if (*i) {
+                ret = searchXMLObjectById(*(*i), id);
+                if (ret)
+                    return ret;
+            }
+        }
+
+        return nullptr;
+    }
+};
+
+IDIndex::IDIndex(const XMLObject& tree)
+{
+    collect(tree);
+
+    // Chain the entries in reverse so that each bucket starts with its earliest entry.
+    vector<int>::size_type size = 16;
+    while (size < m_entries.size() * 2)
+        size *= 2;
+    m_buckets.assign(size, -1);
+    for (int i = static_cast<int>(m_entries.size()) - 1; i >= 0; --i) {
+        int& head = m_buckets[m_entries[i].hash & (size - 1)];
+        m_entries[i].next = head;
+        head = i;
     }
-    
-    return nullptr;
 }
 
-XMLObject* XMLHelper::getXMLObjectById(XMLObject& tree, const XMLCh* id)
+void IDIndex::collect(const XMLObject& obj)
 {
-    if (XMLString::equals(id, tree.getXMLID()))
-        return &tree;
+    const XMLCh* id = obj.getXMLID();
+    if (id && *id) {
+        Entry e;
+        e.hash = hashID(id);
+        e.next = -1;
+        e.id = id;
+        e.obj = &obj;
+        m_entries.push_back(e);
+    }
 
-    XMLObject* ret;
-    const list<XMLObject*>& children = tree.getOrderedChildren();
+    const list<XMLObject*>& children = obj.getOrderedChildren();
     for (list<XMLObject*>::const_iterator i = children.begin(); i != children.end(); ++i) {
-        if (*i) {
-            ret = getXMLObjectById(*(*i), id);
-            if (ret)
-                return ret;
-        }
+        if (*i)
+            collect(*(*i));
+    }
+}
+
+const XMLObject* IDIndex::find(const XMLCh* id) const
+{
+    unsigned int h = hashID(id);
+    for (int i = m_buckets[h & (m_buckets.size() - 1)]; i != -1; i = m_entries[i].next) {
+        if (m_entries[i].hash == h && XMLString::equals(m_entries[i].id, id))
+            return m_entries[i].obj;
     }
-    
     return nullptr;
 }
 
+const XMLObject* XMLHelper::getXMLObjectById(const XMLObject& tree, const XMLCh* id)
+{
+    // An empty ID can only match an object without one, which the index doesn't track.
+    if (!id || !*id)
+        return searchXMLObjectById(tree, id);
+
+    // The swap is a no-op that reads the pointer with a full barrier. The first lookup in
+    // an unmodified tree builds its index, and if two threads race to do so, one copy is
+    // discarded.
+    void** slot = reinterpret_cast<void**>(&tree.m_idIndex);
+    IDIndex* index = static_cast<IDIndex*>(XMLPlatformUtils::compareAndSwap(slot, nullptr, nullptr));
+    if (!index) {
+        IDIndex* built = new IDIndex(tree);
+        index = static_cast<IDIndex*>(XMLPlatformUtils::compareAndSwap(slot, built, nullptr));
+        if (index) {
+            delete built;
+        }
+        else {
+            // Only the thread that published the index marks the objects it covers, and
+            // the flags are only read by changes to the tree, which can't run alongside.
+            index = built;
+            vector<const XMLObject*> pending(1, &tree);
+            while (!pending.empty()) {
+                const XMLObject* obj = pending.back();
+                pending.pop_back();
+                obj->m_idIndexed = true;
+                const list<XMLObject*>& children = obj->getOrderedChildren();
+                for (list<XMLObject*>::const_iterator i = children.begin(); i != children.end(); ++i) {
+                    if (*i)
+                        pending.push_back(*i);
+                }
+            }
+        }
+    }
+    return index->find(id);
+}
+
+XMLObject* XMLHelper::getXMLObjectById(XMLObject& tree, const XMLCh* id)
+{
+    return const_cast<XMLObject*>(getXMLObjectById(const_cast<const XMLObject&>(tree), id));
+}
+
 void XMLHelper::getNonVisiblyUsedPrefixes(const XMLObject& tree, map<xstring,xstring>& prefixes)
 {
     map<xstring,xstring> child_prefixes;
@@ -485,30 +570,21 @@ std::string XMLHelper::encode(const char* str)
     return std::string(stream.str());
 }
 
-void XMLHelper::serialize(const DOMNode* n, std::string& buf, bool pretty)
-{
-    static const XMLCh impltype[] = { chLatin_L, chLatin_S, chNull };
-    static const XMLCh UTF8[]={ chLatin_U, chLatin_T, chLatin_F, chDash, chDigit_8, chNull };
-
-    MemBufFormatTarget target;
-    DOMImplementation* impl=DOMImplementationRegistry::getDOMImplementation(impltype);
+namespace {
+    class StringFormatTarget : public XMLFormatTarget
+    {
+    public:
+        StringFormatTarget(std::string& buf) : m_buf(buf) {}
+        ~StringFormatTarget() {}
 
-    DOMLSSerializer* serializer = static_cast<DOMImplementationLS*>(impl)->createLSSerializer();
-    XercesJanitor<DOMLSSerializer> janitor(serializer);
-    if (pretty && serializer->getDomConfig()->canSetParameter(XMLUni::fgDOMWRTFormatPrettyPrint, pretty))
-        serializer->getDomConfig()->setParameter(XMLUni::fgDOMWRTFormatPrettyPrint, pretty);
-    DOMLSOutput *theOutput = static_cast<DOMImplementationLS*>(impl)->createLSOutput();
-    XercesJanitor<DOMLSOutput> j_theOutput(theOutput);
-    theOutput->setEncoding(UTF8);
-    theOutput->setByteStream(&target);
-    if (!serializer->write(n, theOutput))
-        throw XMLParserException("unable to serialize XML");
+        void writeChars(const XMLByte *const toWrite, const XMLSize_t count, XMLFormatter *const formatter) {
+            m_buf.append(reinterpret_cast<const char*>(toWrite),count);
+        }
 
-    buf.erase();
-    buf.append(reinterpret_cast<const char*>(target.getRawBuffer()),target.getLen());
-}
+    private:
+        std::string& m_buf;
+    };
 
-namespace {
     class StreamFormatTarget : public XMLFormatTarget
     {
     public:
@@ -526,27 +602,136 @@ namespace {
     private:
         std::ostream& m_out;
     };
+
+    // A UTF-8 serializer and output pair, kept by each thread so that serializing doesn't
+    // have to build and configure them every time. The cached ones are tracked so that
+    // library shutdown can release them all before Xerces goes away.
+    class Serializer {
+        MAKE_NONCOPYABLE(Serializer);
+    public:
+        Serializer() : m_serializer(nullptr), m_output(nullptr), m_pretty(false), m_busy(false) {}
+
+        ~Serializer() {
+            if (m_output)
+                m_output->release();
+            if (m_serializer)
+                m_serializer->release();
+        }
+
+        static void write(const DOMNode* n, XMLFormatTarget& target, bool pretty) {
+            Serializer* serializer = s_key ? reinterpret_cast<Serializer*>(s_key->getData()) : nullptr;
+            if (!serializer && s_key) {
+                serializer = new Serializer();
+                Lock lock(s_lock);
+                s_cached->insert(serializer);
+                s_key->setData(serializer);
+            }
+            if (!serializer || serializer->m_busy) {
+                // A nested call on this thread, or one made before the library is
+                // initialized, gets a serializer of its own.
+                Serializer temp;
+                temp.serialize(n, target, pretty);
+            }
+            else {
+                serializer->serialize(n, target, pretty);
+            }
+        }
+
+        static void destroy(void* data) {
+            if (data) {
+                Lock lock(s_lock);
+                s_cached->erase(reinterpret_cast<Serializer*>(data));
+            }
+            delete reinterpret_cast<Serializer*>(data);
+        }
+
+        static ThreadKey* s_key;
+        static Mutex* s_lock;
+        static set<Serializer*>* s_cached;
+
+    private:
+        void serialize(const DOMNode* n, XMLFormatTarget& target, bool pretty) {
+            static const XMLCh impltype[] = { chLatin_L, chLatin_S, chNull };
+            static const XMLCh UTF8[]={ chLatin_U, chLatin_T, chLatin_F, chDash, chDigit_8, chNull };
+
+            if (!m_serializer) {
+                DOMImplementation* impl=DOMImplementationRegistry::getDOMImplementation(impltype);
+                m_serializer = static_cast<DOMImplementationLS*>(impl)->createLSSerializer();
+                m_output = static_cast<DOMImplementationLS*>(impl)->createLSOutput();
+                m_output->setEncoding(UTF8);
+            }
+            if (pretty != m_pretty) {
+                if (!pretty || m_serializer->getDomConfig()->canSetParameter(XMLUni::fgDOMWRTFormatPrettyPrint, pretty))
+                    m_serializer->getDomConfig()->setParameter(XMLUni::fgDOMWRTFormatPrettyPrint, pretty);
+                m_pretty = pretty;
+            }
+
+            bool written = false;
+            m_busy = true;
+            m_output->setByteStream(&target);
+            try {
+                written = m_serializer->write(n, m_output);
+            }
+            catch (...) {
+                m_output->setByteStream(nullptr);
+                m_busy = false;
+                throw;
+            }
+            m_output->setByteStream(nullptr);
+            m_busy = false;
+            if (!written)
+                throw XMLParserException("unable to serialize XML");
+        }
+
+        DOMLSSerializer* m_serializer;
+        DOMLSOutput* m_output;
+        bool m_pretty,m_busy;
+    };
+
+    ThreadKey* Serializer::s_key = nullptr;
+    Mutex* Serializer::s_lock = nullptr;
+    set<Serializer*>* Serializer::s_cached = nullptr;
 };
 
-ostream& XMLHelper::serialize(const DOMNode* n, ostream& out, bool pretty)
+void xmltooling::initSerializers()
 {
-    static const XMLCh impltype[] = { chLatin_L, chLatin_S, chNull };
-    static const XMLCh UTF8[]={ chLatin_U, chLatin_T, chLatin_F, chDash, chDigit_8, chNull };
+    Serializer::s_lock = Mutex::create();
+    Serializer::s_cached = new set<Serializer*>();
+    Serializer::s_key = ThreadKey::create(&Serializer::destroy);
+}
 
-    StreamFormatTarget target(out);
-    DOMImplementation* impl=DOMImplementationRegistry::getDOMImplementation(impltype);
-
-    DOMLSSerializer* serializer = static_cast<DOMImplementationLS*>(impl)->createLSSerializer();
-    XercesJanitor<DOMLSSerializer> janitor(serializer);
-    if (pretty && serializer->getDomConfig()->canSetParameter(XMLUni::fgDOMWRTFormatPrettyPrint, pretty))
-        serializer->getDomConfig()->setParameter(XMLUni::fgDOMWRTFormatPrettyPrint, pretty);
-    DOMLSOutput *theOutput = static_cast<DOMImplementationLS*>(impl)->createLSOutput();
-    XercesJanitor<DOMLSOutput> j_theOutput(theOutput);
-    theOutput->setEncoding(UTF8);
-    theOutput->setByteStream(&target);
-    if (!serializer->write(n, theOutput))
-        throw XMLParserException("unable to serialize XML");
+void xmltooling::termSerializers()
+{
+    // Deleting the key doesn't clean up any thread's serializer, and those left on
+    // other threads can't be released once Xerces is shut down, so they all go now.
+    Serializer::s_key->setData(nullptr);
+    delete Serializer::s_key;
+    Serializer::s_key = nullptr;
+    set<Serializer*> cached;
+    {
+        Lock lock(Serializer::s_lock);
+        cached.swap(*Serializer::s_cached);
+    }
+    for_each(cached.begin(), cached.end(), xmltooling::cleanup<Serializer>());
+    delete Serializer::s_cached;
+    Serializer::s_cached = nullptr;
+    delete Serializer::s_lock;
+    Serializer::s_lock = nullptr;
+}
+
+void XMLHelper::serialize(const DOMNode* n, std::string& buf, bool pretty)
+{
+    // Output is only handed to the caller once it's complete.
+    string temp;
+    StringFormatTarget target(temp);
+    Serializer::write(n, target, pretty);
+    buf.swap(temp);
+}
 
+ostream& XMLHelper::serialize(const DOMNode* n, ostream& out, bool pretty)
+{
+    StreamFormatTarget target(out);
+    Serializer::write(n, target, pretty);
     return out;
 }
 
@@ -566,111 +751,39 @@ ostream& xmltooling::operator<<(ostream& ostr, const XMLObject& obj)
     }
 }
 
-namespace {
-    extern "C" {
-        voidpf saml_zalloc(void* opaque, uInt items, uInt size)
-        {
-            return malloc(items*size);
-        }
-
-        void saml_zfree(void* opaque, voidpf addr)
-        {
-            free(addr);
-        }
-    };
-};
-
 char* XMLHelper::deflate(char* in, unsigned int in_len, unsigned int* out_len)
 {
-    z_stream z;
-    memset(&z, 0, sizeof(z_stream));
-
-    z.zalloc = saml_zalloc;
-    z.zfree = saml_zfree;
-    z.opaque = nullptr;
-    z.next_in = (Bytef*)in;
-    z.avail_in = in_len;
     *out_len = 0;
-
-    int ret = deflateInit2(&z, 9, Z_DEFLATED, -15, 9, Z_DEFAULT_STRATEGY);
-    if (ret != Z_OK) {
-        Category::getInstance(XMLTOOLING_LOGCAT ".XMLHelper").error("zlib deflateInit2 failed with error code (%d)", ret);
-        return nullptr;
+    try {
+        ZlibCodec& codec = ZlibCodec::getCodec(ZlibCodec::DEFLATE);
+        codec.setParameters(9);
+        string buf;
+        codec.update(in, in_len, buf);
+        codec.finish(buf);
+
+        char* out = new char[buf.length()];
+        memcpy(out, buf.data(), buf.length());
+        *out_len = buf.length();
+        return out;
     }
-
-    int dlen = in_len + (in_len >> 8) + 12;  /* orig_size * 1.001 + 12 */
-    char* out = new char[dlen];
-    z.next_out = (Bytef*)out;
-    z.avail_out = dlen;
-
-    ret = ::deflate(&z, Z_FINISH);
-    if (ret != Z_STREAM_END) {
-        deflateEnd(&z);
-        Category::getInstance(XMLTOOLING_LOGCAT ".XMLHelper").error("zlib deflateInit2 failed with error code (%d)", ret);
-        delete[] out;
+    catch (const IOException& ex) {
+        Category::getInstance(XMLTOOLING_LOGCAT ".XMLHelper").error("zlib deflate failed: %s", ex.what());
     }
-
-    *out_len = z.total_out;
-    deflateEnd(&z);
-    return out;
+    return nullptr;
 }
 
 unsigned int XMLHelper::inflate(char* in, unsigned int in_len, ostream& out)
 {
-    z_stream z;
-    memset(&z, 0, sizeof(z_stream));
-
-    z.zalloc = saml_zalloc;
-    z.zfree = saml_zfree;
-    z.opaque = nullptr;
-    z.next_in = (Bytef*)in;
-    z.avail_in = in_len;
-
-    int dlen = in_len << 3;  /* guess inflated size: orig_size * 8 */
-    Byte* buf = new Byte[dlen];
-    memset(buf, 0, dlen);
-    z.next_out = buf;
-    z.avail_out = dlen;
-
-    int ret = inflateInit2(&z, -15);
-    if (ret != Z_OK) {
-        Category::getInstance(XMLTOOLING_LOGCAT ".XMLHelper").error("zlib inflateInit2 failed with error code (%d)", ret);
-        delete[] buf;
-        return 0;
-    }
-
-    size_t diff;
-    int iter = 30;
-    while (--iter) {  /* Make sure we can never be caught in infinite loop */
-        ret = ::inflate(&z, Z_SYNC_FLUSH);
-        switch (ret) {
-        case Z_STREAM_END:
-            diff = z.next_out - buf;
-            z.next_out = buf;
-            while (diff--)
-                out << *(z.next_out++);
-            goto done;
-
-        case Z_OK:  /* avail_out should be 0 now. Time to dump the buffer. */
-            diff = z.next_out - buf;
-            z.next_out = buf;
-            while (diff--)
-                out << *(z.next_out++);
-            memset(buf, 0, dlen);
-            z.next_out = buf;
-            z.avail_out = dlen;
-            break;
-
-        default:
-            delete[] buf;
-            inflateEnd(&z);
-            Category::getInstance(XMLTOOLING_LOGCAT ".XMLHelper").error("zlib inflate failed with error code (%d)", ret);
-            return 0;
-        }
+    try {
+        // Expansion is bounded about where it always was, for protection against compression bombs.
+        ZlibCodec& codec = ZlibCodec::getCodec(ZlibCodec::INFLATE);
+        codec.setOutputLimit(static_cast<size_t>(in_len) * XMLTOOLING_INFLATE_RATIO);
+        codec.update(in, in_len, out);
+        codec.finish(out);
+        return codec.getTotalOut();
+    }
+    catch (const IOException& ex) {
+        Category::getInstance(XMLTOOLING_LOGCAT ".XMLHelper").error("zlib inflate failed: %s", ex.what());
     }
-done:
-    delete[] buf;
-    int out_len = z.total_out;
-    inflateEnd(&z);
-    return out_len;
+    return 0;
 }
@@ -522,8 +522,11 @@ namespace xmltooling {
 
         void push_back(const_reference _Val) {
             setParent(_Val);
-            if (m_list)
-                m_list->insert(m_fence,_Val);
+            if (m_list) {
+                XMLObject* child = _Val;
+                child->m_slot = m_list->insert(m_fence,_Val);
+                child->m_slotted = true;
+            }
             m_container.push_back(_Val);
         }
 
@@ -567,6 +570,13 @@ namespace xmltooling {
         }
 
         void removeChild(const_reference _Val) {
+            XMLObject* child = _Val;
+            if (child->m_slotted) {
+                // The child knows its own position, so no need to search for it.
+                m_list->erase(child->m_slot);
+                delete _Val;
+                return;
+            }
             for (typename std::list<_Ty*>::iterator i=m_list->begin(); i!=m_list->end(); i++) {
                 if ((*i)==_Val) {
                     m_list->erase(i);
@@ -677,7 +687,9 @@ namespace xmltooling {
         void push_back(const_reference _Val) {
             setParent(_Val);
             if (m_list) {
-                m_list->insert(m_fence,_Val.first);
+                XMLObject* child = _Val.first;
+                child->m_slot = m_list->insert(m_fence,_Val.first);
+                child->m_slotted = true;
                 m_list->insert(m_fence,_Val.second);
             }
             m_container.push_back(_Val);
@@ -731,6 +743,16 @@ namespace xmltooling {
         }
 
         void removeChild(const_reference _Val) {
+            XMLObject* child = _Val.first;
+            if (child->m_slotted) {
+                // The second half of the pair always follows the first.
+                typename std::list<_Ty*>::iterator i=child->m_slot;
+                m_list->erase(i++);
+                m_list->erase(i);
+                delete _Val.first;
+                delete _Val.second;
+                return;
+            }
             for (typename std::list<_Ty*>::iterator i=m_list->begin(); i!=m_list->end(); i++) {
                 if ((*i)==_Val.first) {
                     typename std::list<_Ty*>::iterator j=i++;
@@ -0,0 +1,250 @@
+/**
+ * Licensed to the University Corporation for Advanced Internet
+ * Development, Inc. (UCAID) under one or more contributor license
+ * agreements. See the NOTICE file distributed with this work for
+ * additional information regarding copyright ownership.
+ *
+ * UCAID licenses this file to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file except
+ * in compliance with the License. You may obtain a copy of the
+ * License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ */
+
+/**
+ * ZlibCodec.cpp
+ *
+ * Raw deflate and inflate streams with reusable zlib state.
+ */
+
+#include "internal.h"
+#include "exceptions.h"
+#include "util/Threads.h"
+#include "util/ZlibCodec.h"
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <boost/lexical_cast.hpp>
+#include <zlib.h>
+
+using namespace xmltooling;
+using namespace std;
+
+namespace {
+    // Size of the buffer output is produced into before being handed on.
+    const size_t ZLIB_CHUNK = 16384;
+
+    // Largest piece of input given to zlib at once, which counts in uInt.
+    const size_t ZLIB_MAX_INPUT = 1 << 30;
+
+    // The codecs kept by a thread, created on first use.
+    struct ThreadCodecs {
+        ThreadCodecs() : deflater(nullptr), inflater(nullptr) {}
+        ~ThreadCodecs() {
+            delete deflater;
+            delete inflater;
+        }
+        ZlibCodec* deflater;
+        ZlibCodec* inflater;
+    };
+
+    // Created by library initialization. Every thread's codecs are tracked so that
+    // library shutdown can free them all.
+    ThreadKey* g_codecs = nullptr;
+    Mutex* g_codecLock = nullptr;
+    set<ThreadCodecs*>* g_threadCodecs = nullptr;
+
+    void destroyCodecs(void* data) {
+        if (data) {
+            Lock lock(g_codecLock);
+            g_threadCodecs->erase(reinterpret_cast<ThreadCodecs*>(data));
+        }
+        delete reinterpret_cast<ThreadCodecs*>(data);
+    }
+};
+
+void xmltooling::initZlibCodecs()
+{
+    g_codecLock = Mutex::create();
+    g_threadCodecs = new set<ThreadCodecs*>();
+    g_codecs = ThreadKey::create(&destroyCodecs);
+}
+
+void xmltooling::termZlibCodecs()
+{
+    // Deleting the key doesn't clean up any thread's codecs, so they all go now.
+    g_codecs->setData(nullptr);
+    delete g_codecs;
+    g_codecs = nullptr;
+    set<ThreadCodecs*> codecs;
+    {
+        Lock lock(g_codecLock);
+        codecs.swap(*g_threadCodecs);
+    }
+    for_each(codecs.begin(), codecs.end(), xmltooling::cleanup<ThreadCodecs>());
+    delete g_threadCodecs;
+    g_threadCodecs = nullptr;
+    delete g_codecLock;
+    g_codecLock = nullptr;
+}
+
+ZlibCodec::ZlibCodec(Mode mode, int level, int strategy)
+    : m_mode(mode), m_level(level), m_strategy(strategy), m_limit(0), m_finished(false), m_pending(false), m_stream(nullptr), m_buf(nullptr)
+{
+    z_stream* z = new z_stream;
+    memset(z, 0, sizeof(z_stream));
+    int ret = (m_mode == DEFLATE) ? deflateInit2(z, m_level, Z_DEFLATED, -15, 9, m_strategy) : inflateInit2(z, -15);
+    if (ret != Z_OK) {
+        delete z;
+        throw IOException("zlib stream initialization failed with error code ($1).", params(1, boost::lexical_cast<string>(ret).c_str()));
+    }
+    m_stream = z;
+    m_buf = new char[ZLIB_CHUNK];
+}
+
+ZlibCodec::~ZlibCodec()
+{
+    z_stream* z = reinterpret_cast<z_stream*>(m_stream);
+    if (m_mode == DEFLATE)
+        deflateEnd(z);
+    else
+        inflateEnd(z);
+    delete z;
+    delete[] m_buf;
+}
+
+void ZlibCodec::setParameters(int level, int strategy)
+{
+    if (m_mode != DEFLATE || (level == m_level && strategy == m_strategy))
+        return;
+    m_level = level;
+    m_strategy = strategy;
+    z_stream* z = reinterpret_cast<z_stream*>(m_stream);
+    if (z->total_in == 0 && !m_finished)
+        deflateParams(z, m_level, m_strategy);
+    else
+        m_pending = true;
+}
+
+void ZlibCodec::setOutputLimit(size_t limit)
+{
+    m_limit = limit;
+}
+
+void ZlibCodec::update(const char* in, size_t len, string& out)
+{
+    process(in, len, false, &out, nullptr);
+}
+
+void ZlibCodec::update(const char* in, size_t len, ostream& out)
+{
+    process(in, len, false, nullptr, &out);
+}
+
+void ZlibCodec::finish(string& out)
+{
+    process(nullptr, 0, true, &out, nullptr);
+}
+
+void ZlibCodec::finish(ostream& out)
+{
+    process(nullptr, 0, true, nullptr, &out);
+}
+
+size_t ZlibCodec::getTotalOut() const
+{
+    return reinterpret_cast<const z_stream*>(m_stream)->total_out;
+}
+
+void ZlibCodec::reset()
+{
+    z_stream* z = reinterpret_cast<z_stream*>(m_stream);
+    if (m_mode == DEFLATE) {
+        deflateReset(z);
+        if (m_pending) {
+            deflateParams(z, m_level, m_strategy);
+            m_pending = false;
+        }
+    }
+    else {
+        inflateReset(z);
+    }
+    m_finished = false;
+}
+
+void ZlibCodec::process(const char* in, size_t len, bool finish, string* str, ostream* os)
+{
+    if (m_finished) {
+        if (m_mode == DEFLATE && len > 0)
+            throw IOException("Data fed to a finished deflate stream.");
+        return;
+    }
+
+    z_stream* z = reinterpret_cast<z_stream*>(m_stream);
+    do {
+        size_t piece = (len > ZLIB_MAX_INPUT) ? ZLIB_MAX_INPUT : len;
+        z->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+        z->avail_in = static_cast<uInt>(piece);
+        in += piece;
+        len -= piece;
+        int flush = (finish && len == 0) ? Z_FINISH : Z_NO_FLUSH;
+
+        for (;;) {
+            z->next_out = reinterpret_cast<Bytef*>(m_buf);
+            z->avail_out = static_cast<uInt>(ZLIB_CHUNK);
+            int ret = (m_mode == DEFLATE) ? ::deflate(z, flush) : ::inflate(z, flush);
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+                throw IOException("zlib stream failed with error code ($1).", params(1, boost::lexical_cast<string>(ret).c_str()));
+
+            size_t produced = ZLIB_CHUNK - z->avail_out;
+            if (m_limit > 0 && z->total_out > m_limit)
+                throw IOException("zlib stream output exceeded limit of ($1) bytes.", params(1, boost::lexical_cast<string>(m_limit).c_str()));
+            if (produced > 0) {
+                if (str)
+                    str->append(m_buf, produced);
+                else
+                    os->write(m_buf, produced);
+            }
+            if (ret == Z_STREAM_END) {
+                m_finished = true;
+                return;
+            }
+            // Stop once zlib has room left over, so it has consumed everything it can.
+            if (z->avail_out != 0 && (z->avail_in == 0 || ret == Z_BUF_ERROR))
+                break;
+        }
+    } while (len > 0);
+
+    if (finish && !m_finished)
+        throw IOException("Compressed data ended prematurely.");
+}
+
+ZlibCodec& ZlibCodec::getCodec(Mode mode)
+{
+    ThreadCodecs* codecs = reinterpret_cast<ThreadCodecs*>(g_codecs->getData());
+    if (!codecs) {
+        codecs = new ThreadCodecs();
+        Lock lock(g_codecLock);
+        g_threadCodecs->insert(codecs);
+        g_codecs->setData(codecs);
+    }
+    ZlibCodec*& codec = (mode == DEFLATE) ? codecs->deflater : codecs->inflater;
+    if (!codec) {
+        codec = new ZlibCodec(mode);
+    }
+    else {
+        // Settings made by the last caller don't carry over.
+        codec->reset();
+        codec->setParameters(-1, 0);
+        codec->setOutputLimit(0);
+    }
+    return *codec;
+}
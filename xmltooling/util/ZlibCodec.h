@@ -0,0 +1,181 @@
+/**
+ * Licensed to the University Corporation for Advanced Internet
+ * Development, Inc. (UCAID) under one or more contributor license
+ * agreements. See the NOTICE file distributed with this work for
+ * additional information regarding copyright ownership.
+ *
+ * UCAID licenses this file to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file except
+ * in compliance with the License. You may obtain a copy of the
+ * License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ */
+
+/**
+ * @file xmltooling/util/ZlibCodec.h
+ *
+ * Raw deflate and inflate streams with reusable zlib state.
+ */
+
+#ifndef __xmltooling_zlib_h__
+#define __xmltooling_zlib_h__
+
+#include <xmltooling/base.h>
+
+#include <iostream>
+#include <string>
+
+namespace xmltooling {
+
+    /**
+     * Compresses or decompresses a raw (RFC 1951) deflate stream.
+     *
+     * <p>Input is fed in pieces with update() and the stream is ended with finish().
+     * Output is appended to a string or written to a stream in blocks as it is produced.
+     * reset() readies the codec for another stream without reallocating zlib's state,
+     * and getCodec() supplies codecs kept by the calling thread for that purpose.
+     */
+    class XMLTOOL_API ZlibCodec
+    {
+        MAKE_NONCOPYABLE(ZlibCodec);
+    public:
+        /** Direction of a codec. */
+        enum Mode {
+            DEFLATE,    ///< compresses its input
+            INFLATE     ///< decompresses its input
+        };
+
+        /**
+         * Constructor.
+         *
+         * @param mode      direction of the codec
+         * @param level     zlib compression level, 0 to 9, or -1 for zlib's default (deflate only)
+         * @param strategy  zlib compression strategy, 0 for zlib's default (deflate only)
+         */
+        ZlibCodec(Mode mode, int level=-1, int strategy=0);
+
+        ~ZlibCodec();
+
+        /**
+         * Returns the direction of the codec.
+         *
+         * @return  the codec's mode
+         */
+        Mode getMode() const {
+            return m_mode;
+        }
+
+        /**
+         * Changes the compression level and strategy of a deflating codec.
+         *
+         * <p>The change applies at once if no input has been fed to the current stream,
+         * and from the next stream otherwise.
+         *
+         * @param level     zlib compression level, 0 to 9, or -1 for zlib's default
+         * @param strategy  zlib compression strategy, 0 for zlib's default
+         */
+        void setParameters(int level, int strategy=0);
+
+        /**
+         * Bounds the output the current stream may produce.
+         *
+         * <p>A stream that would go past the limit fails instead, which guards inflation
+         * of untrusted input against excessive expansion.
+         *
+         * @param limit maximum number of bytes of output, or 0 for no limit
+         */
+        void setOutputLimit(size_t limit);
+
+        /**
+         * Feeds input to the stream, appending whatever output it produces.
+         *
+         * @param in    input data
+         * @param len   length of input data
+         * @param out   buffer to append output to
+         * @throws IOException thrown if zlib reports an error
+         */
+        void update(const char* in, size_t len, std::string& out);
+
+        /**
+         * Feeds input to the stream, writing whatever output it produces.
+         *
+         * @param in    input data
+         * @param len   length of input data
+         * @param out   stream to write output to
+         * @throws IOException thrown if zlib reports an error
+         */
+        void update(const char* in, size_t len, std::ostream& out);
+
+        /**
+         * Ends the stream, appending the remaining output.
+         *
+         * @param out   buffer to append output to
+         * @throws IOException thrown if zlib reports an error or compressed input was incomplete
+         */
+        void finish(std::string& out);
+
+        /**
+         * Ends the stream, writing the remaining output.
+         *
+         * @param out   stream to write output to
+         * @throws IOException thrown if zlib reports an error or compressed input was incomplete
+         */
+        void finish(std::ostream& out);
+
+        /**
+         * Returns true iff the end of the stream has been reached.
+         *
+         * <p>An inflating codec ignores any input fed to it after this point.
+         *
+         * @return  true iff the stream has ended
+         */
+        bool isFinished() const {
+            return m_finished;
+        }
+
+        /**
+         * Returns the number of bytes produced by the current stream.
+         *
+         * @return  total output length
+         */
+        size_t getTotalOut() const;
+
+        /**
+         * Readies the codec for a new stream, keeping its zlib state allocated.
+         */
+        void reset();
+
+        /**
+         * Returns a codec kept by the calling thread, reset and ready for a new stream.
+         *
+         * <p>The codec is returned to zlib's default level and strategy with no output
+         * limit, whatever the previous caller set. The same codec is returned on each call
+         * from a thread, so it must not be held across a call that may obtain it again.
+         * The library must be initialized.
+         *
+         * @param mode  direction of the codec
+         * @return  the calling thread's codec
+         */
+        static ZlibCodec& getCodec(Mode mode);
+
+    private:
+        void process(const char* in, size_t len, bool finish, std::string* str, std::ostream* os);
+
+        Mode m_mode;
+        int m_level,m_strategy;
+        size_t m_limit;
+        bool m_finished,m_pending;
+        void* m_stream;
+        char* m_buf;
+    };
+
+};
+
+#endif /* __xmltooling_zlib_h__ */
@@ -20,6 +20,7 @@
 
 #include "XMLObjectBaseTestCase.h"
 
+#include <xmltooling/util/DateTimeValue.h>
 #include <xercesc/util/XMLDateTime.hpp>
 
 class DateTimeTest : public CxxTest::TestSuite {
@@ -60,4 +61,62 @@ public:
         auto_ptr_char d4(dt4.getRawData());
         TSM_ASSERT("ISO string for negative 8 hours did not match.", !strcmp(d4.get(), "-P0DT8H3M20S"));
     }
+
+    void testDateTimeValue() {
+        static const char* values[] = {
+            "1970-01-31T00:00:00Z", "2008-11-21T02:22:52Z", "2000-02-29T23:59:59.999Z",
+            "2012-06-30T18:30:00+05:30", "1969-12-31T20:00:00-04:00", "2038-01-19T03:14:08", nullptr
+        };
+        for (const char** v = values; *v; ++v) {
+            auto_ptr_XMLCh ts(*v);
+            XMLDateTime dt(ts.get());
+            dt.parseDateTime();
+            DateTimeValue val;
+            val.set(ts.get());
+            TSM_ASSERT_EQUALS(*v, dt.getEpoch(), val.getEpoch());
+            TSM_ASSERT(*v, XMLString::equals(ts.get(), val.getRawData()));
+        }
+
+        // Forms outside the fast path are handled by Xerces.
+        time_t epoch;
+        auto_ptr_XMLCh longyear("10000-01-01T00:00:00Z");
+        TS_ASSERT(!DateTimeValue::parseDateTime(longyear.get(), epoch));
+        DateTimeValue val;
+        val.set(longyear.get());
+        XMLDateTime dt(longyear.get());
+        dt.parseDateTime();
+        TS_ASSERT_EQUALS(dt.getEpoch(), val.getEpoch());
+
+        auto_ptr_XMLCh bad("2008-02-30T00:00:00Z");
+        TS_ASSERT_THROWS(val.set(bad.get()), XMLObjectException);
+
+        val.set(static_cast<time_t>(1227234172));
+        auto_ptr_char ts2(val.getRawData());
+        TSM_ASSERT("ISO string for Nov 21, 2008 02:22:52 did not match.", !strcmp(ts2.get(), "2008-11-21T02:22:52Z"));
+        val.clear();
+        TS_ASSERT(val.empty());
+    }
+
+    void testDurationValue() {
+        static const char* values[] = { "P1D", "PT2H", "P2DT3H4M5S", "PT90M", "PT1.5S", "-PT30S", nullptr };
+        for (const char** v = values; *v; ++v) {
+            auto_ptr_XMLCh d(*v);
+            XMLDateTime dt(d.get());
+            dt.parseDuration();
+            DateTimeValue val;
+            val.set(d.get(), true);
+            TSM_ASSERT_EQUALS(*v, dt.getEpoch(true), val.getEpoch());
+        }
+
+        time_t epoch;
+        auto_ptr_XMLCh months("P1M");
+        TS_ASSERT(!DateTimeValue::parseDuration(months.get(), epoch));
+        auto_ptr_XMLCh empty("PT");
+        TS_ASSERT(!DateTimeValue::parseDuration(empty.get(), epoch));
+
+        DateTimeValue val;
+        val.set(static_cast<time_t>(-29000), true);
+        auto_ptr_char d4(val.getRawData());
+        TSM_ASSERT("ISO string for negative 8 hours did not match.", !strcmp(d4.get(), "-P0DT8H3M20S"));
+    }
 };
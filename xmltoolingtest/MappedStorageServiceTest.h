@@ -0,0 +1,228 @@
+/**
+ * Licensed to the University Corporation for Advanced Internet
+ * Development, Inc. (UCAID) under one or more contributor license
+ * agreements. See the NOTICE file distributed with this work for
+ * additional information regarding copyright ownership.
+ *
+ * UCAID licenses this file to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file except
+ * in compliance with the License. You may obtain a copy of the
+ * License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ */
+
+#include "XMLObjectBaseTestCase.h"
+
+#include <cstdio>
+#include <fstream>
+#include <xmltooling/util/StorageService.h>
+#include <xmltooling/util/Threads.h>
+
+class MappedStorageServiceTest : public CxxTest::TestSuite {
+    string m_path;
+    DOMDocument* m_config;
+
+    StorageService* openStorage(const DOMDocument* config=nullptr) {
+        return XMLToolingConfig::getConfig().StorageServiceManager.newPlugin(
+            MAPPED_STORAGE_SERVICE, (config ? config : m_config)->getDocumentElement(), false
+            );
+    }
+
+    string readLog() {
+        ifstream in(m_path.c_str(), ios::in | ios::binary);
+        return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    }
+
+    void writeLog(const string& data) {
+        ofstream out(m_path.c_str(), ios::out | ios::binary | ios::trunc);
+        out.write(data.data(), data.length());
+    }
+
+    // Damages the last entry in the log, as a crash in the middle of writing it would.
+    void damageTail(bool truncate) {
+        {
+            scoped_ptr<StorageService> storage(openStorage());
+            storage->createString("context", "kept", "value", time(nullptr) + 60);
+            storage->createString("context", "last", "value", time(nullptr) + 60);
+        }
+
+        string data = readLog();
+        size_t last = data.find_last_not_of('\0');
+        TS_ASSERT(last != string::npos);
+        if (truncate) {
+            data.resize(last);
+        }
+        else {
+            data[last] = ~data[last];
+        }
+        writeLog(data);
+
+        {
+            scoped_ptr<StorageService> storage(openStorage());
+            TSM_ASSERT_EQUALS("Record before the damage was lost.", 1, storage->readString("context", "kept"));
+            TSM_ASSERT_EQUALS("Damaged record found in storage.", 0, storage->readString("context", "last"));
+            TS_ASSERT(storage->createString("context", "next", "value", time(nullptr) + 60));
+        }
+
+        // Writes made after recovery survive another restart.
+        scoped_ptr<StorageService> storage(openStorage());
+        string value;
+        TS_ASSERT_EQUALS(1, storage->readString("context", "kept"));
+        TS_ASSERT_EQUALS(1, storage->readString("context", "next", &value));
+        TS_ASSERT_EQUALS(value, "value");
+        TS_ASSERT_EQUALS(0, storage->readString("context", "last"));
+    }
+
+    struct Writer {
+        StorageService* storage;
+        int id;
+        int last[20];
+    };
+
+    static void* writer_fn(void* arg) {
+        // Rewrites its own keys in bursts, so the log keeps growing while compaction runs.
+        Writer* w = reinterpret_cast<Writer*>(arg);
+        char key[32], value[160];
+        int n = 0;
+        for (int burst = 0; burst < 4; ++burst) {
+            for (int i = 0; i < 2000; ++i, ++n) {
+                int k = n % 20;
+                sprintf(key, "writer%d.%d", w->id, k);
+                sprintf(value, "%d:%0128d", w->id, n);
+                if (n < 20)
+                    w->storage->createString("compact", key, value, time(nullptr) + 3600);
+                else
+                    w->storage->updateString("compact", key, value);
+                w->last[k] = n;
+            }
+            Thread::sleep(1);
+        }
+        return nullptr;
+    }
+
+    void checkWriters(StorageService* storage, const Writer* writers) {
+        char key[32], value[160];
+        string data;
+        for (int i = 0; i < 4; ++i) {
+            for (int k = 0; k < 20; ++k) {
+                sprintf(key, "writer%d.%d", i, k);
+                sprintf(value, "%d:%0128d", i, writers[i].last[k]);
+                TS_ASSERT(storage->readString("compact", key, &data) > 0);
+                TSM_ASSERT_EQUALS("Record value doesn't match.", data, value);
+            }
+        }
+    }
+
+public:
+    void setUp() {
+        m_path = data_path + "MappedStorageService.log";
+        std::remove(m_path.c_str());
+        string config = "<StorageService path='" + m_path + "'/>";
+        m_config = XMLToolingConfig::getConfig().getParser().parse(config.c_str(), config.length());
+    }
+
+    void tearDown() {
+        m_config->release();
+        std::remove(m_path.c_str());
+    }
+
+    void testMappedService() {
+        scoped_ptr<StorageService> storage(openStorage());
+
+        string data;
+        TSM_ASSERT_EQUALS("Record found in storage.", 0, storage->readString("context", "foo1", &data));
+        storage->createString("context", "foo1", "bar1", time(nullptr) + 60);
+        storage->createString("context", "foo2", "bar2", time(nullptr) + 60);
+        TSM_ASSERT("Duplicate record created.", !storage->createString("context", "foo2", "bar2", time(nullptr) + 60));
+        TSM_ASSERT_EQUALS("Record not found in storage.", 1, storage->readString("context", "foo1", &data));
+        TSM_ASSERT_EQUALS("Record value doesn't match.", data, "bar1");
+        TSM_ASSERT_EQUALS("Update failed.", 2, storage->updateString("context", "foo2", "bar1", 0, 1));
+        TSM_ASSERT_EQUALS("Stale update succeeded.", -1, storage->updateString("context", "foo2", "bar3", 0, 1));
+        TSM_ASSERT_EQUALS("Record not found in storage.", 2, storage->readString("context", "foo2", &data, nullptr, 1));
+        TSM_ASSERT_EQUALS("Record value doesn't match.", data, "bar1");
+        TSM_ASSERT("Delete failed.", storage->deleteString("context", "foo2"));
+        storage->reap("context");
+    }
+
+    void testRestart() {
+        time_t exp = time(nullptr) + 3600, recorded = 0;
+        {
+            scoped_ptr<StorageService> storage(openStorage());
+            storage->createString("replay", "msg1", "x", time(nullptr) + 60);
+            storage->createString("replay", "msg2", "x", time(nullptr) + 60);
+            storage->createString("session", "s1", "state", time(nullptr) + 60);
+            TS_ASSERT_EQUALS(2, storage->updateString("session", "s1", "newstate"));
+            TS_ASSERT(storage->deleteString("replay", "msg2"));
+            storage->updateContext("replay", exp);
+            storage->createString("discard", "k", "v", time(nullptr) + 60);
+            storage->deleteContext("discard");
+        }
+
+        // Everything written before the restart must still be there.
+        scoped_ptr<StorageService> storage(openStorage());
+        string data;
+        TSM_ASSERT("Replayed message was accepted.", !storage->createString("replay", "msg1", "x", time(nullptr) + 60));
+        TS_ASSERT_EQUALS(1, storage->readString("replay", "msg1", nullptr, &recorded));
+        TS_ASSERT_EQUALS(exp, recorded);
+        TSM_ASSERT_EQUALS("Deleted record found in storage.", 0, storage->readString("replay", "msg2"));
+        TS_ASSERT_EQUALS(2, storage->readString("session", "s1", &data));
+        TS_ASSERT_EQUALS(data, "newstate");
+        TSM_ASSERT_EQUALS("Deleted context found in storage.", 0, storage->readString("discard", "k"));
+
+        StorageService::Usage usage;
+        TS_ASSERT(storage->getUsage(usage));
+        TS_ASSERT_EQUALS(2, usage.records);
+    }
+
+    void testSecondOpen() {
+        scoped_ptr<StorageService> storage(openStorage());
+        TSM_ASSERT_THROWS("Log opened twice.", delete openStorage(), IOException);
+        TS_ASSERT(storage->createString("context", "key", "value", time(nullptr) + 60));
+    }
+
+    void testGarbledTail() {
+        damageTail(false);
+    }
+
+    void testTruncatedTail() {
+        damageTail(true);
+    }
+
+    void testCompaction() {
+        string config = "<StorageService path='" + m_path + "' synchronous='true' cleanupInterval='1' compactionThreshold='65536'/>";
+        DOMDocument* doc = XMLToolingConfig::getConfig().getParser().parse(config.c_str(), config.length());
+        Writer writers[4];
+        size_t written = 0;
+        {
+            scoped_ptr<StorageService> storage(openStorage(doc));
+            vector<Thread*> threads;
+            for (int i = 0; i < 4; ++i) {
+                writers[i].storage = storage.get();
+                writers[i].id = i;
+                threads.push_back(Thread::create(&writer_fn, &writers[i]));
+            }
+            for (vector<Thread*>::iterator t = threads.begin(); t != threads.end(); ++t) {
+                (*t)->join(nullptr);
+                delete *t;
+            }
+            written = 4 * 4 * 2000 * 160;
+
+            // One more pass of the cleanup thread compacts whatever the writers left.
+            Thread::sleep(2);
+            checkWriters(storage.get(), writers);
+        }
+        TSM_ASSERT("Log was not compacted.", readLog().length() < written);
+
+        scoped_ptr<StorageService> storage(openStorage(doc));
+        checkWriters(storage.get(), writers);
+        storage.reset();
+        doc->release();
+    }
+};
@@ -21,6 +21,8 @@
 #include "XMLObjectBaseTestCase.h"
 
 #include <fstream>
+#include <sstream>
+#include <xmltooling/io/StreamingMarshaller.h>
 
 class MarshallingTest : public CxxTest::TestSuite {
 public:
@@ -112,4 +114,171 @@ public:
         doc->release();
     }
 
+    void testChildRemoval() {
+        xmltooling::QName qname(SimpleXMLObject::NAMESPACE,SimpleXMLObject::LOCAL_NAME);
+        const SimpleXMLObjectBuilder* b=dynamic_cast<const SimpleXMLObjectBuilder*>(XMLObjectBuilder::getBuilder(qname));
+        TS_ASSERT(b!=nullptr);
+
+        SimpleXMLObject* sxObject=dynamic_cast<SimpleXMLObject*>(b->buildObject());
+        TS_ASSERT(sxObject!=nullptr);
+        VectorOf(SimpleXMLObject) kids=sxObject->getSimpleXMLObjects();
+        for (int i=0; i<5; ++i)
+            kids.push_back(dynamic_cast<SimpleXMLObject*>(b->buildObject()));
+        SimpleXMLObject* last=kids.back();
+
+        // Removal must keep the ordered list in step with the typed collection.
+        kids.erase(kids.begin()+2);
+        kids.erase(kids.begin()+1);
+        TSM_ASSERT_EQUALS("Number of child elements was not expected value", 3, kids.size());
+        const list<XMLObject*>& ordered=sxObject->getOrderedChildren();
+        list<XMLObject*>::const_iterator o=ordered.begin();
+#ifndef XMLTOOLING_NO_XMLSEC
+        ++o;    // skip the signature slot
+#endif
+        for (VectorOf(SimpleXMLObject)::const_iterator k=kids.begin(); k!=kids.end(); ++k, ++o) {
+            TS_ASSERT(o!=ordered.end());
+            TS_ASSERT_EQUALS(static_cast<XMLObject*>(*k), *o);
+        }
+        TS_ASSERT(o==ordered.end());
+
+        // Detaching pulls the child out of the ordered list before the parent is destroyed.
+        TS_ASSERT_EQUALS(static_cast<XMLObject*>(last), sxObject->getOrderedChildren().back());
+        last->detach();
+        TS_ASSERT(!last->hasParent());
+        delete last;
+    }
+
+    void testSerialization() {
+        string path=data_path + "SimpleXMLObjectWithChildren.xml";
+        ifstream fs(path.c_str());
+        DOMDocument* doc=XMLToolingConfig::getConfig().getParser().parse(fs);
+        TS_ASSERT(doc!=nullptr);
+
+        string plain,pretty,again;
+        XMLHelper::serialize(doc->getDocumentElement(), plain);
+        XMLHelper::serialize(doc->getDocumentElement(), pretty, true);
+        XMLHelper::serialize(doc->getDocumentElement(), again);
+        TSM_ASSERT_EQUALS("Reused serializer kept formatting settings", plain, again);
+
+        ostringstream os;
+        XMLHelper::serialize(doc->getDocumentElement(), os);
+        TSM_ASSERT_EQUALS("Stream and string serialization differ", plain, os.str());
+
+        // Reparsing the pretty form must give the same element.
+        DOMDocument* doc2=XMLToolingConfig::getConfig().getParser().parse(pretty.c_str(), pretty.length());
+        TS_ASSERT(doc2!=nullptr);
+        TS_ASSERT_EQUALS(doc->getDocumentElement()->getChildElementCount(), doc2->getDocumentElement()->getChildElementCount());
+        doc2->release();
+        doc->release();
+    }
+
+    void testStreamingMarshalling() {
+        xmltooling::QName qname(SimpleXMLObject::NAMESPACE,SimpleXMLObject::LOCAL_NAME);
+        const SimpleXMLObjectBuilder* b=dynamic_cast<const SimpleXMLObjectBuilder*>(XMLObjectBuilder::getBuilder(qname));
+        TS_ASSERT(b!=nullptr);
+
+        scoped_ptr<SimpleXMLObject> sxObject(dynamic_cast<SimpleXMLObject*>(b->buildObject()));
+        TS_ASSERT(sxObject.get()!=nullptr);
+        VectorOf(SimpleXMLObject) kids=sxObject->getSimpleXMLObjects();
+        kids.push_back(dynamic_cast<SimpleXMLObject*>(b->buildObject()));
+        kids.push_back(dynamic_cast<SimpleXMLObject*>(b->buildObject()));
+
+        auto_ptr_XMLCh id("Foo \"1\"\t<&>");
+        auto_ptr_XMLCh content("Bar & <Baz> \"Qux\"");
+        kids.front()->setId(id.get());
+        kids.back()->setValue(content.get());
+
+        xmltooling::QName qtype(SimpleXMLObject::NAMESPACE,SimpleXMLObject::TYPE_NAME,SimpleXMLObject::NAMESPACE_PREFIX);
+        kids.push_back(
+            dynamic_cast<SimpleXMLObject*>(
+                b->buildObject(SimpleXMLObject::NAMESPACE,SimpleXMLObject::DERIVED_NAME,SimpleXMLObject::NAMESPACE_PREFIX,&qtype)
+                )
+            );
+
+        StreamingMarshaller marshaller;
+        string streamed;
+        marshaller.marshall(*sxObject, streamed);
+        TSM_ASSERT("Streaming marshaller cached a DOM", sxObject->getDOM()==nullptr);
+        ostringstream os;
+        marshaller.marshall(*sxObject, os);
+
+        string serialized;
+        XMLHelper::serialize(sxObject->marshall(), serialized);
+        TSM_ASSERT_EQUALS("Streamed output did not match serialized DOM", serialized, streamed);
+        TSM_ASSERT_EQUALS("Streamed output did not match serialized DOM", serialized, os.str());
+
+        // With a DOM in place, it's used instead.
+        streamed.erase();
+        marshaller.marshall(*sxObject, streamed);
+        TSM_ASSERT_EQUALS("Streamed output did not match serialized DOM", serialized, streamed);
+    }
+
+    void testStreamingMarshallingWithChildDOM() {
+        string path=data_path + "SimpleXMLObjectWithChildren.xml";
+        ifstream fs(path.c_str());
+        DOMDocument* doc=XMLToolingConfig::getConfig().getParser().parse(fs);
+        TS_ASSERT(doc!=nullptr);
+        const XMLObjectBuilder* b = XMLObjectBuilder::getBuilder(doc->getDocumentElement());
+        TS_ASSERT(b!=nullptr);
+        SimpleXMLObject* child = dynamic_cast<SimpleXMLObject*>(b->buildFromDocument(doc));
+        TS_ASSERT(child!=nullptr);
+
+        // Content the object doesn't know about only survives if the DOM is written as is.
+        auto_ptr_XMLCh extra("Extra");
+        auto_ptr_XMLCh one("1");
+        DOMElement* dom = child->getDOM();
+        dom->setAttributeNS(nullptr, extra.get(), one.get());
+        string expected;
+        XMLHelper::serialize(dom, expected);
+
+        scoped_ptr<SimpleXMLObject> sxObject(SimpleXMLObjectBuilder::buildSimpleXMLObject());
+        sxObject->getSimpleXMLObjects().push_back(child);
+        TSM_ASSERT("Child's DOM was released", child->getDOM()==dom);
+
+        StreamingMarshaller marshaller;
+        string streamed;
+        marshaller.marshall(*sxObject, streamed);
+        TSM_ASSERT("Child's cached DOM was not used", streamed.find(expected)!=string::npos);
+        TSM_ASSERT("Child's DOM was released", child->getDOM()==dom);
+        TSM_ASSERT("Streaming marshaller cached a DOM", sxObject->getDOM()==nullptr);
+    }
+
+    void testStreamingMarshallingWithReparentedDOM() {
+        string path=data_path + "SimpleXMLObjectWithChildren.xml";
+        ifstream fs(path.c_str());
+        DOMDocument* doc=XMLToolingConfig::getConfig().getParser().parse(fs);
+        TS_ASSERT(doc!=nullptr);
+        const XMLObjectBuilder* b = XMLObjectBuilder::getBuilder(doc->getDocumentElement());
+        TS_ASSERT(b!=nullptr);
+        scoped_ptr<SimpleXMLObject> parsed(dynamic_cast<SimpleXMLObject*>(b->buildFromDocument(doc)));
+        TS_ASSERT(parsed.get()!=nullptr);
+
+        // The child's prefix is declared by its old parent, and the new one uses the default namespace.
+        SimpleXMLObject* child = parsed->getSimpleXMLObjects().front();
+        child->detach();
+        parsed.release();   // deleted by detach()
+        DOMElement* dom = child->getDOM();
+        TS_ASSERT(dom!=nullptr);
+        scoped_ptr<SimpleXMLObject> sxObject(
+            dynamic_cast<SimpleXMLObject*>(b->buildObject(SimpleXMLObject::NAMESPACE, SimpleXMLObject::LOCAL_NAME, nullptr))
+            );
+        sxObject->getSimpleXMLObjects().push_back(child);
+
+        StreamingMarshaller marshaller;
+        string streamed;
+        marshaller.marshall(*sxObject, streamed);
+        TSM_ASSERT("Child's DOM was released", child->getDOM()==dom);
+
+        istringstream in(streamed);
+        DOMDocument* reparsed=XMLToolingConfig::getConfig().getParser().parse(in);
+        TS_ASSERT(reparsed!=nullptr);
+        const DOMElement* e = XMLHelper::getFirstChildElement(reparsed->getDocumentElement());
+        TS_ASSERT(e!=nullptr);
+        TS_ASSERT(XMLHelper::isNodeNamed(e, SimpleXMLObject::NAMESPACE, SimpleXMLObject::LOCAL_NAME));
+        auto_ptr_XMLCh id("Id");
+        auto_ptr_XMLCh foo("Foo");
+        TS_ASSERT(XMLString::equals(e->getAttributeNS(nullptr, id.get()), foo.get()));
+        reparsed->release();
+    }
+
 };
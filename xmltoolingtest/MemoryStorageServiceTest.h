@@ -47,4 +47,142 @@ public:
         TSM_ASSERT("Delete failed.", storage->deleteString("context", "foo2"));
         storage->reap("context");
     }
+
+    void testContextOperations() {
+        scoped_ptr<StorageService> storage(
+            XMLToolingConfig::getConfig().StorageServiceManager.newPlugin(MEMORY_STORAGE_SERVICE,nullptr,false)
+            );
+
+        // Enough keys to land in every shard.
+        char key[32];
+        for (int i=0; i<100; ++i) {
+            sprintf(key, "key%d", i);
+            TS_ASSERT(storage->createString("context", key, "value", time(nullptr) + 60));
+        }
+        TSM_ASSERT("Duplicate record created.", !storage->createString("context", "key5", "value", time(nullptr) + 60));
+
+        time_t exp = time(nullptr) + 3600, recorded = 0;
+        storage->updateContext("context", exp);
+        for (int i=0; i<100; ++i) {
+            sprintf(key, "key%d", i);
+            TS_ASSERT_EQUALS(1, storage->readString("context", key, nullptr, &recorded));
+            TS_ASSERT_EQUALS(exp, recorded);
+        }
+
+        storage->deleteContext("context");
+        for (int i=0; i<100; ++i) {
+            sprintf(key, "key%d", i);
+            TSM_ASSERT_EQUALS("Record found in storage.", 0, storage->readString("context", key));
+        }
+        TSM_ASSERT_EQUALS("Update of missing record succeeded.", 0, storage->updateString("context", "key1", "value"));
+    }
+
+    void testExpiration() {
+        scoped_ptr<StorageService> storage(
+            XMLToolingConfig::getConfig().StorageServiceManager.newPlugin(MEMORY_STORAGE_SERVICE,nullptr,false)
+            );
+
+        time_t now = time(nullptr);
+        char key[32];
+        for (int i=0; i<2500; ++i) {
+            sprintf(key, "key%d", i);
+            storage->createString("context", key, "value", (i % 2) ? now - 10 : now + 60);
+        }
+
+        // Expired records are left alone by updateContext.
+        time_t exp = now + 3600, recorded = 0;
+        storage->updateContext("context", exp);
+        TS_ASSERT_EQUALS(1, storage->readString("context", "key0", nullptr, &recorded));
+        TS_ASSERT_EQUALS(exp, recorded);
+        TSM_ASSERT_EQUALS("Expired record found in storage.", 0, storage->readString("context", "key1"));
+
+        // Shortening an expiration moves the record into the reapable range.
+        TS_ASSERT_EQUALS(1, storage->updateString("context", "key2", nullptr, now - 1));
+        storage->reap("context");
+        TSM_ASSERT_EQUALS("Expired record found in storage.", 0, storage->readString("context", "key2"));
+        TSM_ASSERT_EQUALS("Record not found in storage.", 1, storage->readString("context", "key4"));
+        TSM_ASSERT("Unable to recreate reaped record.", storage->createString("context", "key1", "value", now + 60));
+    }
+
+    void testLimits() {
+        string config("<StorageService shards='1' maxContextRecords='64'/>");
+        DOMDocument* doc=XMLToolingConfig::getConfig().getParser().parse(config.c_str(), config.length());
+        TS_ASSERT(doc!=nullptr);
+        scoped_ptr<StorageService> storage(
+            XMLToolingConfig::getConfig().StorageServiceManager.newPlugin(MEMORY_STORAGE_SERVICE,doc->getDocumentElement(),false)
+            );
+        doc->release();
+
+        char key[32];
+        for (int i=0; i<1000; ++i) {
+            sprintf(key, "key%d", i);
+            storage->createString("context", key, "value", time(nullptr) + 60);
+        }
+        storage->createString("other", "key", "value", time(nullptr) + 60);
+
+        StorageService::Usage usage;
+        TS_ASSERT(storage->getUsage(usage, "context"));
+        TSM_ASSERT_EQUALS("Context limit not enforced.", 64, usage.records);
+        TSM_ASSERT_EQUALS("Most recent record was evicted.", 1, storage->readString("context", "key999"));
+        TS_ASSERT(storage->getUsage(usage));
+        TS_ASSERT_EQUALS(65, usage.records);
+        TS_ASSERT(usage.bytes > 0);
+
+        storage->deleteContext("context");
+        TS_ASSERT(storage->getUsage(usage, "context"));
+        TS_ASSERT_EQUALS(0, usage.records);
+        TS_ASSERT_EQUALS(0, usage.bytes);
+    }
+
+    void testContextLimitsAcrossShards() {
+        // A context limit counts the whole context, not the slice of it held by one shard.
+        string config("<StorageService maxContextRecords='64'/>");
+        DOMDocument* doc=XMLToolingConfig::getConfig().getParser().parse(config.c_str(), config.length());
+        TS_ASSERT(doc!=nullptr);
+        scoped_ptr<StorageService> storage(
+            XMLToolingConfig::getConfig().StorageServiceManager.newPlugin(MEMORY_STORAGE_SERVICE,doc->getDocumentElement(),false)
+            );
+        doc->release();
+
+        char key[32];
+        for (int i=0; i<64; ++i) {
+            sprintf(key, "key%d", i);
+            storage->createString("context", key, "value", time(nullptr) + 60);
+        }
+
+        StorageService::Usage usage;
+        TS_ASSERT(storage->getUsage(usage, "context"));
+        TSM_ASSERT_EQUALS("Record evicted below the context limit.", 64, usage.records);
+        for (int i=0; i<64; ++i) {
+            sprintf(key, "key%d", i);
+            TSM_ASSERT_EQUALS("Record evicted below the context limit.", 1, storage->readString("context", key));
+        }
+
+        storage->createString("context", "key64", "value", time(nullptr) + 60);
+        TS_ASSERT(storage->getUsage(usage, "context"));
+        TSM_ASSERT_EQUALS("Context limit not enforced.", 64, usage.records);
+        TSM_ASSERT_EQUALS("Most recent record was evicted.", 1, storage->readString("context", "key64"));
+    }
+
+    void testSmallLimits() {
+        // A limit below the shard count isn't rounded up to one record per shard.
+        string config("<StorageService maxRecords='5'/>");
+        DOMDocument* doc=XMLToolingConfig::getConfig().getParser().parse(config.c_str(), config.length());
+        TS_ASSERT(doc!=nullptr);
+        scoped_ptr<StorageService> storage(
+            XMLToolingConfig::getConfig().StorageServiceManager.newPlugin(MEMORY_STORAGE_SERVICE,doc->getDocumentElement(),false)
+            );
+        doc->release();
+
+        char key[32];
+        for (int i=0; i<100; ++i) {
+            sprintf(key, "key%d", i);
+            storage->createString("context", key, "value", time(nullptr) + 60);
+        }
+
+        StorageService::Usage usage;
+        TS_ASSERT(storage->getUsage(usage));
+        TSM_ASSERT("Storage limit exceeded.", usage.records <= 5);
+        TS_ASSERT(usage.records > 0);
+    }
 };
@@ -21,6 +21,8 @@
 #include "XMLObjectBaseTestCase.h"
 
 #include <fstream>
+#include <xmltooling/io/StreamingUnmarshaller.h>
+#include <xmltooling/util/Threads.h>
 #include <xercesc/util/XMLUniDefs.hpp>
 
 const XMLCh SimpleXMLObject::NAMESPACE[] = {
@@ -157,6 +159,289 @@ public:
         TSM_ASSERT_EQUALS("Child's schema type was not expected value", qtype, *(kids.back()->getSchemaType()));
     }
 
+    void testStructuralClone() {
+        string path=data_path + "SimpleXMLObjectWithChildren.xml";
+        ifstream fs(path.c_str());
+        DOMDocument* doc=XMLToolingConfig::getConfig().getParser().parse(fs);
+        TS_ASSERT(doc!=nullptr);
+
+        const XMLObjectBuilder* b = XMLObjectBuilder::getBuilder(doc->getDocumentElement());
+        TS_ASSERT(b!=nullptr);
+
+        scoped_ptr<SimpleXMLObject> sxObject(
+            dynamic_cast<SimpleXMLObject*>(b->buildFromDocument(doc))
+            );
+        TS_ASSERT(sxObject.get()!=nullptr);
+
+        // Without a signature in the DOM, the clone is copied directly and marshalls back the same.
+        scoped_ptr<SimpleXMLObject> clonedObject(dynamic_cast<SimpleXMLObject*>(sxObject->clone()));
+        TS_ASSERT(clonedObject.get()!=nullptr);
+        TS_ASSERT(clonedObject->getDOM()==nullptr);
+        TSM_ASSERT_EQUALS("Number of child elements was not expected value", 3, clonedObject->getSimpleXMLObjects().size());
+        TS_ASSERT(clonedObject->marshall()->isEqualNode(sxObject->getDOM()));
+    }
+
+    void testLazyClone() {
+        string path=data_path + "SimpleXMLObjectWithChildren.xml";
+        ifstream fs(path.c_str());
+        DOMDocument* doc=XMLToolingConfig::getConfig().getParser().parse(fs);
+        TS_ASSERT(doc!=nullptr);
+
+        const XMLObjectBuilder* b = XMLObjectBuilder::getBuilder(doc->getDocumentElement());
+        TS_ASSERT(b!=nullptr);
+
+        scoped_ptr<SimpleXMLObject> sxObject(
+            dynamic_cast<SimpleXMLObject*>(b->buildFromDocument(doc, true, true))
+            );
+        TS_ASSERT(sxObject.get()!=nullptr);
+
+        // Content that was never accessed has to be unmarshalled to be copied.
+        scoped_ptr<SimpleXMLObject> clonedObject(dynamic_cast<SimpleXMLObject*>(sxObject->clone()));
+        TS_ASSERT(clonedObject.get()!=nullptr);
+        TS_ASSERT(clonedObject->getDOM()==nullptr);
+        TSM_ASSERT_EQUALS("Number of child elements was not expected value", 3, clonedObject->getSimpleXMLObjects().size());
+        auto_ptr_XMLCh expected("Bar");
+        TSM_ASSERT("Child's element content was not expected value",
+            XMLString::equals(expected.get(), clonedObject->getSimpleXMLObjects()[1]->getValue()));
+        TS_ASSERT(clonedObject->marshall()->isEqualNode(sxObject->getDOM()));
+    }
+
+    void testGetXMLObjectById() {
+        string path=data_path + "SimpleXMLObjectWithChildren.xml";
+        ifstream fs(path.c_str());
+        DOMDocument* doc=XMLToolingConfig::getConfig().getParser().parse(fs);
+        TS_ASSERT(doc!=nullptr);
+
+        const XMLObjectBuilder* b = XMLObjectBuilder::getBuilder(doc->getDocumentElement());
+        TS_ASSERT(b!=nullptr);
+
+        scoped_ptr<SimpleXMLObject> sxObject(
+            dynamic_cast<SimpleXMLObject*>(b->buildFromDocument(doc))
+            );
+        TS_ASSERT(sxObject.get()!=nullptr);
+
+        auto_ptr_XMLCh foo("Foo");
+        auto_ptr_XMLCh bar("Bar");
+        VectorOf(SimpleXMLObject) kids=sxObject->getSimpleXMLObjects();
+        TS_ASSERT_EQUALS(static_cast<XMLObject*>(kids.front()), XMLHelper::getXMLObjectById(*sxObject, foo.get()));
+        TS_ASSERT(XMLHelper::getXMLObjectById(*sxObject, bar.get())==nullptr);
+
+        // Lookups must track changes made after the first one.
+        kids[1]->setId(bar.get());
+        TS_ASSERT_EQUALS(static_cast<XMLObject*>(kids[1]), XMLHelper::getXMLObjectById(*sxObject, bar.get()));
+        kids.erase(kids.begin());
+        TS_ASSERT(XMLHelper::getXMLObjectById(*sxObject, foo.get())==nullptr);
+        kids.push_back(SimpleXMLObjectBuilder::buildSimpleXMLObject());
+        kids.back()->setId(foo.get());
+        TS_ASSERT_EQUALS(static_cast<XMLObject*>(kids.back()), XMLHelper::getXMLObjectById(*sxObject, foo.get()));
+
+        // Objects added after a lookup are found, along with their own children.
+        auto_ptr_XMLCh baz("Baz");
+        TS_ASSERT(XMLHelper::getXMLObjectById(*sxObject, baz.get())==nullptr);
+        SimpleXMLObject* added = SimpleXMLObjectBuilder::buildSimpleXMLObject();
+        kids.push_back(added);
+        TS_ASSERT(XMLHelper::getXMLObjectById(*sxObject, baz.get())==nullptr);
+        SimpleXMLObject* grandchild = SimpleXMLObjectBuilder::buildSimpleXMLObject();
+        grandchild->setId(baz.get());
+        added->getSimpleXMLObjects().push_back(grandchild);
+        TS_ASSERT_EQUALS(static_cast<XMLObject*>(grandchild), XMLHelper::getXMLObjectById(*sxObject, baz.get()));
+    }
+
+    void testUnmarshallingWithArena() {
+        string path=data_path + "SimpleXMLObjectWithChildren.xml";
+        ifstream fs(path.c_str());
+        DOMDocument* doc=XMLToolingConfig::getConfig().getParser().parse(fs);
+        TS_ASSERT(doc!=nullptr);
+
+        const XMLObjectBuilder* b = XMLObjectBuilder::getBuilder(doc->getDocumentElement());
+        TS_ASSERT(b!=nullptr);
+
+        scoped_ptr<SimpleXMLObject> sxObject;
+        {
+            XMLObjectArena arena;
+            sxObject.reset(dynamic_cast<SimpleXMLObject*>(b->buildFromDocument(doc)));
+            TS_ASSERT(sxObject.get()!=nullptr);
+            TSM_ASSERT("Object was not allocated from the arena", arena.contains(*sxObject));
+            TSM_ASSERT("Child was not allocated from the arena", arena.contains(*(sxObject->getSimpleXMLObjects().front())));
+
+            XMLObjectArena nested;
+            scoped_ptr<SimpleXMLObject> inner(SimpleXMLObjectBuilder::buildSimpleXMLObject());
+            TSM_ASSERT("Object was not allocated from the innermost arena", nested.contains(*inner));
+            TSM_ASSERT("Object was allocated from an outer arena", !arena.contains(*inner));
+        }
+        scoped_ptr<SimpleXMLObject> heapObject(SimpleXMLObjectBuilder::buildSimpleXMLObject());
+        {
+            XMLObjectArena arena;
+            TSM_ASSERT("Object built outside of the arena's scope was allocated from it", !arena.contains(*heapObject));
+        }
+
+        // Objects outlive the arena's scope, and can be mixed with heap-allocated ones.
+        VectorOf(SimpleXMLObject) kids=sxObject->getSimpleXMLObjects();
+        TSM_ASSERT_EQUALS("Number of child elements was not expected value", 3, kids.size());
+        kids.erase(kids.begin());
+        kids.push_back(SimpleXMLObjectBuilder::buildSimpleXMLObject());
+        TSM_ASSERT_EQUALS("Number of child elements was not expected value", 3, kids.size());
+        xmltooling::QName qtype(SimpleXMLObject::NAMESPACE,SimpleXMLObject::TYPE_NAME);
+        TSM_ASSERT_EQUALS("Child's schema type was not expected value", qtype, *(kids[1]->getSchemaType()));
+    }
+
+    void testArenaAllocationForms() {
+        XMLObjectArena arena;
+        scoped_ptr<SimpleXMLObject> nothrowObject(new (std::nothrow) SimpleXMLObject());
+        TS_ASSERT(nothrowObject.get()!=nullptr);
+        TSM_ASSERT("Object was not allocated from the arena", arena.contains(*nothrowObject));
+
+        void* buf = ::operator new(sizeof(SimpleXMLObject));
+        SimpleXMLObject* placed = new (buf) SimpleXMLObject();
+        TSM_ASSERT("Object in caller's storage was claimed by the arena", !arena.contains(*placed));
+        placed->~SimpleXMLObject();
+        ::operator delete(buf);
+    }
+
+    void testLazyUnmarshalling() {
+        string path=data_path + "SimpleXMLObjectWithChildren.xml";
+        ifstream fs(path.c_str());
+        DOMDocument* doc=XMLToolingConfig::getConfig().getParser().parse(fs);
+        TS_ASSERT(doc!=nullptr);
+
+        const XMLObjectBuilder* b = XMLObjectBuilder::getBuilder(doc->getDocumentElement());
+        TS_ASSERT(b!=nullptr);
+
+        scoped_ptr<SimpleXMLObject> sxObject(
+            dynamic_cast<SimpleXMLObject*>(b->buildFromDocument(doc, true, true))
+            );
+        TS_ASSERT(sxObject.get()!=nullptr);
+
+        // Children are unmarshalled on first access, and the cached DOM is left alone.
+        DOMElement* dom = sxObject->getDOM();
+        TS_ASSERT(dom!=nullptr);
+        TSM_ASSERT_EQUALS("Number of ordered children was not expected value", 3, sxObject->getOrderedChildren().size());
+        TSM_ASSERT_EQUALS("Cached DOM was released by lazy unmarshalling", dom, sxObject->getDOM());
+
+        VectorOf(SimpleXMLObject) kids=sxObject->getSimpleXMLObjects();
+        TSM_ASSERT_EQUALS("Number of child elements was not expected value", 3, kids.size());
+        auto_ptr_XMLCh expected("Bar");
+        TSM_ASSERT("Child's element content was not expected value", XMLString::equals(expected.get(), kids[1]->getValue()));
+        xmltooling::QName qtype(SimpleXMLObject::NAMESPACE,SimpleXMLObject::TYPE_NAME);
+        TSM_ASSERT_EQUALS("Child's schema type was not expected value", qtype, *(kids.back()->getSchemaType()));
+
+        kids.erase(kids.begin());
+        TSM_ASSERT_EQUALS("Number of child elements was not expected value", 2, sxObject->getSimpleXMLObjects().size());
+    }
+
+    void testParseFromMemoryAndFile() {
+        string path=data_path + "SimpleXMLObjectWithChildren.xml";
+        DOMDocument* doc=XMLToolingConfig::getConfig().getParser().parseFile(path.c_str());
+        TS_ASSERT(doc!=nullptr);
+        TS_ASSERT(doc->getDocumentURI()!=nullptr);
+        TS_ASSERT(!XMLPlatformUtils::isRelative(doc->getDocumentURI()));
+
+        string buf;
+        XMLHelper::serialize(doc->getDocumentElement(), buf);
+        DOMDocument* doc2=XMLToolingConfig::getConfig().getParser().parse(buf.c_str(), buf.length());
+        TS_ASSERT(doc2!=nullptr);
+        TS_ASSERT(doc->getDocumentElement()->isEqualNode(doc2->getDocumentElement()));
+        doc2->release();
+        doc->release();
+
+        string missing=data_path + "NoSuchFile.xml";
+        TS_ASSERT_THROWS(XMLToolingConfig::getConfig().getParser().parseFile(missing.c_str()),XMLParserException);
+    }
+
+    string readResource(ParserPool& pool, const char* systemId) {
+        auto_ptr_XMLCh widenit(systemId);
+        scoped_ptr<DOMLSInput> input(pool.resolveResource(nullptr, nullptr, nullptr, widenit.get(), nullptr));
+        TS_ASSERT(input.get()!=nullptr);
+        scoped_ptr<BinInputStream> in(input->getByteStream()->makeStream());
+        TS_ASSERT(in.get()!=nullptr);
+        string bytes;
+        XMLByte buf[1024];
+        XMLSize_t len;
+        while ((len = in->readBytes(buf, sizeof(buf))) > 0)
+            bytes.append(reinterpret_cast<const char*>(buf), len);
+        return bytes;
+    }
+
+    void testResourceCache() {
+        ParserPool pool(true, true);
+        string path=data_path + "SimpleXMLObjectWithChildren.xml";
+        auto_ptr_XMLCh ns("urn:example:resource");
+        auto_ptr_XMLCh widenit(path.c_str());
+        TS_ASSERT(pool.loadSchema(ns.get(), widenit.get()));
+
+        ifstream fs(path.c_str(), ios::in | ios::binary);
+        string expected((istreambuf_iterator<char>(fs)), istreambuf_iterator<char>());
+        TSM_ASSERT_EQUALS("Resolved resource was not expected value", expected, readResource(pool, "urn:example:resource"));
+        TSM_ASSERT_EQUALS("Cached resource was not expected value", expected, readResource(pool, "urn:example:resource"));
+
+        // Blocked requests stay blocked on repeat.
+        TS_ASSERT(readResource(pool, "http://example.org/blocked.xsd").empty());
+        TS_ASSERT(readResource(pool, "http://example.org/blocked.xsd").empty());
+    }
+
+    void testParserPoolReuse() {
+        ParserPool pool;
+        pool.warmUp(1);
+
+        string path=data_path + "SimpleXMLObjectWithChildren.xml";
+        string dtdpath=data_path + "DTD.xml";
+        for (int i=0; i<4; ++i) {
+            if (i == 2) {
+                // A failed parse hands the parser back for reuse.
+                ifstream fs(dtdpath.c_str());
+                TS_ASSERT_THROWS(pool.parse(fs),XMLParserException);
+                continue;
+            }
+            ifstream fs(path.c_str());
+            DOMDocument* doc=pool.parse(fs);
+            TS_ASSERT(doc!=nullptr);
+            doc->release();
+        }
+
+        ParserPool::Statistics stats=pool.getStatistics();
+        TSM_ASSERT_EQUALS("Number of parsers created was not expected value", 1, stats.created);
+        TSM_ASSERT_EQUALS("Number of parsers reused was not expected value", 4, stats.reused);
+        TSM_ASSERT_EQUALS("Number of waits was not expected value", 0, stats.waited);
+    }
+
+    static void* parse_fn(void* arg) {
+        ParserPool* pool = reinterpret_cast<ParserPool*>(arg);
+        string path=data_path + "SimpleXMLObjectWithChildren.xml";
+        ifstream fs(path.c_str());
+        DOMDocument* doc=pool->parse(fs);
+        if (doc)
+            doc->release();
+        return nullptr;
+    }
+
+    void testBoundedParserPool() {
+        ParserPool pool;
+        parse_fn(&pool);
+
+        // The parser this thread kept is handed back, so another thread neither waits nor creates one.
+        pool.setLimits(1, 1);
+        Thread* t = Thread::create(&parse_fn, &pool);
+        t->join(nullptr);
+        delete t;
+
+        ParserPool::Statistics stats=pool.getStatistics();
+        TSM_ASSERT_EQUALS("Number of parsers created was not expected value", 1, stats.created);
+        TSM_ASSERT_EQUALS("Number of parsers reused was not expected value", 1, stats.reused);
+        TSM_ASSERT_EQUALS("Number of waits was not expected value", 0, stats.waited);
+    }
+
+    void testManyParserPools() {
+        // More pools than a platform has thread keys, each leaving its parser with this thread.
+        string path=data_path + "SimpleXMLObjectWithChildren.xml";
+        for (int i=0; i<1100; ++i) {
+            ParserPool pool;
+            ifstream fs(path.c_str());
+            DOMDocument* doc=pool.parse(fs);
+            TS_ASSERT(doc!=nullptr);
+            doc->release();
+        }
+    }
+
     void testUnmarshallingWithUnknownChild() {
         string path=data_path + "SimpleXMLObjectWithUnknownChild.xml";
         ifstream fs(path.c_str());
@@ -169,4 +454,54 @@ public:
         TS_ASSERT_THROWS(b->buildFromDocument(doc),UnmarshallingException);
         doc->release();
     }
+
+    void testStreamingUnmarshallingWithDTD() {
+        string path=data_path + "DTD.xml";
+        ifstream fs(path.c_str());
+        StreamingUnmarshaller unmarshaller;
+        TS_ASSERT_THROWS(unmarshaller.unmarshall(fs),XMLParserException);
+    }
+
+    void testStreamingUnmarshallingWithAttributes() {
+        string path=data_path + "SimpleXMLObjectWithAttribute.xml";
+        ifstream fs(path.c_str());
+        StreamingUnmarshaller unmarshaller;
+        scoped_ptr<SimpleXMLObject> sxObject(dynamic_cast<SimpleXMLObject*>(unmarshaller.unmarshall(fs)));
+        TS_ASSERT(sxObject.get()!=nullptr);
+        TS_ASSERT(sxObject->getDOM()==nullptr);
+
+        auto_ptr_XMLCh expected("Firefly");
+        TSM_ASSERT("ID was not expected value", XMLString::equals(expected.get(), sxObject->getId()));
+    }
+
+    void testStreamingUnmarshallingWithChildElements() {
+        string path=data_path + "SimpleXMLObjectWithChildren.xml";
+        ifstream fs(path.c_str());
+        StreamingUnmarshaller unmarshaller;
+        scoped_ptr<SimpleXMLObject> sxObject(dynamic_cast<SimpleXMLObject*>(unmarshaller.unmarshall(fs)));
+        TS_ASSERT(sxObject.get()!=nullptr);
+        TS_ASSERT(sxObject->getDOM()==nullptr);
+
+        VectorOf(SimpleXMLObject) kids=sxObject->getSimpleXMLObjects();
+        TSM_ASSERT_EQUALS("Number of child elements was not expected value", 3, kids.size());
+        auto_ptr_XMLCh expected("Bar");
+        TSM_ASSERT("Element content was not expected value", XMLString::equals(expected.get(), kids[1]->getValue()));
+        xmltooling::QName qtype(SimpleXMLObject::NAMESPACE,SimpleXMLObject::TYPE_NAME);
+        TSM_ASSERT_EQUALS("Child's schema type was not expected value", qtype, *(kids.back()->getSchemaType()));
+
+        // The DOM is rebuilt on demand.
+        DOMElement* rootElement = sxObject->marshall();
+        ifstream fs2(path.c_str());
+        DOMDocument* doc=XMLToolingConfig::getConfig().getParser().parse(fs2);
+        TS_ASSERT(doc!=nullptr);
+        TS_ASSERT(rootElement->isEqualNode(doc->getDocumentElement()));
+        doc->release();
+    }
+
+    void testStreamingUnmarshallingWithUnknownChild() {
+        string path=data_path + "SimpleXMLObjectWithUnknownChild.xml";
+        ifstream fs(path.c_str());
+        StreamingUnmarshaller unmarshaller;
+        TS_ASSERT_THROWS(unmarshaller.unmarshall(fs),UnmarshallingException);
+    }
 };
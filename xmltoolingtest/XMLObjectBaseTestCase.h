@@ -102,10 +102,12 @@ public:
     }
 
     XMLObject* clone() const {
-        auto_ptr<XMLObject> domClone(AbstractDOMCachingXMLObject::clone());
-        SimpleXMLObject* ret=dynamic_cast<SimpleXMLObject*>(domClone.get());
-        if (ret)
-            return domClone.release();
+        if (requiresDOMClone()) {
+            auto_ptr<XMLObject> domClone(AbstractDOMCachingXMLObject::clone());
+            SimpleXMLObject* ret=dynamic_cast<SimpleXMLObject*>(domClone.get());
+            if (ret)
+                return domClone.release();
+        }
 
         return new SimpleXMLObject(*this);
     }
@@ -119,19 +121,23 @@ public:
 
 #ifndef XMLTOOLING_NO_XMLSEC    
     Signature* getSignature() const {
+        materializeContent();
         return dynamic_cast<Signature*>(*m_signature);
     }
 
     void setSignature(Signature* sig) {
+        materializeContent();
         *m_signature=prepareForAssignment(*m_signature,sig);
     }
 #endif
 
     VectorOf(SimpleXMLObject) getSimpleXMLObjects() {
+        materializeContent();
         return VectorOf(SimpleXMLObject)(this, m_simples, &m_children, m_children.end());
     }
     
     const std::vector<SimpleXMLObject*>& getSimpleXMLObjects() const {
+        materializeContent();
         return m_simples;
     }
 
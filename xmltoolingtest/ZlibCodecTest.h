@@ -0,0 +1,132 @@
+/**
+ * Licensed to the University Corporation for Advanced Internet
+ * Development, Inc. (UCAID) under one or more contributor license
+ * agreements. See the NOTICE file distributed with this work for
+ * additional information regarding copyright ownership.
+ *
+ * UCAID licenses this file to you under the Apache License,
+ * Version 2.0 (the "License"); you may not use this file except
+ * in compliance with the License. You may obtain a copy of the
+ * License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ */
+
+#include "XMLObjectBaseTestCase.h"
+
+#include <sstream>
+#include <boost/lexical_cast.hpp>
+#include <xmltooling/exceptions.h>
+#include <xmltooling/util/XMLHelper.h>
+#include <xmltooling/util/ZlibCodec.h>
+
+class ZlibCodecTest : public CxxTest::TestSuite {
+    string m_data;
+
+public:
+    void setUp() {
+        m_data.erase();
+        for (int i = 0; i < 5000; ++i)
+            m_data += "<saml:Attribute Name=\"urn:oid:" + boost::lexical_cast<string>(i % 97) + "\"/>";
+    }
+
+    void testRoundTrip() {
+        ZlibCodec deflater(ZlibCodec::DEFLATE, 9);
+        string deflated;
+        for (size_t pos = 0; pos < m_data.length(); pos += 1000)
+            deflater.update(m_data.data() + pos, min<size_t>(1000, m_data.length() - pos), deflated);
+        deflater.finish(deflated);
+        TS_ASSERT(deflater.isFinished());
+        TS_ASSERT(deflated.length() < m_data.length());
+
+        ZlibCodec inflater(ZlibCodec::INFLATE);
+        string inflated;
+        for (size_t pos = 0; pos < deflated.length(); pos += 7)
+            inflater.update(deflated.data() + pos, min<size_t>(7, deflated.length() - pos), inflated);
+        inflater.finish(inflated);
+        TSM_ASSERT_EQUALS("Inflated data was not expected value", m_data, inflated);
+        TS_ASSERT_EQUALS(m_data.length(), inflater.getTotalOut());
+
+        // Reuse for a second stream, at a different level.
+        deflater.reset();
+        deflater.setParameters(1);
+        string deflated2;
+        deflater.update(m_data.data(), m_data.length(), deflated2);
+        deflater.finish(deflated2);
+        inflater.reset();
+        ostringstream out;
+        inflater.update(deflated2.data(), deflated2.length(), out);
+        inflater.finish(out);
+        TSM_ASSERT_EQUALS("Inflated data was not expected value", m_data, out.str());
+    }
+
+    void testTruncated() {
+        ZlibCodec& deflater = ZlibCodec::getCodec(ZlibCodec::DEFLATE);
+        string deflated;
+        deflater.update(m_data.data(), m_data.length(), deflated);
+        deflater.finish(deflated);
+
+        ZlibCodec& inflater = ZlibCodec::getCodec(ZlibCodec::INFLATE);
+        string inflated;
+        inflater.update(deflated.data(), deflated.length() / 2, inflated);
+        TS_ASSERT_THROWS(inflater.finish(inflated), IOException);
+    }
+
+    void testOutputLimit() {
+        string zeros(1024 * 1024, '\0');
+        ZlibCodec& deflater = ZlibCodec::getCodec(ZlibCodec::DEFLATE);
+        string deflated;
+        deflater.update(zeros.data(), zeros.length(), deflated);
+        deflater.finish(deflated);
+
+        ZlibCodec& inflater = ZlibCodec::getCodec(ZlibCodec::INFLATE);
+        inflater.setOutputLimit(zeros.length() / 2);
+        string inflated;
+        TS_ASSERT_THROWS(inflater.update(deflated.data(), deflated.length(), inflated), IOException);
+
+        // The limit is gone once the codec is handed out again.
+        ZlibCodec& inflater2 = ZlibCodec::getCodec(ZlibCodec::INFLATE);
+        inflated.erase();
+        inflater2.update(deflated.data(), deflated.length(), inflated);
+        inflater2.finish(inflated);
+        TS_ASSERT_EQUALS(zeros.length(), inflated.length());
+
+        // Far beyond the ratio XMLHelper allows.
+        stringstream out;
+        TS_ASSERT_EQUALS(0, XMLHelper::inflate(const_cast<char*>(deflated.data()), deflated.length(), out));
+    }
+
+    void testThreadCodecDefaults() {
+        // A level set by one caller doesn't leak into the next stream from getCodec().
+        ZlibCodec& deflater = ZlibCodec::getCodec(ZlibCodec::DEFLATE);
+        deflater.setParameters(0);
+        string stored;
+        deflater.update(m_data.data(), m_data.length(), stored);
+        deflater.finish(stored);
+        TS_ASSERT(stored.length() > m_data.length());
+
+        ZlibCodec& deflater2 = ZlibCodec::getCodec(ZlibCodec::DEFLATE);
+        string deflated;
+        deflater2.update(m_data.data(), m_data.length(), deflated);
+        deflater2.finish(deflated);
+        TS_ASSERT(deflated.length() < m_data.length() / 4);
+    }
+
+    void testXMLHelper() {
+        unsigned int len = 0;
+        char* deflated = XMLHelper::deflate(const_cast<char*>(m_data.c_str()), m_data.length(), &len);
+        TS_ASSERT(deflated != nullptr);
+        TS_ASSERT(len > 0);
+
+        stringstream out;
+        TS_ASSERT_EQUALS(m_data.length(), XMLHelper::inflate(deflated, len, out));
+        TSM_ASSERT_EQUALS("Inflated data was not expected value", m_data, out.str());
+        delete[] deflated;
+    }
+};